@@ -1,568 +1,854 @@
-#define _USE_MATH_DEFINES  
+// Programa de linea de ordenes de libhilos: resuelve una imagen, un lote de
+// imagenes (--lote), redibuja una secuencia (--reproducir) o mide los nucleos
+// de puntuacion (--bench-kernels)
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <math.h>
-#include <time.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <pthread.h>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+#ifndef _WIN32
+#include <sys/resource.h>
 #endif
 
-// Representa un punto en el plano 2D (coordenadas de clavos)
-typedef struct {
-    double x, y;
-} Punto;
+#include "libhilos.h"
 
-// Representa un hilo entre dos clavos con su beneficio asociado
-typedef struct {
-    int clavo1, clavo2;  // Indices de los clavos conectados
-    double error;        // Beneficio de dibujar este hilo
-    double puntuacion;   // Puntuacion para ordenacion
-} Hilo;
+static const char *nombres_disposiciones[NUM_DISPOSICIONES] = {
+    "rectangulo", "circulo", "elipse", "fichero"
+};
 
-// Representa una imagen en escala de grises formato PGM
-typedef struct {
-    int ancho, alto;
-    unsigned char **pixels;  // Matriz de pixeles [alto][ancho]
-} Imagen;
+static const char *nombres_fases[NUM_FASES] = {
+    "lectura", "clavos", "muestreo", "puntuacion", "ordenacion", "dibujo", "error", "escritura"
+};
 
-// Parametros del algoritmo voraz
-typedef struct {
-    int n;  // Numero de clavos
-    int p;  // Numero de hilos candidatos por iteracion
-    int s;  // Numero de mejores hilos a seleccionar
-} Parametros;
+// Si es true no se muestra el progreso por consola
+static bool silencioso = false;
 
-// Lee una imagen en formato PGM desde archivo
-Imagen* leer_pgm(const char *nombre_archivo) {
-    FILE *archivo = fopen(nombre_archivo, "r");
-    if (archivo == NULL) {
-        fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", nombre_archivo);
-        return NULL;
-    }
-    
-    char formato[3];
-    if (fscanf(archivo, "%2s", formato) != 1 || strcmp(formato, "P2") != 0) {
-        fprintf(stderr, "Error: Formato PGM no valido (debe ser P2)\n");
-        fclose(archivo);
-        return NULL;
-    }
-    
-    Imagen *img = (Imagen*)malloc(sizeof(Imagen));
-    if (img == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria\n");
-        fclose(archivo);
-        return NULL;
-    }
-    
-    int max_valor;
-    if (fscanf(archivo, "%d %d %d", &img->ancho, &img->alto, &max_valor) != 3) {
-        fprintf(stderr, "Error: No se pudo leer dimensiones de la imagen\n");
-        free(img);
-        fclose(archivo);
-        return NULL;
-    }
-    
-    img->pixels = (unsigned char**)malloc(img->alto * sizeof(unsigned char*));
-    if (img->pixels == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para pixeles\n");
-        free(img);
-        fclose(archivo);
-        return NULL;
-    }
-    
-    for (int i = 0; i < img->alto; i++) {
-        img->pixels[i] = (unsigned char*)malloc(img->ancho * sizeof(unsigned char));
-        if (img->pixels[i] == NULL) {
-            fprintf(stderr, "Error: No se pudo asignar memoria para fila %d\n", i);
-            for (int j = 0; j < i; j++) {
-                free(img->pixels[j]);
-            }
-            free(img->pixels);
-            free(img);
-            fclose(archivo);
-            return NULL;
+// printf para los mensajes de progreso (se omite en modo silencioso)
+static void informar(const char *formato, ...) {
+    if (silencioso) return;
+    va_list args;
+    va_start(args, formato);
+    vprintf(formato, args);
+    va_end(args);
+}
+
+// Escribe 'texto' como cadena JSON (entre comillas y con los caracteres escapados)
+static void escribir_cadena_json(FILE *archivo, const char *texto) {
+    fputc('"', archivo);
+    for (const unsigned char *c = (const unsigned char*)texto; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fputc('\\', archivo);
+            fputc(*c, archivo);
+        } else if (*c < 0x20) {
+            fprintf(archivo, "\\u%04x", *c);
+        } else {
+            fputc(*c, archivo);
         }
     }
-    
-    int valor;
-    for (int i = 0; i < img->alto; i++) {
-        for (int j = 0; j < img->ancho; j++) {
-            if (fscanf(archivo, "%d", &valor) != 1) {
-                fprintf(stderr, "Error: No se pudo leer pixel en (%d, %d)\n", j, i);
-                for (int k = 0; k < img->alto; k++) {
-                    free(img->pixels[k]);
+    fputc('"', archivo);
+}
+// Lee las opciones desde argv[primera] en adelante
+// Devuelve false (tras informar por stderr) si alguna no es valida
+static bool leer_opciones(int argc, char *argv[], int primera, Parametros *params,
+                          const char **kernel) {
+    for (int i = primera; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            params->memoria_cache_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            params->trabajadores = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            params->escala = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            params->refinar = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            params->semilla = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rng") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "xoshiro") == 0) {
+                params->generador = GENERADOR_XOSHIRO;
+            } else if (strcmp(argv[i], "pcg") == 0) {
+                params->generador = GENERADOR_PCG;
+            } else {
+                fprintf(stderr, "Error: Generador aleatorio no valido: %s (xoshiro o pcg)\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--verificar-error") == 0) {
+            params->verificar_error = true;
+        } else if (strcmp(argv[i], "--aa") == 0) {
+            params->antialias = true;
+        } else if (strcmp(argv[i], "--clavos") == 0 && i + 1 < argc) {
+            // Cualquier valor que no sea una disposicion se toma como fichero
+            i++;
+            params->disposicion = DISPOSICION_FICHERO;
+            params->fichero_clavos = argv[i];
+            for (int d = 0; d < DISPOSICION_FICHERO; d++) {
+                if (strcmp(argv[i], nombres_disposiciones[d]) == 0) {
+                    params->disposicion = (TipoDisposicion)d;
+                    params->fichero_clavos = NULL;
                 }
-                free(img->pixels);
-                free(img);
-                fclose(archivo);
-                return NULL;
             }
-            img->pixels[i][j] = (unsigned char)valor;
+        } else if (strcmp(argv[i], "--simetrias") == 0) {
+            params->compartir_simetrias = true;
+        } else if (strcmp(argv[i], "--sin-simetrias") == 0) {
+            params->compartir_simetrias = false;
+        } else if (strcmp(argv[i], "--max-hilos") == 0 && i + 1 < argc) {
+            params->max_hilos = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tiempo") == 0 && i + 1 < argc) {
+            params->limite_tiempo = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--secuencia") == 0 && i + 1 < argc) {
+            params->secuencia = argv[++i];
+        } else if (strcmp(argv[i], "-q") == 0 || strcmp(argv[i], "--silencioso") == 0) {
+            silencioso = true;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            // La salida estandar queda solo para el objeto JSON
+            params->estadisticas_json = true;
+            silencioso = true;
+        } else if (strcmp(argv[i], "--stats=texto") == 0) {
+            params->estadisticas_json = false;
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            *kernel = argv[++i];
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "muestreo") == 0) {
+                params->modo = MODO_MUESTREO;
+            } else if (strcmp(argv[i], "continuo") == 0) {
+                params->modo = MODO_CONTINUO;
+            } else if (strcmp(argv[i], "monticulo") == 0) {
+                params->modo = MODO_MONTICULO;
+            } else {
+                fprintf(stderr, "Error: Modo de seleccion no valido: %s\n", argv[i]);
+                return false;
+            }
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "p5") == 0 || strcmp(argv[i], "P5") == 0) {
+                params->salida_binaria = true;
+            } else if (strcmp(argv[i], "p2") == 0 || strcmp(argv[i], "P2") == 0) {
+                params->salida_binaria = false;
+            } else {
+                fprintf(stderr, "Error: Formato de salida no valido: %s (p2 o p5)\n", argv[i]);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Error: Opcion no reconocida: %s\n", argv[i]);
+            return false;
         }
     }
-    
-    fclose(archivo);
-    return img;
+    return true;
 }
 
-// Escribe una imagen en formato PGM a archivo
-int escribir_pgm(const char *nombre_archivo, Imagen *img) {
-    FILE *archivo = fopen(nombre_archivo, "w");
-    if (archivo == NULL) {
-        fprintf(stderr, "Error: No se pudo crear el archivo %s\n", nombre_archivo);
-        return 0;
+// Elige el nucleo de puntuacion pedido con --kernel
+static bool elegir_nucleo(const char *kernel) {
+    if (!seleccionar_nucleo(kernel)) {
+        fprintf(stderr, "Error: Nucleo de puntuacion no disponible en esta CPU: %s\n", kernel);
+        return false;
     }
-    
-    fprintf(archivo, "P2\n");
-    fprintf(archivo, "%d %d\n", img->ancho, img->alto);
-    fprintf(archivo, "255\n");
-    
-    for (int i = 0; i < img->alto; i++) {
-        for (int j = 0; j < img->ancho; j++) {
-            fprintf(archivo, "%d", img->pixels[i][j]);
-            if (j < img->ancho - 1) {
-                fprintf(archivo, " ");
-            }
-        }
-        fprintf(archivo, "\n");
+    return true;
+}
+
+// Funcion de progreso de la linea de ordenes: muestra los mensajes de la biblioteca
+static bool mostrar_progreso(const ProgresoHilos *progreso, void *datos) {
+    (void)datos;
+    if (progreso->mensaje != NULL) {
+        fputs(progreso->mensaje, stdout);
+        fflush(stdout);
     }
-    
-    fclose(archivo);
-    return 1;
+    return true;
 }
 
-// Libera la memoria asignada para una imagen
-void liberar_imagen(Imagen *img) {
-    if (img == NULL) return;
-    if (img->pixels != NULL) {
-        for (int i = 0; i < img->alto; i++) {
-            free(img->pixels[i]);
-        }
-        free(img->pixels);
+// Un trabajo del manifiesto de un lote
+typedef struct {
+    char *imagen;
+    char *salida;
+    int n, p, s;
+    int recurso;   // Indice en Lote.recursos (-1 si no se pudo leer la cabecera)
+} TrabajoLote;
+
+// Clavos y cache de lineas compartidos por los trabajos con igual (ancho, alto, n)
+// Se crean con el primer trabajo que los usa y se liberan con el ultimo
+typedef struct {
+    int ancho, alto, n;
+    Arena arena;       // Memoria de los clavos
+    Punto *clavos;
+    CacheLineas *cache;
+    bool creado;
+    int pendientes;    // Trabajos que aun no han terminado de usarlos
+} RecursoLote;
+
+// Cola de trabajos de un trabajador del lote: el dueño saca por el final y
+// los demas roban por el principio, asi cada uno empieza por trabajos
+// distintos y solo se pelean por la misma cola cuando queda poco
+typedef struct {
+    int *trabajos;
+    int inicio, fin;   // Pendientes: trabajos[inicio .. fin)
+    pthread_mutex_t cerrojo;
+} ColaLote;
+
+typedef struct {
+    TrabajoLote *trabajos;
+    int num_trabajos;
+    RecursoLote *recursos;
+    int num_recursos;
+    pthread_mutex_t cerrojo_recursos;
+    ColaLote *colas;
+    int num_colas;
+    Parametros base;
+    FILE *csv;
+    pthread_mutex_t cerrojo_csv;   // Protege csv y los contadores
+    int completados, fallidos;
+    long long robos;
+    long long aciertos_cache, consultas_cache;
+} Lote;
+
+// Libera los trabajos de un manifiesto
+static void liberar_trabajos_lote(TrabajoLote *trabajos, int num_trabajos) {
+    for (int i = 0; i < num_trabajos; i++) {
+        free(trabajos[i].imagen);
+        free(trabajos[i].salida);
     }
-    free(img);
+    free(trabajos);
 }
 
-// Genera n clavos distribuidos uniformemente en el perimetro rectangular
-Punto* generar_clavos(int n, int ancho, int alto) {
-    Punto *clavos = (Punto*)malloc(n * sizeof(Punto));
-    if (clavos == NULL) return NULL;
+// Lee un manifiesto con una linea "imagen n p s salida" por trabajo
+// (se ignoran las lineas vacias y las que empiezan por #)
+static TrabajoLote* leer_manifiesto(const char *nombre_archivo, const Parametros *base, int *num_trabajos) {
+    FILE *archivo = fopen(nombre_archivo, "r");
+    if (archivo == NULL) {
+        fprintf(stderr, "Error: No se pudo abrir el manifiesto %s\n", nombre_archivo);
+        return NULL;
+    }
     
-    double perimetro = 2.0 * (ancho - 1) + 2.0 * (alto - 1);
-    double distancia_entre_clavos = perimetro / n;
+    int capacidad = 16;
+    TrabajoLote *trabajos = (TrabajoLote*)malloc(capacidad * sizeof(TrabajoLote));
+    *num_trabajos = 0;
+    char linea[4096], imagen[2048], salida[2048], sobrante[2];
+    int num_linea = 0;
+    bool correcto = trabajos != NULL;
     
-    for (int i = 0; i < n; i++) {
-        double pos = i * distancia_entre_clavos;
+    while (correcto && fgets(linea, sizeof(linea), archivo) != NULL) {
+        num_linea++;
+        const char *pos = linea;
+        while (*pos == ' ' || *pos == '\t') pos++;
+        if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == '\0') continue;
         
-        if (pos < ancho - 1) {
-            clavos[i].x = pos;
-            clavos[i].y = 0;
-        } else if (pos < (ancho - 1) + (alto - 1)) {
-            clavos[i].x = ancho - 1;
-            clavos[i].y = pos - (ancho - 1);
-        } else if (pos < 2 * (ancho - 1) + (alto - 1)) {
-            clavos[i].x = (ancho - 1) - (pos - (ancho - 1) - (alto - 1));
-            clavos[i].y = alto - 1;
-        } else {
-            clavos[i].x = 0;
-            clavos[i].y = (alto - 1) - (pos - 2 * (ancho - 1) - (alto - 1));
+        Parametros params = *base;
+        if (sscanf(pos, "%2047s %d %d %d %2047s %1s", imagen, &params.n, &params.p, &params.s,
+                   salida, sobrante) != 5) {
+            fprintf(stderr, "Error: Linea %d del manifiesto no valida (imagen n p s salida)\n", num_linea);
+            correcto = false;
+            break;
+        }
+        if (!validar_parametros(&params)) {
+            fprintf(stderr, "Error: En la linea %d del manifiesto\n", num_linea);
+            correcto = false;
+            break;
+        }
+        
+        if (*num_trabajos == capacidad) {
+            capacidad *= 2;
+            TrabajoLote *ampliado = (TrabajoLote*)realloc(trabajos, capacidad * sizeof(TrabajoLote));
+            if (ampliado == NULL) {
+                correcto = false;
+                break;
+            }
+            trabajos = ampliado;
         }
+        TrabajoLote *t = &trabajos[*num_trabajos];
+        t->imagen = strdup(imagen);
+        t->salida = strdup(salida);
+        t->n = params.n;
+        t->p = params.p;
+        t->s = params.s;
+        t->recurso = -1;
+        (*num_trabajos)++;
+        if (t->imagen == NULL || t->salida == NULL) correcto = false;
     }
+    fclose(archivo);
     
-    return clavos;
+    if (correcto && *num_trabajos == 0) {
+        fprintf(stderr, "Error: El manifiesto %s no contiene trabajos\n", nombre_archivo);
+        correcto = false;
+    }
+    if (!correcto) {
+        if (trabajos == NULL) fprintf(stderr, "Error: No se pudo asignar memoria para el manifiesto\n");
+        liberar_trabajos_lote(trabajos, *num_trabajos);
+        return NULL;
+    }
+    return trabajos;
 }
 
-// Dibuja una linea entre dos puntos usando el algoritmo de Bresenham
-// Cada pixel se oscurece restando 'valor' (permite acumulacion de hilos)
-void dibujar_linea_bresenham(Imagen *img, int x1, int y1, int x2, int y2, 
-                             unsigned char valor, int *num_pixels) {
-    int dx = abs(x2 - x1);
-    int dy = abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
-    
-    int x = x1;
-    int y = y1;
-    *num_pixels = 0;
-    
-    int max_pixels = (int)sqrt(img->ancho * img->ancho + img->alto * img->alto) + 10;
-    
-    while (*num_pixels < max_pixels) {
-        if (x >= 0 && x < img->ancho && y >= 0 && y < img->alto) {
-            if (img->pixels[y][x] >= valor) {
-                img->pixels[y][x] -= valor;
-            } else {
-                img->pixels[y][x] = 0;
-            }
-            (*num_pixels)++;
-        }
-        
-        if (x == x2 && y == y2) break;
+// Agrupa los trabajos por (ancho, alto, n) leyendo solo la cabecera de cada
+// imagen, y cuenta cuantos trabajos usaran cada grupo
+static bool agrupar_recursos_lote(Lote *lote) {
+    lote->recursos = (RecursoLote*)malloc(lote->num_trabajos * sizeof(RecursoLote));
+    lote->num_recursos = 0;
+    if (lote->recursos == NULL) return false;
+    
+    for (int i = 0; i < lote->num_trabajos; i++) {
+        TrabajoLote *t = &lote->trabajos[i];
+        int ancho, alto;
+        if (!leer_dimensiones_pgm(t->imagen, &ancho, &alto)) continue;
         
-        int e2 = 2 * err;
-        
-        if (e2 > -dy) {
-            err -= dy;
-            x += sx;
+        int r = 0;
+        while (r < lote->num_recursos &&
+               (lote->recursos[r].ancho != ancho || lote->recursos[r].alto != alto ||
+                lote->recursos[r].n != t->n)) {
+            r++;
         }
-        if (e2 < dx) {
-            err += dx;
-            y += sy;
+        if (r == lote->num_recursos) {
+            RecursoLote *nuevo = &lote->recursos[lote->num_recursos++];
+            nuevo->ancho = ancho;
+            nuevo->alto = alto;
+            nuevo->n = t->n;
+            iniciar_arena(&nuevo->arena, BLOQUE_ARENA);
+            nuevo->clavos = NULL;
+            nuevo->cache = NULL;
+            nuevo->creado = false;
+            nuevo->pendientes = 0;
         }
+        lote->recursos[r].pendientes++;
+        t->recurso = r;
     }
+    return true;
 }
 
-// Calcula el beneficio de dibujar un hilo entre dos clavos
-// Mayor beneficio = mas oscuridad falta por cubrir en esa trayectoria
-double calcular_error_hilo(Imagen *original, Imagen *actual, Punto *clavos, int clavo1, int clavo2) {
-    int x1 = (int)round(clavos[clavo1].x);
-    int y1 = (int)round(clavos[clavo1].y);
-    int x2 = (int)round(clavos[clavo2].x);
-    int y2 = (int)round(clavos[clavo2].y);
-    
-    int dx = abs(x2 - x1);
-    int dy = abs(y2 - y1);
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
-    int err = dx - dy;
-    
-    int x = x1;
-    int y = y1;
-    double beneficio_total = 0.0;
-    int max_iteraciones = (int)sqrt(original->ancho * original->ancho + original->alto * original->alto) + 10;
-    int iteraciones = 0;
-    
-    while (iteraciones < max_iteraciones) {
-        if (x >= 0 && x < original->ancho && y >= 0 && y < original->alto) {
-            int oscuridad_original = 255 - original->pixels[y][x];
-            int oscuridad_actual = 255 - actual->pixels[y][x];
-            int oscuridad_faltante = oscuridad_original - oscuridad_actual;
-            if (oscuridad_faltante > 0) {
-                beneficio_total += oscuridad_faltante;
-            }
-        }
-        
-        if (x == x2 && y == y2) break;
-        
-        int e2 = 2 * err;
-        
-        if (e2 > -dy) {
-            err -= dy;
-            x += sx;
+// Devuelve (creandolos la primera vez) los clavos y la cache de un grupo
+static bool obtener_recurso_lote(Lote *lote, int r, Punto **clavos, CacheLineas **cache) {
+    RecursoLote *recurso = &lote->recursos[r];
+    bool correcto = true;
+    
+    pthread_mutex_lock(&lote->cerrojo_recursos);
+    if (!recurso->creado) {
+        recurso->creado = true;
+        recurso->clavos = generar_clavos(&recurso->arena, lote->base.disposicion, lote->base.fichero_clavos,
+                                         recurso->n, recurso->ancho, recurso->alto);
+        if (recurso->clavos != NULL && lote->base.memoria_cache_mb > 0) {
+            int paso = (recurso->ancho + ALINEACION - 1) / ALINEACION * ALINEACION;
+            recurso->cache = crear_cache_lineas(recurso->clavos, recurso->n, recurso->ancho,
+                                                recurso->alto, paso,
+                                                (size_t)lote->base.memoria_cache_mb * 1024 * 1024,
+                                                lote->base.antialias, lote->base.compartir_simetrias);
         }
-        if (e2 < dx) {
-            err += dx;
-            y += sy;
-        }
-        
-        iteraciones++;
     }
-    
-    return beneficio_total;
+    *clavos = recurso->clavos;
+    *cache = recurso->cache;
+    if (recurso->clavos == NULL || (lote->base.memoria_cache_mb > 0 && recurso->cache == NULL)) {
+        correcto = false;
+    }
+    pthread_mutex_unlock(&lote->cerrojo_recursos);
+    return correcto;
 }
 
-// Calcula el error total entre dos imagenes (suma de diferencias al cuadrado)
-double calcular_error_total(Imagen *original, Imagen *actual) {
-    if (original->ancho != actual->ancho || original->alto != actual->alto) {
-        return -1.0;
-    }
-    
-    double error_total = 0.0;
-    for (int i = 0; i < original->alto; i++) {
-        for (int j = 0; j < original->ancho; j++) {
-            int diff = abs((int)original->pixels[i][j] - (int)actual->pixels[i][j]);
-            error_total += diff * diff;
+// Marca un trabajo del grupo como terminado y libera el grupo con el ultimo
+static void soltar_recurso_lote(Lote *lote, int r) {
+    if (r < 0) return;
+    RecursoLote *recurso = &lote->recursos[r];
+    
+    pthread_mutex_lock(&lote->cerrojo_recursos);
+    recurso->pendientes--;
+    if (recurso->pendientes == 0) {
+        if (recurso->cache != NULL) {
+            pthread_mutex_lock(&lote->cerrojo_csv);
+            lote->aciertos_cache += recurso->cache->aciertos;
+            lote->consultas_cache += recurso->cache->aciertos + recurso->cache->fallos;
+            pthread_mutex_unlock(&lote->cerrojo_csv);
         }
+        liberar_cache_lineas(recurso->cache);
+        liberar_arena(&recurso->arena);
+        recurso->cache = NULL;
+        recurso->clavos = NULL;
     }
-    
-    return error_total;
+    pthread_mutex_unlock(&lote->cerrojo_recursos);
 }
 
-// Funcion de comparacion para qsort (ordena hilos por beneficio descendente)
-int comparar_hilos(const void *a, const void *b) {
-    Hilo *hilo_a = (Hilo*)a;
-    Hilo *hilo_b = (Hilo*)b;
+// Resuelve un trabajo del lote y escribe su linea en el CSV
+static void ejecutar_trabajo_lote(Lote *lote, int indice) {
+    TrabajoLote *t = &lote->trabajos[indice];
+    Parametros params = lote->base;
+    params.n = t->n;
+    params.p = t->p;
+    params.s = t->s;
+    params.trabajadores = 1;
+    // La semilla de cada trabajo no depende de que trabajador lo ejecute
+    params.semilla = semilla_flujo(lote->base.semilla, indice);
+    validar_parametros(&params);
+    
+    const char *estado = "ok";
+    double error_final = 0.0;
+    double tiempo_lectura = 0.0, tiempo_ejecucion = 0.0, tiempo_escritura = 0.0;
+    int num_hilos = 0;
+    long long candidatos_evaluados = 0;
+    Imagen *original = NULL;
+    ContextoHilos *ctx = NULL;
+    Punto *clavos;
+    CacheLineas *cache;
+    
+    double inicio = tiempo_actual();
+    if (t->recurso < 0 || (original = leer_pgm(t->imagen)) == NULL) {
+        estado = "error_lectura";
+        goto fin;
+    }
+    tiempo_lectura = tiempo_actual() - inicio;
+    
+    inicio = tiempo_actual();
+    RecursoLote *recurso = &lote->recursos[t->recurso];
+    if (original->ancho != recurso->ancho || original->alto != recurso->alto ||
+        !obtener_recurso_lote(lote, t->recurso, &clavos, &cache) ||
+        (ctx = crear_contexto(original, &params, clavos, cache)) == NULL) {
+        fprintf(stderr, "Error: No se pudo preparar el trabajo %s\n", t->imagen);
+        estado = "error_memoria";
+        goto fin;
+    }
+    resolver_paso(ctx, 0);
+    const Imagen *resultado = obtener_resultado(ctx, &error_final);
+    tiempo_ejecucion = tiempo_actual() - inicio;
+    
+    inicio = tiempo_actual();
+    if (!escribir_pgm(t->salida, resultado, params.salida_binaria)) {
+        estado = "error_escritura";
+    }
+    tiempo_escritura = tiempo_actual() - inicio;
+    
+fin:
+    if (ctx != NULL) {
+        num_hilos = obtener_secuencia(ctx)->num_hilos;
+        candidatos_evaluados = obtener_estadisticas(ctx)->candidatos_evaluados;
+    }
+    liberar_contexto(ctx);
+    soltar_recurso_lote(lote, t->recurso);
+    liberar_imagen(original);
     
-    if (hilo_a->error > hilo_b->error) return -1;
-    if (hilo_a->error < hilo_b->error) return 1;
-    return 0;
+    pthread_mutex_lock(&lote->cerrojo_csv);
+    fprintf(lote->csv, "%d,%s,%s,%d,%d,%d,%d,%.2f,%.2f,%.3f,%.3f,%lld,%s\n",
+            indice, t->imagen, t->salida, t->n, t->p, t->s, num_hilos, error_final,
+            tiempo_ejecucion, tiempo_lectura, tiempo_escritura, candidatos_evaluados, estado);
+    fflush(lote->csv);
+    if (strcmp(estado, "ok") == 0) {
+        lote->completados++;
+    } else {
+        lote->fallidos++;
+    }
+    pthread_mutex_unlock(&lote->cerrojo_csv);
 }
 
-// Selecciona p hilos candidatos aleatorios y calcula su beneficio
-void seleccionar_hilos_candidatos(Hilo *candidatos, int p, int n, Punto *clavos, 
-                                  Imagen *original, Imagen *actual, int *usados, int num_usados) {
-    int count = 0;
-    int intentos = 0;
-    const int max_intentos = p * 10;
-    
-    while (count < p && intentos < max_intentos) {
-        intentos++;
-        int clavo1 = rand() % n;
-        int clavo2 = rand() % n;
-        
-        if (clavo1 == clavo2) continue;
-        
-        candidatos[count].clavo1 = clavo1;
-        candidatos[count].clavo2 = clavo2;
-        candidatos[count].error = calcular_error_hilo(original, actual, clavos, clavo1, clavo2);
-        candidatos[count].puntuacion = candidatos[count].error;
-        
-        count++;
+// Saca el siguiente trabajo de la cola propia o, si esta vacia, lo roba del
+// principio de la cola de otro trabajador. Devuelve -1 cuando no queda ninguno
+static int siguiente_trabajo_lote(Lote *lote, int id) {
+    ColaLote *propia = &lote->colas[id];
+    int trabajo = -1;
+    
+    pthread_mutex_lock(&propia->cerrojo);
+    if (propia->fin > propia->inicio) {
+        trabajo = propia->trabajos[--propia->fin];
+    }
+    pthread_mutex_unlock(&propia->cerrojo);
+    if (trabajo >= 0) return trabajo;
+    
+    for (int k = 1; k < lote->num_colas && trabajo < 0; k++) {
+        ColaLote *victima = &lote->colas[(id + k) % lote->num_colas];
+        pthread_mutex_lock(&victima->cerrojo);
+        if (victima->fin > victima->inicio) {
+            trabajo = victima->trabajos[victima->inicio++];
+        }
+        pthread_mutex_unlock(&victima->cerrojo);
     }
+    if (trabajo >= 0) {
+        pthread_mutex_lock(&lote->cerrojo_csv);
+        lote->robos++;
+        pthread_mutex_unlock(&lote->cerrojo_csv);
+    }
+    return trabajo;
 }
 
-// Algoritmo voraz principal para generar la imagen con hilos
-// En cada iteracion selecciona los s mejores hilos de p candidatos aleatorios
-void algoritmo_voraz(Imagen *original, Imagen *resultado, Punto *clavos, 
-                     Parametros *params, int *hilos_seleccionados, int *num_hilos,
-                     double *error_final) {
-    for (int i = 0; i < resultado->alto; i++) {
-        for (int j = 0; j < resultado->ancho; j++) {
-            resultado->pixels[i][j] = 255;
-        }
+// Argumento de cada trabajador del lote
+typedef struct {
+    Lote *lote;
+    int id;
+    pthread_t hilo;
+} TrabajadorLote;
+
+static void* bucle_trabajador_lote(void *arg) {
+    TrabajadorLote *tl = (TrabajadorLote*)arg;
+    int trabajo;
+    // Los trabajos se conocen desde el principio, asi que cuando ninguna
+    // cola tiene trabajos pendientes ya no aparecera ninguno nuevo
+    while ((trabajo = siguiente_trabajo_lote(tl->lote, tl->id)) >= 0) {
+        ejecutar_trabajo_lote(tl->lote, trabajo);
+    }
+    return NULL;
+}
+
+// Modo lote: resuelve todos los trabajos del manifiesto con 'base.trabajadores'
+// hilos de ejecucion y escribe una linea CSV por trabajo en 'nombre_csv'
+int ejecutar_lote(const char *nombre_manifiesto, const char *nombre_csv, Parametros *base) {
+    Lote lote;
+    memset(&lote, 0, sizeof(lote));
+    lote.base = *base;
+    lote.trabajos = leer_manifiesto(nombre_manifiesto, base, &lote.num_trabajos);
+    if (lote.trabajos == NULL) return 1;
+    
+    lote.csv = fopen(nombre_csv, "w");
+    if (lote.csv == NULL) {
+        fprintf(stderr, "Error: No se pudo crear el archivo %s\n", nombre_csv);
+        liberar_trabajos_lote(lote.trabajos, lote.num_trabajos);
+        return 1;
     }
-    
-    int max_hilos = 50000;
-    int *hilos_usados = (int*)malloc(max_hilos * 2 * sizeof(int));
-    if (hilos_usados == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para hilos usados\n");
-        return;
+    fprintf(lote.csv, "trabajo,imagen,salida,n,p,s,hilos_dibujados,error_final,tiempo_seg,"
+                      "tiempo_lectura,tiempo_escritura,candidatos_evaluados,estado\n");
+    fflush(lote.csv);
+    
+    double inicio = tiempo_actual();
+    lote.num_colas = (base->trabajadores < lote.num_trabajos) ? base->trabajadores : lote.num_trabajos;
+    lote.colas = (ColaLote*)malloc(lote.num_colas * sizeof(ColaLote));
+    TrabajadorLote *trabajadores = (TrabajadorLote*)malloc(lote.num_colas * sizeof(TrabajadorLote));
+    int *reparto = (int*)malloc(lote.num_trabajos * sizeof(int));
+    if (lote.colas == NULL || trabajadores == NULL || reparto == NULL || !agrupar_recursos_lote(&lote)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para el lote\n");
+        free(lote.colas);
+        free(trabajadores);
+        free(reparto);
+        free(lote.recursos);
+        fclose(lote.csv);
+        liberar_trabajos_lote(lote.trabajos, lote.num_trabajos);
+        return 1;
     }
+    pthread_mutex_init(&lote.cerrojo_recursos, NULL);
+    pthread_mutex_init(&lote.cerrojo_csv, NULL);
     
-    Hilo *candidatos = (Hilo*)malloc(params->p * sizeof(Hilo));
-    if (candidatos == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para candidatos\n");
-        free(hilos_usados);
-        return;
+    // Reparto inicial en bloques contiguos: cada cola recibe trabajos
+    // consecutivos del manifiesto (tramo del trabajador i = [T*i/C, T*(i+1)/C))
+    for (int i = 0; i < lote.num_trabajos; i++) reparto[i] = i;
+    for (int c = 0; c < lote.num_colas; c++) {
+        int desde = (int)((long)lote.num_trabajos * c / lote.num_colas);
+        int hasta = (int)((long)lote.num_trabajos * (c + 1) / lote.num_colas);
+        lote.colas[c].trabajos = reparto + desde;
+        lote.colas[c].inicio = 0;
+        lote.colas[c].fin = hasta - desde;
+        pthread_mutex_init(&lote.colas[c].cerrojo, NULL);
     }
     
-    *num_hilos = 0;
-    int iteraciones_sin_mejora = 0;
-    const int max_iteraciones_sin_mejora = 20;
-    
-    double error_anterior = calcular_error_total(original, resultado);
-    
-    printf("Iniciando algoritmo voraz...\n");
-    printf("Error inicial: %.2f\n", error_anterior);
+    printf("Lote: %d trabajos, %d trabajadores, %d combinaciones distintas de (ancho, alto, n)\n",
+           lote.num_trabajos, lote.num_colas, lote.num_recursos);
+    fflush(stdout);
     
-    while (*num_hilos < max_hilos) {
-        seleccionar_hilos_candidatos(candidatos, params->p, params->n, clavos, 
-                                     original, resultado, hilos_usados, *num_hilos);
-        
-        qsort(candidatos, params->p, sizeof(Hilo), comparar_hilos);
-        
-        int hilos_a_dibujar = (params->s < params->p) ? params->s : params->p;
-        
-        bool mejora_encontrada = false;
-        
-        for (int i = 0; i < hilos_a_dibujar; i++) {
-            int clavo1 = candidatos[i].clavo1;
-            int clavo2 = candidatos[i].clavo2;
-            
-            int num_pixels;
-            dibujar_linea_bresenham(resultado,
-                                    (int)round(clavos[clavo1].x),
-                                    (int)round(clavos[clavo1].y),
-                                    (int)round(clavos[clavo2].x),
-                                    (int)round(clavos[clavo2].y),
-                                    5,
-                                    &num_pixels);
-            
-            hilos_seleccionados[*num_hilos * 2] = clavo1;
-            hilos_seleccionados[*num_hilos * 2 + 1] = clavo2;
-            (*num_hilos)++;
-            
-            mejora_encontrada = true;
-        }
-        
-        double error_actual = 0.0;
-        bool error_calculado = false;
-        
-        int num_iteraciones = *num_hilos / params->s;
-        if (num_iteraciones % 30 == 0 || num_iteraciones < 5) {
-            error_actual = calcular_error_total(original, resultado);
-            error_calculado = true;
-            
-            if (error_calculado) {
-                if (error_actual < error_anterior) {
-                    error_anterior = error_actual;
-                    iteraciones_sin_mejora = 0;
-                } else {
-                    iteraciones_sin_mejora++;
-                }
-            }
-        }
-        
-        if (iteraciones_sin_mejora >= max_iteraciones_sin_mejora) {
-            printf("Parada: No hay mejora en %d iteraciones\n", max_iteraciones_sin_mejora);
-            fflush(stdout);
-            break;
-        }
-        
-        if (!mejora_encontrada) {
-            printf("Parada: No se encontraron hilos utiles\n");
-            fflush(stdout);
+    int creados = 0;
+    for (int c = 0; c < lote.num_colas; c++) {
+        trabajadores[c].lote = &lote;
+        trabajadores[c].id = c;
+        if (pthread_create(&trabajadores[c].hilo, NULL, bucle_trabajador_lote, &trabajadores[c]) != 0) {
             break;
         }
-        
-        if (*num_hilos % 500 == 0) {
-            double error_mostrar = calcular_error_total(original, resultado);
-            printf("Hilos dibujados: %d, Error actual: %.2f\n", *num_hilos, error_mostrar);
-            fflush(stdout);
-        }
-    }
-    
-    printf("Calculando error final...\n");
+        creados++;
+    }
+    if (creados == 0) {
+        // Sin hilos auxiliares el hilo principal hace de unico trabajador
+        TrabajadorLote unico = {&lote, 0, pthread_self()};
+        bucle_trabajador_lote(&unico);
+    }
+    for (int c = 0; c < creados; c++) {
+        pthread_join(trabajadores[c].hilo, NULL);
+    }
+    double tiempo_total = tiempo_actual() - inicio;
+    
+    printf("\n=== ESTADISTICAS DEL LOTE ===\n");
+    printf("  Trabajos completados: %d de %d\n", lote.completados, lote.num_trabajos);
+    printf("  Trabajos fallidos: %d\n", lote.fallidos);
+    printf("  Trabajos robados entre trabajadores: %lld\n", lote.robos);
+    printf("  Clavos y caches reutilizados: %d trabajos comparten %d combinaciones\n",
+           lote.num_trabajos, lote.num_recursos);
+    if (lote.consultas_cache > 0) {
+        printf("  Aciertos de cache: %lld de %lld consultas (%.1f%%)\n", lote.aciertos_cache,
+               lote.consultas_cache, 100.0 * lote.aciertos_cache / lote.consultas_cache);
+    }
+    printf("  Tiempo total: %.2f segundos\n", tiempo_total);
+    printf("  Resultados: %s\n", nombre_csv);
+    printf("===================================\n");
     fflush(stdout);
     
-    *error_final = calcular_error_total(original, resultado);
+    int fallidos = lote.fallidos;
+    for (int c = 0; c < lote.num_colas; c++) {
+        pthread_mutex_destroy(&lote.colas[c].cerrojo);
+    }
+    pthread_mutex_destroy(&lote.cerrojo_recursos);
+    pthread_mutex_destroy(&lote.cerrojo_csv);
+    fclose(lote.csv);
+    free(lote.colas);
+    free(trabajadores);
+    free(reparto);
+    free(lote.recursos);
+    liberar_trabajos_lote(lote.trabajos, lote.num_trabajos);
+    return fallidos > 0 ? 1 : 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc >= 3 && strcmp(argv[1], "--bench-kernels") == 0) {
+        int n = (argc >= 4) ? atoi(argv[3]) : 1000;
+        int num_lineas = (argc >= 5) ? atoi(argv[4]) : 20000;
+        if (n < 2 || num_lineas <= 0) {
+            fprintf(stderr, "Error: Los parametros deben ser positivos\n");
+            return 1;
+        }
+        return ejecutar_bench_nucleos(argv[2], n, num_lineas);
+    }
     
-    printf("Algoritmo voraz completado. Hilos dibujados: %d, Error final: %.2f\n", *num_hilos, *error_final);
-    fflush(stdout);
+    Parametros params;
+    parametros_por_defecto(&params);
+    const char *kernel = "auto";
     
-    if (candidatos != NULL) {
-        free(candidatos);
+    if (argc >= 4 && strcmp(argv[1], "--reproducir") == 0) {
+        if (!leer_opciones(argc, argv, 4, &params, &kernel)) {
+            return 1;
+        }
+        return reproducir_secuencia(argv[2], argv[3], params.salida_binaria);
     }
-    if (hilos_usados != NULL) {
-        free(hilos_usados);
+    
+    if (argc >= 4 && strcmp(argv[1], "--lote") == 0) {
+        // Los trabajos se ejecutan en paralelo y sin mensajes de progreso
+        silencioso = true;
+        if (!leer_opciones(argc, argv, 4, &params, &kernel) || !validar_opciones(&params) ||
+            !elegir_nucleo(kernel)) {
+            return 1;
+        }
+        if (params.secuencia != NULL) {
+            fprintf(stderr, "Error: --secuencia no esta disponible en modo lote\n");
+            return 1;
+        }
+        return ejecutar_lote(argv[2], argv[3], &params);
     }
     
-    printf("Memoria liberada correctamente\n");
-    fflush(stdout);
-}
-
-int main(int argc, char *argv[]) {
     if (argc < 6) {
-        fprintf(stderr, "Uso: %s <n> <p> <s> <imagen_entrada> <imagen_salida>\n", argv[0]);
+        fprintf(stderr, "Uso: %s <n> <p> <s> <imagen_entrada> <imagen_salida> [opciones]\n", argv[0]);
         fprintf(stderr, "  n: numero de clavos\n");
         fprintf(stderr, "  p: numero de hilos candidatos por iteracion\n");
         fprintf(stderr, "  s: numero de mejores hilos a seleccionar\n");
-        fprintf(stderr, "  imagen_entrada: archivo PGM de entrada\n");
+        fprintf(stderr, "  imagen_entrada: archivo PGM de entrada (P2 o P5)\n");
         fprintf(stderr, "  imagen_salida: archivo PGM de salida\n");
+        fprintf(stderr, "Opciones:\n");
+        fprintf(stderr, "  -c <MB>: memoria maxima de la cache de lineas (0 = sin cache, por defecto %d)\n",
+                MEMORIA_CACHE_MB_DEFECTO);
+        fprintf(stderr, "  -t <trabajadores>: hilos de ejecucion para evaluar candidatos (por defecto 1)\n");
+        fprintf(stderr, "  --seed <semilla>: semilla aleatoria (por defecto, la hora actual)\n");
+        fprintf(stderr, "  --rng <xoshiro|pcg>: generador aleatorio de los candidatos (por defecto xoshiro)\n");
+        fprintf(stderr, "  -f <p2|p5>: formato de la imagen de salida (por defecto p2)\n");
+        fprintf(stderr, "  --verificar-error: contrasta el error acumulado con recalculos completos\n");
+        fprintf(stderr, "  -m <muestreo|continuo|monticulo>: estrategia de seleccion de hilos (por defecto muestreo)\n");
+        fprintf(stderr, "  --kernel <auto|escalar|sse2|avx2>: nucleo de puntuacion (por defecto auto)\n");
+        fprintf(stderr, "  --aa: hilos con antialiasing y clavos en coordenadas reales (modo muestreo)\n");
+        fprintf(stderr, "  --clavos <rectangulo|circulo|elipse|fichero>: disposicion de los clavos (por defecto\n"
+                        "    rectangulo); un fichero tiene una pareja \"x y\" por linea\n");
+        fprintf(stderr, "  --simetrias: comparte en la cache las lineas de clavos simetricos\n");
+        fprintf(stderr, "  --sin-simetrias: no las comparte (por defecto)\n");
+        fprintf(stderr, "  -e <1|2|4|8>: puntua los candidatos a escala 1/e (por defecto 1, sin multirresolucion);\n"
+                        "    el nivel grueso anade su propia cache de c/e MB\n");
+        fprintf(stderr, "  -r <k>: candidatos repuntuados a resolucion completa con -e (por defecto 4*s)\n");
+        fprintf(stderr, "  --max-hilos <k>: detiene el algoritmo tras k hilos (por defecto 0, sin limite)\n");
+        fprintf(stderr, "  --tiempo <segundos>: limite de tiempo de resolucion (por defecto 0, sin limite)\n");
+        fprintf(stderr, "  -q, --silencioso: no muestra el progreso del algoritmo\n");
+        fprintf(stderr, "  --stats=<texto|json>: formato de las estadisticas finales (por defecto texto)\n");
+        fprintf(stderr, "  --secuencia <fichero>: escribe la secuencia de hilos segun se dibujan\n");
+        fprintf(stderr, "Modo lote: %s --lote <manifiesto> <resultados.csv> [opciones]\n", argv[0]);
+        fprintf(stderr, "  cada linea del manifiesto: imagen n p s salida; -t es el numero de trabajos en paralelo\n");
+        fprintf(stderr, "Reproduccion: %s --reproducir <secuencia> <imagen_salida> [-f p2|p5]\n", argv[0]);
+        fprintf(stderr, "Microbenchmark de nucleos: %s --bench-kernels <imagen> [n] [lineas]\n", argv[0]);
         return 1;
     }
     
-    Parametros params;
     params.n = atoi(argv[1]);
     params.p = atoi(argv[2]);
     params.s = atoi(argv[3]);
-    
-    if (params.n <= 0 || params.p <= 0 || params.s <= 0) {
-        fprintf(stderr, "Error: Los parametros deben ser positivos\n");
-        return 1;
-    }
-    
-    if (params.s > params.p) {
-        fprintf(stderr, "Error: s no puede ser mayor que p\n");
+    if (!leer_opciones(argc, argv, 6, &params, &kernel) || !validar_parametros(&params) ||
+        !validar_opciones(&params) || !elegir_nucleo(kernel)) {
         return 1;
     }
     
-    srand(time(NULL));
-    
-    clock_t inicio = clock();
-    
-    printf("Leyendo imagen: %s\n", argv[4]);
+    informar("Leyendo imagen: %s\n", argv[4]);
+    double inicio_lectura = tiempo_actual();
     Imagen *original = leer_pgm(argv[4]);
     if (original == NULL) {
         return 1;
     }
+    double inicio = tiempo_actual();
+    double tiempo_lectura = inicio - inicio_lectura;
     
-    printf("Imagen cargada: %d x %d pixeles\n", original->ancho, original->alto);
+    informar("Imagen cargada: %d x %d pixeles\n", original->ancho, original->alto);
     
-    Imagen *resultado = (Imagen*)malloc(sizeof(Imagen));
-    if (resultado == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para imagen resultado\n");
+    informar("Generando %d clavos (disposicion %s)...\n", params.n, nombres_disposiciones[params.disposicion]);
+    ContextoHilos *ctx = crear_contexto(original, &params, NULL, NULL);
+    if (ctx == NULL) {
         liberar_imagen(original);
         return 1;
     }
+    Estadisticas *stats = obtener_estadisticas(ctx);
+    stats->tiempo_fase[FASE_LECTURA] += tiempo_lectura;
     
-    resultado->ancho = original->ancho;
-    resultado->alto = original->alto;
-    resultado->pixels = (unsigned char**)malloc(resultado->alto * sizeof(unsigned char*));
-    if (resultado->pixels == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para pixeles resultado\n");
-        free(resultado);
-        liberar_imagen(original);
-        return 1;
-    }
-    
-    for (int i = 0; i < resultado->alto; i++) {
-        resultado->pixels[i] = (unsigned char*)malloc(resultado->ancho * sizeof(unsigned char));
-        if (resultado->pixels[i] == NULL) {
-            for (int j = 0; j < i; j++) {
-                free(resultado->pixels[j]);
-            }
-            free(resultado->pixels);
-            free(resultado);
-            liberar_imagen(original);
-            return 1;
-        }
-    }
-    
-    printf("Generando %d clavos en el borde de la imagen...\n", params.n);
-    Punto *clavos = generar_clavos(params.n, original->ancho, original->alto);
-    if (clavos == NULL) {
-        fprintf(stderr, "Error: No se pudo generar clavos\n");
-        liberar_imagen(resultado);
-        liberar_imagen(original);
-        return 1;
-    }
-    
-    int max_hilos = 50000;
-    int *hilos_seleccionados = (int*)malloc(max_hilos * 2 * sizeof(int));
-    if (hilos_seleccionados == NULL) {
-        fprintf(stderr, "Error: No se pudo asignar memoria para hilos seleccionados\n");
-        free(clavos);
-        liberar_imagen(resultado);
-        liberar_imagen(original);
-        return 1;
-    }
-    
-    int num_hilos = 0;
-    double error_final = 0.0;
-    
-    printf("Ejecutando algoritmo voraz...\n");
+    informar("Ejecutando algoritmo voraz...\n");
     fflush(stdout);
     
-    algoritmo_voraz(original, resultado, clavos, &params, 
-                   hilos_seleccionados, &num_hilos, &error_final);
+    if (!silencioso) {
+        fijar_progreso(ctx, mostrar_progreso, NULL);
+    }
+    MotivoParada parada = resolver_paso(ctx, 0);
+    double error_final;
+    const Imagen *resultado = obtener_resultado(ctx, &error_final);
+    const SecuenciaHilos *secuencia = obtener_secuencia(ctx);
+    const CacheLineas *cache = obtener_cache(ctx);
     
-    clock_t fin = clock();
-    double tiempo_ejecucion = ((double)(fin - inicio)) / CLOCKS_PER_SEC;
+    double tiempo_ejecucion = tiempo_actual() - inicio;
     
-    printf("\nEscribiendo imagen resultado: %s\n", argv[5]);
+    informar("\nEscribiendo imagen resultado: %s\n", argv[5]);
     fflush(stdout);
     
-    int escritura_exitosa = escribir_pgm(argv[5], resultado);
+    double inicio_escritura = tiempo_actual();
+    int escritura_exitosa = escribir_pgm(argv[5], resultado, params.salida_binaria);
+    medir_fase(stats, FASE_ESCRITURA, inicio_escritura);
+    double tiempo_escritura = stats->tiempo_fase[FASE_ESCRITURA];
     
     if (!escritura_exitosa) {
         fprintf(stderr, "Error: No se pudo escribir imagen resultado\n");
         fflush(stderr);
     } else {
-        printf("Imagen resultado escrita correctamente\n");
+        informar("Imagen resultado escrita correctamente\n");
         fflush(stdout);
     }
     
+    if (cache != NULL) {
+        stats->aciertos_cache += cache->aciertos;
+        stats->fallos_cache += cache->fallos;
+    }
+    
+    // Las arenas de la estrategia ya se han liberado y estan en los contadores
+    ContadoresMemoria memoria;
+    obtener_memoria(ctx, &memoria);
+    long long reservas = memoria.reservas;
+    long long bloques_sistema = memoria.bloques_sistema;
+    long long reutilizados = memoria.bloques_reutilizados;
+    double pico_memoria_mb = 0.0;
+#ifndef _WIN32
+    struct rusage uso;
+    if (getrusage(RUSAGE_SELF, &uso) == 0) {
+        // En Linux ru_maxrss va en KB
+        pico_memoria_mb = uso.ru_maxrss / 1024.0;
+    }
+#endif
+    
+    if (params.estadisticas_json) {
+        printf("{\"imagen\": ");
+        escribir_cadena_json(stdout, argv[4]);
+        printf(", \"salida\": ");
+        escribir_cadena_json(stdout, argv[5]);
+        printf(", \"ancho\": %d, \"alto\": %d, \"n\": %d, \"p\": %d, \"s\": %d",
+               original->ancho, original->alto, params.n, params.p, params.s);
+        printf(", \"trabajadores\": %d, \"semilla\": %u, \"generador\": \"%s\"", params.trabajadores,
+               params.semilla, params.generador == GENERADOR_PCG ? "pcg" : "xoshiro");
+        printf(", \"modo\": \"%s\", \"nucleo\": \"%s\", \"escala\": %d, \"refinar\": %d, \"max_hilos\": %d",
+               params.modo == MODO_CONTINUO ? "continuo" : params.modo == MODO_MONTICULO ? "monticulo" : "muestreo",
+               nucleo_seleccionado(), params.escala, params.refinar, params.max_hilos);
+        printf(", \"antialias\": %s", params.antialias ? "true" : "false");
+        printf(", \"disposicion\": \"%s\", \"simetrias\": %d", nombres_disposiciones[params.disposicion],
+               cache != NULL ? cache->simetrias.num : 1);
+        printf(", \"hilos_dibujados\": %d, \"error_final\": %.0f, \"escritura_correcta\": %s",
+               secuencia->num_hilos, error_final, escritura_exitosa ? "true" : "false");
+        printf(", \"parada\": \"%s\"", nombre_parada(parada));
+        printf(", \"tiempo_ejecucion\": %.6f, \"tiempo_lectura\": %.6f, \"tiempo_escritura\": %.6f",
+               tiempo_ejecucion, tiempo_lectura, tiempo_escritura);
+        printf(", \"fases\": {");
+        for (int f = 0; f < NUM_FASES; f++) {
+            printf("%s\"%s\": %.6f", f > 0 ? ", " : "", nombres_fases[f], stats->tiempo_fase[f]);
+        }
+        printf("}, \"contadores\": {\"candidatos_evaluados\": %lld, \"candidatos_refinados\": %lld",
+               stats->candidatos_evaluados, stats->candidatos_refinados);
+        printf(", \"lineas_puntuadas\": %lld, \"pixeles_visitados\": %lld", stats->lineas_puntuadas,
+               stats->pixeles_visitados);
+        printf(", \"aciertos_cache\": %lld, \"fallos_cache\": %lld, \"lineas_expulsadas\": %lld",
+               stats->aciertos_cache, stats->fallos_cache, cache != NULL ? cache->expulsiones : 0LL);
+        printf(", \"consultas_simetricas\": %lld, \"mosaicos_revisados\": %lld}",
+               cache != NULL ? cache->simetricas : 0LL, stats->mosaicos_revisados);
+        printf(", \"memoria\": {\"cache_usada\": %zu, \"reservas_arenas\": %lld, \"bloques_sistema\": %lld",
+               cache != NULL ? cache->memoria_usada : (size_t)0, reservas, bloques_sistema);
+        printf(", \"bloques_reutilizados\": %lld, \"capacidad_secuencia\": %d, \"pico_residente_mb\": %.1f}",
+               reutilizados, secuencia->capacidad, pico_memoria_mb);
+        printf(", \"secuencia_bytes\": %ld}\n", secuencia->bytes);
+        fflush(stdout);
+        
+        liberar_contexto(ctx);
+        liberar_imagen(original);
+        return 0;
+    }
+    
     printf("\n=== ESTADISTICAS DE EJECUCION ===\n");
     fflush(stdout);
     printf("Parametros:\n");
     printf("  Numero de clavos (n): %d\n", params.n);
     printf("  Hilos candidatos por iteracion (p): %d\n", params.p);
     printf("  Mejores hilos seleccionados (s): %d\n", params.s);
+    printf("  Trabajadores (t): %d\n", params.trabajadores);
+    printf("  Semilla: %u (generador %s)\n", params.semilla,
+           params.generador == GENERADOR_PCG ? "pcg" : "xoshiro");
+    printf("  Modo de seleccion: %s\n", params.modo == MODO_CONTINUO ? "continuo" :
+                                        params.modo == MODO_MONTICULO ? "monticulo" : "muestreo");
+    printf("  Nucleo de puntuacion: %s\n", nucleo_seleccionado());
+    if (params.max_hilos > 0) {
+        printf("  Limite de hilos: %d\n", params.max_hilos);
+    }
+    if (params.escala > 1) {
+        printf("  Multirresolucion: escala 1/%d, refinando %d candidatos\n", params.escala, params.refinar);
+    }
+    if (params.antialias) {
+        printf("  Antialiasing: si (lineas de Wu con pesos precalculados)\n");
+    }
+    printf("  Disposicion de los clavos: %s\n", nombres_disposiciones[params.disposicion]);
     printf("Resultados:\n");
-    printf("  Numero de hilos dibujados: %d\n", num_hilos);
+    printf("  Numero de hilos dibujados: %d\n", secuencia->num_hilos);
     printf("  Error final: %.2f\n", error_final);
     printf("  Tiempo de ejecucion: %.2f segundos\n", tiempo_ejecucion);
+    printf("  Tiempo de lectura: %.3f segundos\n", tiempo_lectura);
+    printf("  Tiempo de escritura: %.3f segundos\n", tiempo_escritura);
+    printf("  Candidatos evaluados: %lld (%.0f por segundo)\n", stats->candidatos_evaluados,
+           stats->tiempo_evaluacion > 0 ? stats->candidatos_evaluados / stats->tiempo_evaluacion : 0.0);
+    if (params.escala > 1) {
+        printf("  Candidatos refinados: %lld\n", stats->candidatos_refinados);
+    }
+    printf("  Lineas puntuadas: %lld (%.0f pixeles de media)\n", stats->lineas_puntuadas,
+           stats->lineas_puntuadas > 0 ? (double)stats->pixeles_visitados / stats->lineas_puntuadas : 0.0);
+    if (params.secuencia != NULL) {
+        printf("  Secuencia de hilos: %s, %ld bytes (%.2f por hilo)\n", params.secuencia, secuencia->bytes,
+               secuencia->num_hilos > 0 ? (double)secuencia->bytes / secuencia->num_hilos : 0.0);
+    }
+    if (cache != NULL) {
+        long long consultas = cache->aciertos + cache->fallos;
+        printf("Cache de lineas:\n");
+        printf("  Aciertos: %lld de %lld consultas (%.1f%%)\n", cache->aciertos, consultas,
+               consultas > 0 ? 100.0 * cache->aciertos / consultas : 0.0);
+        printf("  Lineas expulsadas: %lld\n", cache->expulsiones);
+        if (cache->simetrias.num > 1) {
+            printf("  Simetrias de los clavos: %d (%lld consultas servidas con la linea de un par simetrico)\n",
+                   cache->simetrias.num, cache->simetricas);
+        }
+        printf("  Memoria usada: %.1f MB (%.1f MB reservados)\n", cache->memoria_usada / (1024.0 * 1024.0),
+               cache->arena.bytes / (1024.0 * 1024.0));
+    }
+    
+    double tiempo_fases = 0.0;
+    for (int f = 0; f < NUM_FASES; f++) tiempo_fases += stats->tiempo_fase[f];
+    printf("Tiempo por fases:\n");
+    for (int f = 0; f < NUM_FASES; f++) {
+        printf("  %-11s %8.3f s (%5.1f%%)\n", nombres_fases[f], stats->tiempo_fase[f],
+               tiempo_fases > 0 ? 100.0 * stats->tiempo_fase[f] / tiempo_fases : 0.0);
+    }
+    printf("Memoria:\n");
+    printf("  Reservas en arenas: %lld (%lld bloques pedidos al sistema)\n", reservas, bloques_sistema);
+    printf("  Bloques de lineas reutilizados: %lld\n", reutilizados);
+    printf("  Capacidad de la secuencia de hilos: %d\n", secuencia->capacidad);
+#ifndef _WIN32
+    printf("  Pico de memoria residente: %.1f MB\n", pico_memoria_mb);
+#endif
     printf("===================================\n");
     fflush(stdout);
     
-    free(hilos_seleccionados);
-    free(clavos);
-    liberar_imagen(resultado);
+    liberar_contexto(ctx);
     liberar_imagen(original);
     
     return 0;
@@ -0,0 +1,3825 @@
+#define _USE_MATH_DEFINES  
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "libhilos.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAY_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Lado (en pixeles) de los mosaicos en que se resume el plano de oscuridad faltante
+// Divide al paso de fila, asi que cada tramo de d / LADO_MOSAICO cae en un solo mosaico
+#define LADO_MOSAICO 64
+#if ALINEACION % LADO_MOSAICO != 0
+#error "LADO_MOSAICO debe dividir a ALINEACION"
+#endif
+
+// Granularidad (en pixeles) de las clases de tamaño de los bloques de lineas
+#define PIXELES_POR_CLASE 64
+
+// Peso de cobertura de un pixel cubierto del todo por una linea con antialiasing
+#define PESO_MAXIMO_AA 255
+
+// Muestras del primer cuadrante con las que se mide la longitud de arco de una elipse
+#define MUESTRAS_ELIPSE 1024
+
+// Identificacion de los ficheros de secuencia de hilos
+// (version 2: la cabecera indica si los hilos tienen antialiasing;
+// version 3: tambien la disposicion de los clavos y si se comparten lineas simetricas)
+#define SECUENCIA_MAGICO "HSEQ"
+#define SECUENCIA_VERSION 3
+
+// Inversa de cada simetria (solo los dos giros de 90 grados no son involuciones)
+static const Simetria simetria_inversa[NUM_SIMETRIAS] = {
+    SIMETRIA_IDENTIDAD, SIMETRIA_ESPEJO_X, SIMETRIA_ESPEJO_Y, SIMETRIA_GIRO_180,
+    SIMETRIA_TRASPUESTA, SIMETRIA_GIRO_270, SIMETRIA_GIRO_90, SIMETRIA_ANTITRASPUESTA
+};
+
+// Representa un hilo entre dos clavos con su beneficio asociado
+typedef struct {
+    int clavo1, clavo2;  // Indices de los clavos conectados
+    double error;        // Beneficio de dibujar este hilo
+    double puntuacion;   // Puntuacion para ordenacion
+} Hilo;
+
+// Resumen del plano de oscuridad faltante por mosaicos de LADO_MOSAICO x
+// LADO_MOSAICO pixeles. Sus sumas se corrigen al oscurecer cada pixel, asi
+// que saber si queda oscuridad por cubrir es O(1), y las verificaciones solo
+// recorren los mosaicos marcados como sucios desde la anterior
+typedef struct {
+    int columnas, filas;
+    long long *error;        // Error cuadratico de cada mosaico (suma de faltante^2)
+    long long *positivo;     // Oscuridad faltante positiva de cada mosaico
+    unsigned char *sucio;    // Cambiado desde la ultima verificacion
+    int *sucios;             // Lista de los mosaicos sucios
+    int num_sucios;
+    int con_oscuridad;       // Mosaicos con oscuridad faltante positiva
+    int *de_tramo;           // Mosaico de cada tramo de LADO_MOSAICO pixeles (d / LADO_MOSAICO)
+} Mosaicos;
+
+// Plano de oscuridad faltante de cada pixel: (255 - original) - (255 - actual)
+// Comparte el paso (en elementos) con las imagenes, asi que un mismo
+// desplazamiento y * paso + x sirve para los tres planos
+typedef struct Residuo {
+    int ancho, alto;
+    int paso;                // Elementos entre el inicio de dos filas
+    short *valores;          // Buffer [alto * paso], alineado a 64 bytes
+    
+    // Copia traspuesta (la columna x empieza en transpuesta[x * paso_t]) que se
+    // mantiene para las lineas con antialiasing poco empinadas; NULL si no se usa
+    short *transpuesta;
+    int paso_t;
+    
+    // Con lineas compartidas por simetria, simetricos[g][g(d)] = valores[d]:
+    // una linea cacheada de la que se sirve su imagen por g se puntua sobre el
+    // plano g sin mover sus pixeles. NULL en las simetrias que no se usan
+    short *simetricos[NUM_SIMETRIAS];
+    int num_simetricos;
+    
+    Mosaicos *mosaicos;      // Resumen por mosaicos (NULL en el nivel grueso)
+    
+    // Nivel grueso de la piramide (NULL sin multirresolucion): cada celda
+    // resume un bloque de factor x factor pixeles de este plano
+    struct Residuo *grueso;
+    int factor;
+    int *sumas;              // Solo en el nivel grueso: oscuridad positiva de cada bloque
+} Residuo;
+
+// Estado de un generador: xoshiro usa los cuatro estados, PCG solo
+// estado[0] (estado) y estado[1] (incremento, impar)
+typedef struct {
+    TipoGenerador tipo;
+    uint64_t estado[4];
+} Generador;
+
+// Cabecera de un fichero de secuencia: lo necesario para redibujar los hilos
+// (dimensiones, clavos y oscuridad por hilo) y los parametros de la ejecucion
+typedef struct {
+    int ancho, alto, n, p, s;
+    unsigned int semilla;
+    int modo, escala;
+    int valor;            // Oscuridad que resta cada hilo
+    bool desde_menor;     // Las lineas se trazan desde el clavo de menor indice
+    bool antialias;       // Lineas con antialiasing (rasterizar_linea_aa)
+    int disposicion;      // TipoDisposicion de los clavos
+    bool simetrias;       // Lineas compartidas entre clavos simetricos (cache)
+    const Punto *clavos;  // Coordenadas de los clavos (solo DISPOSICION_FICHERO)
+} CabeceraSecuencia;
+
+// Reserva 'bytes' alineados a ALINEACION (NULL si no hay memoria)
+void* reservar_alineado(size_t bytes) {
+    void *ptr = NULL;
+    if (bytes == 0) bytes = ALINEACION;
+    if (posix_memalign(&ptr, ALINEACION, bytes) != 0) return NULL;
+    return ptr;
+}
+
+static ContadoresMemoria memoria_liberada;
+static pthread_mutex_t cerrojo_memoria = PTHREAD_MUTEX_INITIALIZER;
+
+// Prepara una arena vacia que pedira bloques de al menos 'tam_bloque' bytes
+void iniciar_arena(Arena *arena, size_t tam_bloque) {
+    arena->bloques = NULL;
+    arena->tam_bloque = tam_bloque;
+    arena->reservas = 0;
+    arena->bloques_sistema = 0;
+    arena->bytes = 0;
+}
+
+// Reserva 'bytes' de la arena alineados a ALINEACION (NULL si no hay memoria)
+void* arena_reservar(Arena *arena, size_t bytes) {
+    bytes = (bytes + ALINEACION - 1) / ALINEACION * ALINEACION;
+    BloqueArena *bloque = arena->bloques;
+    if (bloque == NULL || bloque->tam - bloque->usado < bytes) {
+        size_t tam = (bytes > arena->tam_bloque) ? bytes : arena->tam_bloque;
+        bloque = (BloqueArena*)malloc(sizeof(BloqueArena));
+        if (bloque == NULL) return NULL;
+        bloque->datos = (unsigned char*)reservar_alineado(tam);
+        if (bloque->datos == NULL) {
+            free(bloque);
+            return NULL;
+        }
+        bloque->tam = tam;
+        bloque->usado = 0;
+        // Un bloque hecho a medida para una reserva grande no sustituye al
+        // actual, que puede tener sitio para las siguientes
+        if (tam > arena->tam_bloque && arena->bloques != NULL) {
+            bloque->siguiente = arena->bloques->siguiente;
+            arena->bloques->siguiente = bloque;
+        } else {
+            bloque->siguiente = arena->bloques;
+            arena->bloques = bloque;
+        }
+        arena->bloques_sistema++;
+        arena->bytes += tam;
+    }
+    void *ptr = bloque->datos + bloque->usado;
+    bloque->usado += bytes;
+    arena->reservas++;
+    return ptr;
+}
+
+// Libera de una vez todas las reservas de la arena
+void liberar_arena(Arena *arena) {
+    BloqueArena *bloque = arena->bloques;
+    while (bloque != NULL) {
+        BloqueArena *siguiente = bloque->siguiente;
+        free(bloque->datos);
+        free(bloque);
+        bloque = siguiente;
+    }
+    pthread_mutex_lock(&cerrojo_memoria);
+    memoria_liberada.reservas += arena->reservas;
+    memoria_liberada.bloques_sistema += arena->bloques_sistema;
+    pthread_mutex_unlock(&cerrojo_memoria);
+    iniciar_arena(arena, arena->tam_bloque);
+}
+
+// Crea una imagen de ancho x alto sin inicializar sus pixeles
+Imagen* crear_imagen(int ancho, int alto) {
+    Imagen *img = (Imagen*)malloc(sizeof(Imagen));
+    if (img == NULL) return NULL;
+    
+    img->ancho = ancho;
+    img->alto = alto;
+    img->paso = (ancho + ALINEACION - 1) / ALINEACION * ALINEACION;
+    img->pixels = (unsigned char*)reservar_alineado((size_t)img->paso * alto);
+    if (img->pixels == NULL) {
+        free(img);
+        return NULL;
+    }
+    memset(img->pixels, 0, (size_t)img->paso * alto);
+    
+    return img;
+}
+
+// Libera la memoria asignada para una imagen
+void liberar_imagen(Imagen *img) {
+    if (img == NULL) return;
+    free(img->pixels);
+    free(img);
+}
+
+// Contenido completo de un fichero accesible en memoria
+typedef struct {
+    unsigned char *datos;
+    size_t tam;
+    bool proyectado;  // true si viene de mmap, false si se leyo con fread
+} FicheroMemoria;
+
+// Carga un fichero en memoria: se proyecta con mmap cuando es posible
+// y si no (o en Windows) se lee entero de una vez
+static bool cargar_fichero(const char *nombre_archivo, FicheroMemoria *f) {
+    f->datos = NULL;
+    f->tam = 0;
+    f->proyectado = false;
+    
+#ifndef _WIN32
+    int fd = open(nombre_archivo, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *mapa = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapa != MAP_FAILED) {
+            posix_madvise(mapa, (size_t)info.st_size, POSIX_MADV_SEQUENTIAL);
+            f->datos = (unsigned char*)mapa;
+            f->tam = (size_t)info.st_size;
+            f->proyectado = true;
+            close(fd);
+            return true;
+        }
+    }
+    close(fd);
+#endif
+    
+    FILE *archivo = fopen(nombre_archivo, "rb");
+    if (archivo == NULL) return false;
+    if (fseek(archivo, 0, SEEK_END) != 0) {
+        fclose(archivo);
+        return false;
+    }
+    long tam = ftell(archivo);
+    rewind(archivo);
+    if (tam <= 0 || (f->datos = (unsigned char*)malloc((size_t)tam)) == NULL) {
+        fclose(archivo);
+        return false;
+    }
+    f->tam = fread(f->datos, 1, (size_t)tam, archivo);
+    fclose(archivo);
+    return true;
+}
+
+// Libera un fichero cargado con cargar_fichero
+static void descargar_fichero(FicheroMemoria *f) {
+#ifndef _WIN32
+    if (f->proyectado) {
+        munmap(f->datos, f->tam);
+        return;
+    }
+#endif
+    free(f->datos);
+}
+
+// Salta espacios y comentarios (# hasta fin de linea) de una cabecera PGM
+static const unsigned char* saltar_separadores(const unsigned char *pos, const unsigned char *fin) {
+    while (pos < fin) {
+        if (*pos == '#') {
+            while (pos < fin && *pos != '\n') pos++;
+        } else if (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r') {
+            pos++;
+        } else {
+            break;
+        }
+    }
+    return pos;
+}
+
+// Lee un entero no negativo en ASCII sin pasar por fscanf
+// Devuelve la posicion siguiente al numero o NULL si no hay numero
+static const unsigned char* leer_entero(const unsigned char *pos, const unsigned char *fin, int *valor) {
+    pos = saltar_separadores(pos, fin);
+    if (pos >= fin || *pos < '0' || *pos > '9') return NULL;
+    int v = 0;
+    while (pos < fin && *pos >= '0' && *pos <= '9') {
+        v = v * 10 + (*pos - '0');
+        pos++;
+    }
+    *valor = v;
+    return pos;
+}
+
+// Lee la cabecera de un PGM (formato, dimensiones y valor maximo)
+// Devuelve la posicion siguiente al valor maximo o NULL si no es valida
+static const unsigned char* leer_cabecera_pgm(const unsigned char *pos, const unsigned char *fin,
+                                              bool *binario, int *ancho, int *alto, int *max_valor) {
+    if (fin - pos < 2 || pos[0] != 'P' || (pos[1] != '2' && pos[1] != '5')) {
+        fprintf(stderr, "Error: Formato PGM no valido (debe ser P2 o P5)\n");
+        return NULL;
+    }
+    *binario = (pos[1] == '5');
+    pos += 2;
+    
+    if ((pos = leer_entero(pos, fin, ancho)) == NULL ||
+        (pos = leer_entero(pos, fin, alto)) == NULL ||
+        (pos = leer_entero(pos, fin, max_valor)) == NULL || *ancho <= 0 || *alto <= 0) {
+        fprintf(stderr, "Error: No se pudo leer dimensiones de la imagen\n");
+        return NULL;
+    }
+    return pos;
+}
+
+// Lee solo las dimensiones de un PGM (con mmap no se llegan a leer los pixeles)
+bool leer_dimensiones_pgm(const char *nombre_archivo, int *ancho, int *alto) {
+    FicheroMemoria f;
+    if (!cargar_fichero(nombre_archivo, &f)) {
+        fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", nombre_archivo);
+        return false;
+    }
+    bool binario;
+    int max_valor;
+    bool correcto = leer_cabecera_pgm(f.datos, f.datos + f.tam, &binario, ancho, alto, &max_valor) != NULL;
+    descargar_fichero(&f);
+    return correcto;
+}
+
+// Lee una imagen en formato PGM (P2 ASCII o P5 binario) desde archivo
+Imagen* leer_pgm(const char *nombre_archivo) {
+    FicheroMemoria f;
+    if (!cargar_fichero(nombre_archivo, &f)) {
+        fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", nombre_archivo);
+        return NULL;
+    }
+    
+    const unsigned char *pos = f.datos;
+    const unsigned char *fin = f.datos + f.tam;
+    bool binario;
+    int ancho, alto, max_valor;
+    if ((pos = leer_cabecera_pgm(pos, fin, &binario, &ancho, &alto, &max_valor)) == NULL) {
+        descargar_fichero(&f);
+        return NULL;
+    }
+    
+    if (binario && max_valor > 255) {
+        fprintf(stderr, "Error: Solo se admiten imagenes P5 de 8 bits\n");
+        descargar_fichero(&f);
+        return NULL;
+    }
+    
+    Imagen *img = crear_imagen(ancho, alto);
+    if (img == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para pixeles\n");
+        descargar_fichero(&f);
+        return NULL;
+    }
+    
+    if (binario) {
+        // Tras el valor maximo hay exactamente un separador y los bytes crudos
+        pos++;
+        if (pos > fin || (size_t)(fin - pos) < (size_t)ancho * alto) {
+            fprintf(stderr, "Error: Faltan pixeles en la imagen P5\n");
+            liberar_imagen(img);
+            descargar_fichero(&f);
+            return NULL;
+        }
+        for (int i = 0; i < alto; i++) {
+            memcpy(img->pixels + (size_t)i * img->paso, pos + (size_t)i * ancho, ancho);
+        }
+    } else {
+        int valor;
+        for (int i = 0; i < img->alto; i++) {
+            unsigned char *fila = img->pixels + (size_t)i * img->paso;
+            for (int j = 0; j < img->ancho; j++) {
+                if ((pos = leer_entero(pos, fin, &valor)) == NULL) {
+                    fprintf(stderr, "Error: No se pudo leer pixel en (%d, %d)\n", j, i);
+                    liberar_imagen(img);
+                    descargar_fichero(&f);
+                    return NULL;
+                }
+                fila[j] = (unsigned char)valor;
+            }
+        }
+    }
+    
+    descargar_fichero(&f);
+    return img;
+}
+
+// Escribe una imagen en formato PGM a archivo (P5 binario si 'binario')
+// El fichero completo se compone en memoria y se escribe de una vez
+int escribir_pgm(const char *nombre_archivo, const Imagen *img, bool binario) {
+    FILE *archivo = fopen(nombre_archivo, "wb");
+    if (archivo == NULL) {
+        fprintf(stderr, "Error: No se pudo crear el archivo %s\n", nombre_archivo);
+        return 0;
+    }
+    
+    // Cabecera + hasta 4 caracteres por pixel en ASCII ("255 ")
+    size_t capacidad = 64 + (size_t)img->alto * (binario ? img->ancho : img->ancho * 4);
+    unsigned char *buffer = (unsigned char*)malloc(capacidad);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para escribir la imagen\n");
+        fclose(archivo);
+        return 0;
+    }
+    
+    size_t len = (size_t)sprintf((char*)buffer, "%s\n%d %d\n255\n", binario ? "P5" : "P2",
+                                 img->ancho, img->alto);
+    
+    for (int i = 0; i < img->alto; i++) {
+        const unsigned char *fila = img->pixels + (size_t)i * img->paso;
+        if (binario) {
+            memcpy(buffer + len, fila, img->ancho);
+            len += img->ancho;
+            continue;
+        }
+        for (int j = 0; j < img->ancho; j++) {
+            int v = fila[j];
+            if (v >= 100) buffer[len++] = (unsigned char)('0' + v / 100);
+            if (v >= 10) buffer[len++] = (unsigned char)('0' + v / 10 % 10);
+            buffer[len++] = (unsigned char)('0' + v % 10);
+            buffer[len++] = (j < img->ancho - 1) ? ' ' : '\n';
+        }
+    }
+    
+    size_t escritos = fwrite(buffer, 1, len, archivo);
+    free(buffer);
+    if (fclose(archivo) != 0 || escritos != len) {
+        fprintf(stderr, "Error: Fallo al escribir el archivo %s\n", nombre_archivo);
+        return 0;
+    }
+    return 1;
+}
+
+// Libera el resumen por mosaicos
+static void liberar_mosaicos(Mosaicos *m) {
+    if (m == NULL) return;
+    free(m->error);
+    free(m->positivo);
+    free(m->sucio);
+    free(m->sucios);
+    free(m->de_tramo);
+    free(m);
+}
+
+// Crea el resumen por mosaicos de un plano de oscuridad faltante (todos limpios)
+// Devuelve NULL si no hay memoria
+static Mosaicos* crear_mosaicos(const Residuo *res) {
+    Mosaicos *m = (Mosaicos*)calloc(1, sizeof(Mosaicos));
+    if (m == NULL) return NULL;
+    m->columnas = (res->ancho + LADO_MOSAICO - 1) / LADO_MOSAICO;
+    m->filas = (res->alto + LADO_MOSAICO - 1) / LADO_MOSAICO;
+    int num = m->columnas * m->filas;
+    m->error = (long long*)calloc(num, sizeof(long long));
+    m->positivo = (long long*)calloc(num, sizeof(long long));
+    m->sucio = (unsigned char*)calloc(num, 1);
+    m->sucios = (int*)malloc(num * sizeof(int));
+    int tramos_fila = res->paso / LADO_MOSAICO;
+    m->de_tramo = (int*)malloc((size_t)res->alto * tramos_fila * sizeof(int));
+    if (m->error == NULL || m->positivo == NULL || m->sucio == NULL || m->sucios == NULL ||
+        m->de_tramo == NULL) {
+        liberar_mosaicos(m);
+        return NULL;
+    }
+    
+    // Asi oscurecer un pixel no necesita dividir su desplazamiento por el paso
+    // (el paso es multiplo de LADO_MOSAICO, asi que tramos_fila == columnas)
+    for (int y = 0; y < res->alto; y++) {
+        for (int t = 0; t < tramos_fila; t++) {
+            m->de_tramo[(size_t)y * tramos_fila + t] = (y / LADO_MOSAICO) * m->columnas + t;
+        }
+    }
+    
+    for (int y = 0; y < res->alto; y++) {
+        const short *fila = res->valores + (size_t)y * res->paso;
+        long long *error = m->error + (y / LADO_MOSAICO) * m->columnas;
+        long long *positivo = m->positivo + (y / LADO_MOSAICO) * m->columnas;
+        for (int x = 0; x < res->ancho; x++) {
+            int v = fila[x];
+            error[x / LADO_MOSAICO] += v * v;
+            if (v > 0) positivo[x / LADO_MOSAICO] += v;
+        }
+    }
+    for (int k = 0; k < num; k++) {
+        if (m->positivo[k] > 0) m->con_oscuridad++;
+    }
+    return m;
+}
+
+// Suma de los errores de todos los mosaicos (el error cuadratico total)
+static long long error_mosaicos(const Mosaicos *m) {
+    long long total = 0;
+    for (int k = 0; k < m->columnas * m->filas; k++) {
+        total += m->error[k];
+    }
+    return total;
+}
+
+// Crea el plano de oscuridad faltante entre 'original' y 'actual'
+Residuo* crear_residuo(Imagen *original, Imagen *actual) {
+    Residuo *res = (Residuo*)malloc(sizeof(Residuo));
+    if (res == NULL) return NULL;
+    
+    res->ancho = original->ancho;
+    res->alto = original->alto;
+    res->paso = original->paso;
+    res->grueso = NULL;
+    res->factor = 1;
+    res->sumas = NULL;
+    res->transpuesta = NULL;
+    res->paso_t = 0;
+    for (int g = 0; g < NUM_SIMETRIAS; g++) res->simetricos[g] = NULL;
+    res->num_simetricos = 0;
+    res->mosaicos = NULL;
+    // Relleno final para que los nucleos SIMD puedan leer 32 bits en el ultimo pixel
+    res->valores = (short*)reservar_alineado((size_t)res->paso * res->alto * sizeof(short) + ALINEACION);
+    if (res->valores == NULL) {
+        free(res);
+        return NULL;
+    }
+    
+    for (int i = 0; i < res->alto; i++) {
+        const unsigned char *fila_original = original->pixels + (size_t)i * original->paso;
+        const unsigned char *fila_actual = actual->pixels + (size_t)i * actual->paso;
+        short *fila = res->valores + (size_t)i * res->paso;
+        for (int j = 0; j < res->paso; j++) {
+            fila[j] = (j < res->ancho) ? (short)(fila_actual[j] - fila_original[j]) : 0;
+        }
+    }
+    
+    res->mosaicos = crear_mosaicos(res);
+    if (res->mosaicos == NULL) {
+        free(res->valores);
+        free(res);
+        return NULL;
+    }
+    return res;
+}
+
+// Paso del plano traspuesto de una imagen de 'alto' filas
+static inline int paso_transpuesto(int alto) {
+    return (alto + 31) / 32 * 32;
+}
+
+// Crea la copia traspuesta de la oscuridad faltante. Devuelve false si no hay memoria
+bool crear_plano_transpuesto(Residuo *res) {
+    res->paso_t = paso_transpuesto(res->alto);
+    size_t celdas = (size_t)res->paso_t * res->ancho;
+    res->transpuesta = (short*)reservar_alineado(celdas * sizeof(short) + ALINEACION);
+    if (res->transpuesta == NULL) return false;
+    memset(res->transpuesta, 0, celdas * sizeof(short) + ALINEACION);
+    for (int y = 0; y < res->alto; y++) {
+        for (int x = 0; x < res->ancho; x++) {
+            res->transpuesta[(size_t)x * res->paso_t + y] = res->valores[(size_t)y * res->paso + x];
+        }
+    }
+    return true;
+}
+
+// Aplica la simetria 'op' al pixel (x, y) de una imagen ancho x alto
+static inline void transformar_pixel(Simetria op, int ancho, int alto, int *x, int *y) {
+    int px = *x, py = *y;
+    switch (op) {
+        case SIMETRIA_ESPEJO_X:       *x = ancho - 1 - px; break;
+        case SIMETRIA_ESPEJO_Y:       *y = alto - 1 - py; break;
+        case SIMETRIA_GIRO_180:       *x = ancho - 1 - px; *y = alto - 1 - py; break;
+        case SIMETRIA_TRASPUESTA:     *x = py; *y = px; break;
+        case SIMETRIA_GIRO_90:        *x = ancho - 1 - py; *y = px; break;
+        case SIMETRIA_GIRO_270:       *x = py; *y = alto - 1 - px; break;
+        case SIMETRIA_ANTITRASPUESTA: *x = ancho - 1 - py; *y = alto - 1 - px; break;
+        default: break;
+    }
+}
+
+// Aplica la simetria 'op' al pixel de desplazamiento 'd' (y * paso + x)
+static inline size_t transformar_desplazamiento(Simetria op, int ancho, int alto, int paso, size_t d) {
+    int x = (int)(d % paso), y = (int)(d / paso);
+    transformar_pixel(op, ancho, alto, &x, &y);
+    return (size_t)y * paso + x;
+}
+
+// Crea un plano de oscuridad faltante transformado por cada simetria valida
+// de 'simetrias'. Devuelve false si no hay memoria
+bool crear_planos_simetricos(Residuo *res, const SimetriasClavos *simetrias) {
+    size_t bytes = (size_t)res->paso * res->alto * sizeof(short) + ALINEACION;
+    for (int g = 1; g < NUM_SIMETRIAS; g++) {
+        if (simetrias->permutacion[g] == NULL) continue;
+        short *plano = (short*)reservar_alineado(bytes);
+        if (plano == NULL) return false;
+        memset(plano, 0, bytes);
+        for (int y = 0; y < res->alto; y++) {
+            for (int x = 0; x < res->ancho; x++) {
+                size_t d = (size_t)y * res->paso + x;
+                plano[transformar_desplazamiento((Simetria)g, res->ancho, res->alto, res->paso, d)] =
+                    res->valores[d];
+            }
+        }
+        res->simetricos[g] = plano;
+        res->num_simetricos++;
+    }
+    return true;
+}
+
+// Anade a 'res' un nivel grueso reducido 'factor' veces en cada eje. Cada
+// celda vale la oscuridad faltante positiva de su bloque dividida entre
+// 'factor', que es lo que aporta el tramo de una linea que cruza el bloque,
+// de modo que las puntuaciones de ambos niveles son comparables
+bool crear_nivel_grueso(Residuo *res, int factor) {
+    Residuo *g = (Residuo*)malloc(sizeof(Residuo));
+    if (g == NULL) return false;
+    
+    g->ancho = (res->ancho + factor - 1) / factor;
+    g->alto = (res->alto + factor - 1) / factor;
+    g->paso = (g->ancho + ALINEACION - 1) / ALINEACION * ALINEACION;
+    g->grueso = NULL;
+    g->factor = 1;
+    g->transpuesta = NULL;
+    g->paso_t = 0;
+    for (int k = 0; k < NUM_SIMETRIAS; k++) g->simetricos[k] = NULL;
+    g->num_simetricos = 0;
+    g->mosaicos = NULL;
+    size_t celdas = (size_t)g->paso * g->alto;
+    g->valores = (short*)reservar_alineado(celdas * sizeof(short) + ALINEACION);
+    g->sumas = (int*)calloc(celdas, sizeof(int));
+    if (g->valores == NULL || g->sumas == NULL) {
+        free(g->valores);
+        free(g->sumas);
+        free(g);
+        return false;
+    }
+    memset(g->valores, 0, celdas * sizeof(short) + ALINEACION);
+    
+    for (int i = 0; i < res->alto; i++) {
+        const short *fila = res->valores + (size_t)i * res->paso;
+        int *sumas = g->sumas + (size_t)(i / factor) * g->paso;
+        for (int j = 0; j < res->ancho; j++) {
+            if (fila[j] > 0) sumas[j / factor] += fila[j];
+        }
+    }
+    for (size_t b = 0; b < celdas; b++) {
+        g->valores[b] = (short)(g->sumas[b] / factor);
+    }
+    
+    res->grueso = g;
+    res->factor = factor;
+    return true;
+}
+
+// Libera el plano de oscuridad faltante (y su nivel grueso)
+void liberar_residuo(Residuo *res) {
+    if (res == NULL) return;
+    liberar_residuo(res->grueso);
+    for (int g = 0; g < NUM_SIMETRIAS; g++) free(res->simetricos[g]);
+    liberar_mosaicos(res->mosaicos);
+    free(res->transpuesta);
+    free(res->sumas);
+    free(res->valores);
+    free(res);
+}
+
+// Suma 'delta' a la oscuridad positiva del bloque grueso que contiene el pixel 'd'
+static void actualizar_bloque(Residuo *res, size_t d, int delta) {
+    Residuo *g = res->grueso;
+    int y = (int)(d / res->paso);
+    int x = (int)(d % res->paso);
+    size_t b = (size_t)(y / res->factor) * g->paso + x / res->factor;
+    g->sumas[b] += delta;
+    g->valores[b] = (short)(g->sumas[b] / res->factor);
+}
+
+// Escribe un entero sin signo en base 128 (7 bits por byte, el bit alto
+// indica que sigue otro byte). Devuelve los bytes escritos
+static int escribir_varint(FILE *archivo, unsigned int valor) {
+    int bytes = 1;
+    while (valor >= 0x80) {
+        fputc((int)(valor & 0x7F) | 0x80, archivo);
+        valor >>= 7;
+        bytes++;
+    }
+    fputc((int)valor, archivo);
+    return bytes;
+}
+
+// Lee un entero escrito con escribir_varint
+// Devuelve la posicion siguiente o NULL si el fichero termina a medias
+static const unsigned char* leer_varint(const unsigned char *pos, const unsigned char *fin,
+                                        unsigned int *valor) {
+    unsigned int v = 0;
+    for (int desplazamiento = 0; pos < fin && desplazamiento < 35; desplazamiento += 7) {
+        unsigned char byte = *pos++;
+        v |= (unsigned int)(byte & 0x7F) << desplazamiento;
+        if ((byte & 0x80) == 0) {
+            *valor = v;
+            return pos;
+        }
+    }
+    return NULL;
+}
+
+// Escribe un real como sus 8 bytes IEEE 754 en orden little-endian
+static int escribir_real(FILE *archivo, double valor) {
+    uint64_t bits;
+    memcpy(&bits, &valor, sizeof(bits));
+    for (int k = 0; k < 8; k++) {
+        fputc((int)((bits >> (8 * k)) & 0xFF), archivo);
+    }
+    return 8;
+}
+
+// Lee un real escrito con escribir_real
+// Devuelve la posicion siguiente o NULL si el fichero termina a medias
+static const unsigned char* leer_real(const unsigned char *pos, const unsigned char *fin, double *valor) {
+    if (fin - pos < 8) return NULL;
+    uint64_t bits = 0;
+    for (int k = 0; k < 8; k++) {
+        bits |= (uint64_t)pos[k] << (8 * k);
+    }
+    memcpy(valor, &bits, sizeof(bits));
+    return pos + 8;
+}
+
+// Zigzag: los enteros pequeños en valor absoluto dan varints cortos
+static unsigned int zigzag(int v) {
+    return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static int deshacer_zigzag(unsigned int v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+// Crea una secuencia vacia con sitio inicial para 'capacidad' hilos
+SecuenciaHilos* crear_secuencia(int capacidad) {
+    SecuenciaHilos *secuencia = (SecuenciaHilos*)malloc(sizeof(SecuenciaHilos));
+    if (secuencia == NULL) return NULL;
+    secuencia->clavos = (int*)malloc((size_t)capacidad * 2 * sizeof(int));
+    if (secuencia->clavos == NULL) {
+        free(secuencia);
+        return NULL;
+    }
+    secuencia->num_hilos = 0;
+    secuencia->capacidad = capacidad;
+    secuencia->fichero = NULL;
+    secuencia->bytes = 0;
+    secuencia->ultimo_clavo = 0;
+    secuencia->volcar_cada = 1;
+    secuencia->sin_volcar = 0;
+    return secuencia;
+}
+
+// Abre el fichero de secuencia y escribe su cabecera: "HSEQ", la version y
+// los campos de 'cabecera' como varints, seguidos de las coordenadas de los
+// clavos si vienen de un fichero. Despues, cada hilo se codifica como
+// zigzag(clavo1 - clavo2 del hilo anterior) y zigzag(clavo2 - clavo1)
+bool abrir_fichero_secuencia(SecuenciaHilos *secuencia, const char *nombre_archivo,
+                             const CabeceraSecuencia *cabecera, int volcar_cada) {
+    FILE *archivo = fopen(nombre_archivo, "wb");
+    if (archivo == NULL) {
+        fprintf(stderr, "Error: No se pudo crear el archivo %s\n", nombre_archivo);
+        return false;
+    }
+    fwrite(SECUENCIA_MAGICO, 1, 4, archivo);
+    fputc(SECUENCIA_VERSION, archivo);
+    long bytes = 5;
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->ancho);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->alto);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->n);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->p);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->s);
+    bytes += escribir_varint(archivo, cabecera->semilla);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->modo);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->escala);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->valor);
+    bytes += escribir_varint(archivo, cabecera->desde_menor ? 1 : 0);
+    bytes += escribir_varint(archivo, cabecera->antialias ? 1 : 0);
+    bytes += escribir_varint(archivo, (unsigned int)cabecera->disposicion);
+    bytes += escribir_varint(archivo, cabecera->simetrias ? 1 : 0);
+    if (cabecera->disposicion == DISPOSICION_FICHERO) {
+        for (int i = 0; i < cabecera->n; i++) {
+            bytes += escribir_real(archivo, cabecera->clavos[i].x);
+            bytes += escribir_real(archivo, cabecera->clavos[i].y);
+        }
+    }
+    fflush(archivo);
+    
+    secuencia->fichero = archivo;
+    secuencia->bytes = bytes;
+    secuencia->ultimo_clavo = 0;
+    secuencia->volcar_cada = (volcar_cada > 0) ? volcar_cada : 1;
+    secuencia->sin_volcar = 0;
+    return true;
+}
+
+// Garantiza sitio para 'hilos' hilos mas, duplicando la capacidad si hace
+// falta (coste amortizado constante por hilo). Devuelve false si no hay memoria
+bool reservar_hilos(SecuenciaHilos *secuencia, int hilos) {
+    if ((long)secuencia->num_hilos + hilos <= secuencia->capacidad) return true;
+    long capacidad = secuencia->capacidad;
+    while (capacidad < (long)secuencia->num_hilos + hilos) capacidad *= 2;
+    if (capacidad > INT_MAX / 2) return false;
+    int *ampliado = (int*)realloc(secuencia->clavos, (size_t)capacidad * 2 * sizeof(int));
+    if (ampliado == NULL) return false;
+    secuencia->clavos = ampliado;
+    secuencia->capacidad = (int)capacidad;
+    return true;
+}
+
+// Hilos que aun se pueden dibujar antes de llegar al limite de 'params'
+static int hilos_restantes(const Parametros *params, const SecuenciaHilos *secuencia) {
+    if (params->max_hilos == 0) return INT_MAX;
+    return params->max_hilos - secuencia->num_hilos;
+}
+
+// Anade un hilo a la secuencia (con sitio ya reservado por reservar_hilos)
+// y, si hay fichero, lo escribe en el
+void anadir_hilo(SecuenciaHilos *secuencia, int clavo1, int clavo2) {
+    secuencia->clavos[secuencia->num_hilos * 2] = clavo1;
+    secuencia->clavos[secuencia->num_hilos * 2 + 1] = clavo2;
+    secuencia->num_hilos++;
+    
+    if (secuencia->fichero == NULL) return;
+    secuencia->bytes += escribir_varint(secuencia->fichero, zigzag(clavo1 - secuencia->ultimo_clavo));
+    secuencia->bytes += escribir_varint(secuencia->fichero, zigzag(clavo2 - clavo1));
+    secuencia->ultimo_clavo = clavo2;
+    if (++secuencia->sin_volcar >= secuencia->volcar_cada) {
+        fflush(secuencia->fichero);
+        secuencia->sin_volcar = 0;
+    }
+}
+
+// Cierra el fichero de secuencia (si lo hay). Devuelve false si fallo alguna escritura
+bool cerrar_fichero_secuencia(SecuenciaHilos *secuencia) {
+    if (secuencia->fichero == NULL) return true;
+    bool correcto = !ferror(secuencia->fichero);
+    if (fclose(secuencia->fichero) != 0) correcto = false;
+    secuencia->fichero = NULL;
+    return correcto;
+}
+
+// Libera la secuencia (cerrando su fichero si seguia abierto)
+void liberar_secuencia(SecuenciaHilos *secuencia) {
+    if (secuencia == NULL) return;
+    cerrar_fichero_secuencia(secuencia);
+    free(secuencia->clavos);
+    free(secuencia);
+}
+
+// Coloca n clavos distribuidos uniformemente en el perimetro rectangular
+static void generar_clavos_rectangulo(Punto *clavos, int n, int ancho, int alto) {
+    double perimetro = 2.0 * (ancho - 1) + 2.0 * (alto - 1);
+    double distancia_entre_clavos = perimetro / n;
+    
+    for (int i = 0; i < n; i++) {
+        double pos = i * distancia_entre_clavos;
+        
+        if (pos < ancho - 1) {
+            clavos[i].x = pos;
+            clavos[i].y = 0;
+        } else if (pos < (ancho - 1) + (alto - 1)) {
+            clavos[i].x = ancho - 1;
+            clavos[i].y = pos - (ancho - 1);
+        } else if (pos < 2 * (ancho - 1) + (alto - 1)) {
+            clavos[i].x = (ancho - 1) - (pos - (ancho - 1) - (alto - 1));
+            clavos[i].y = alto - 1;
+        } else {
+            clavos[i].x = 0;
+            clavos[i].y = (alto - 1) - (pos - 2 * (ancho - 1) - (alto - 1));
+        }
+    }
+}
+
+// Punto (u, v), relativo al centro, de la elipse de semiejes (a, b) que esta
+// a una 'fraccion' (0 a 1) del arco del primer cuadrante. 'arco' es la
+// longitud acumulada hasta cada una de las MUESTRAS_ELIPSE divisiones del angulo
+static void punto_cuarto_elipse(const double *arco, double a, double b, double fraccion,
+                                double *u, double *v) {
+    double angulo;
+    if (a == b) {
+        angulo = fraccion * M_PI / 2;
+    } else {
+        double objetivo = fraccion * arco[MUESTRAS_ELIPSE];
+        int izquierda = 0, derecha = MUESTRAS_ELIPSE;
+        while (derecha - izquierda > 1) {
+            int medio = (izquierda + derecha) / 2;
+            if (arco[medio] <= objetivo) izquierda = medio;
+            else derecha = medio;
+        }
+        double tramo = arco[derecha] - arco[izquierda];
+        double t = (tramo > 0) ? (objetivo - arco[izquierda]) / tramo : 0.0;
+        angulo = (izquierda + t) * (M_PI / 2) / MUESTRAS_ELIPSE;
+    }
+    *u = a * cos(angulo);
+    *v = b * sin(angulo);
+}
+
+// Coloca n clavos equiespaciados en longitud de arco sobre la elipse de
+// semiejes (a, b) centrada en la imagen, desplazados medio hueco para que
+// ninguno caiga sobre un eje. La posicion de cada clavo se reduce con
+// aritmetica entera al primer cuadrante (y en el circulo al primer octante)
+// y se refleja, asi que los clavos simetricos lo son exactamente
+static void generar_clavos_elipse(Punto *clavos, int n, int ancho, int alto, double a, double b) {
+    double arco[MUESTRAS_ELIPSE + 1];
+    arco[0] = 0.0;
+    double paso_angulo = (M_PI / 2) / MUESTRAS_ELIPSE;
+    for (int k = 1; k <= MUESTRAS_ELIPSE; k++) {
+        double medio = (k - 0.5) * paso_angulo;
+        arco[k] = arco[k - 1] + paso_angulo * hypot(a * sin(medio), b * cos(medio));
+    }
+    
+    double cx = (ancho - 1) / 2.0;
+    double cy = (alto - 1) / 2.0;
+    for (int i = 0; i < n; i++) {
+        // El perimetro mide 4n unidades y cada cuadrante n: el clavo i esta en 4i + 2
+        long posicion = 4L * i + 2;
+        int cuadrante = (int)(posicion / n);
+        long resto = posicion % n;
+        if (cuadrante & 1) resto = n - resto;
+        
+        double u, v;
+        bool intercambiar = (a == b && 2 * resto > n);
+        if (intercambiar) resto = n - resto;
+        punto_cuarto_elipse(arco, a, b, (double)resto / n, &u, &v);
+        if (intercambiar) {
+            double tmp = u; u = v; v = tmp;
+        }
+        if (cuadrante == 1 || cuadrante == 2) u = -u;
+        if (cuadrante >= 2) v = -v;
+        clavos[i].x = cx + u;
+        clavos[i].y = cy + v;
+    }
+}
+
+// Lee n clavos de un fichero de texto con una pareja "x y" (en pixeles) por
+// linea; se ignoran las lineas vacias y las que empiezan por '#'
+static bool leer_clavos_fichero(const char *nombre_archivo, Punto *clavos, int n, int ancho, int alto) {
+    FILE *archivo = fopen(nombre_archivo, "r");
+    if (archivo == NULL) {
+        fprintf(stderr, "Error: No se pudo abrir el fichero de clavos %s\n", nombre_archivo);
+        return false;
+    }
+    
+    char linea[256];
+    int leidos = 0, num_linea = 0;
+    bool correcto = true;
+    while (correcto && fgets(linea, sizeof(linea), archivo) != NULL) {
+        num_linea++;
+        char *pos = linea;
+        while (*pos == ' ' || *pos == '\t') pos++;
+        if (*pos == '#' || *pos == '\n' || *pos == '\r' || *pos == '\0') continue;
+        
+        double x, y;
+        char sobrante[2];
+        if (sscanf(pos, "%lf %lf %1s", &x, &y, sobrante) != 2) {
+            fprintf(stderr, "Error: Linea %d del fichero de clavos no valida\n", num_linea);
+            correcto = false;
+        } else if (x < 0 || y < 0 || x > ancho - 1 || y > alto - 1) {
+            fprintf(stderr, "Error: El clavo de la linea %d (%g, %g) esta fuera de la imagen %d x %d\n",
+                    num_linea, x, y, ancho, alto);
+            correcto = false;
+        } else if (leidos < n) {
+            clavos[leidos].x = x;
+            clavos[leidos].y = y;
+            leidos++;
+        } else {
+            leidos++;
+        }
+    }
+    fclose(archivo);
+    
+    if (correcto && leidos != n) {
+        fprintf(stderr, "Error: El fichero de clavos %s tiene %d clavos y n es %d\n",
+                nombre_archivo, leidos, n);
+        correcto = false;
+    }
+    return correcto;
+}
+
+// Genera los n clavos de la disposicion dada ('fichero' solo se usa con
+// DISPOSICION_FICHERO). Se reservan en 'arena' y se liberan con ella
+// Devuelve NULL si no hay memoria o el fichero no es valido
+Punto* generar_clavos(Arena *arena, TipoDisposicion disposicion, const char *fichero,
+                      int n, int ancho, int alto) {
+    Punto *clavos = (Punto*)arena_reservar(arena, n * sizeof(Punto));
+    if (clavos == NULL) return NULL;
+    
+    double radio = ((ancho < alto ? ancho : alto) - 1) / 2.0;
+    switch (disposicion) {
+        case DISPOSICION_CIRCULO:
+            generar_clavos_elipse(clavos, n, ancho, alto, radio, radio);
+            break;
+        case DISPOSICION_ELIPSE:
+            generar_clavos_elipse(clavos, n, ancho, alto, (ancho - 1) / 2.0, (alto - 1) / 2.0);
+            break;
+        case DISPOSICION_FICHERO:
+            if (!leer_clavos_fichero(fichero, clavos, n, ancho, alto)) return NULL;
+            break;
+        default:
+            generar_clavos_rectangulo(clavos, n, ancho, alto);
+            break;
+    }
+    return clavos;
+}
+
+// Corrige las sumas del mosaico del pixel 'd' cuando su oscuridad faltante
+// pasa de 'antes' a 'despues' y lo marca como sucio
+static void actualizar_mosaico(Residuo *res, size_t d, int antes, int despues) {
+    Mosaicos *m = res->mosaicos;
+    int k = m->de_tramo[d / LADO_MOSAICO];
+    m->error[k] += (long long)despues * despues - (long long)antes * antes;
+    int positivo = (despues > 0 ? despues : 0) - (antes > 0 ? antes : 0);
+    if (positivo != 0) {
+        bool tenia = m->positivo[k] > 0;
+        m->positivo[k] += positivo;
+        bool tiene = m->positivo[k] > 0;
+        m->con_oscuridad += (int)tiene - (int)tenia;
+    }
+    if (!m->sucio[k]) {
+        m->sucio[k] = 1;
+        m->sucios[m->num_sucios++] = k;
+    }
+}
+
+// Oscurece el pixel de desplazamiento 'd' restando 'valor' (saturando en 0)
+// Si 'res' no es NULL actualiza la oscuridad faltante y, si 'error' no es
+// NULL, le suma la variacion de la suma de cuadrados
+static inline void oscurecer_pixel(Imagen *img, Residuo *res, size_t d, unsigned char valor,
+                                   long long *error) {
+    unsigned char antes = img->pixels[d];
+    unsigned char despues = (antes >= valor) ? (unsigned char)(antes - valor) : 0;
+    img->pixels[d] = despues;
+    if (res != NULL) {
+        int faltante = res->valores[d];
+        int nuevo = faltante - (antes - despues);
+        res->valores[d] = (short)nuevo;
+        if (res->transpuesta != NULL) {
+            size_t x = d % res->paso, y = d / res->paso;
+            res->transpuesta[x * res->paso_t + y] = (short)nuevo;
+        }
+        if (res->num_simetricos > 0) {
+            for (int g = 1; g < NUM_SIMETRIAS; g++) {
+                if (res->simetricos[g] == NULL) continue;
+                res->simetricos[g][transformar_desplazamiento((Simetria)g, res->ancho, res->alto,
+                                                              res->paso, d)] = (short)nuevo;
+            }
+        }
+        if (error != NULL) {
+            *error += nuevo * nuevo - faltante * faltante;
+        }
+        if (res->grueso != NULL && faltante > 0) {
+            actualizar_bloque(res, d, (nuevo > 0 ? nuevo : 0) - faltante);
+        }
+        if (res->mosaicos != NULL && nuevo != faltante) {
+            actualizar_mosaico(res, d, faltante, nuevo);
+        }
+    }
+}
+
+// Dibuja una linea entre dos puntos usando el algoritmo de Bresenham
+// Cada pixel se oscurece restando 'valor' (permite acumulacion de hilos)
+// Si 'res' no es NULL se mantiene la oscuridad faltante y 'error' (opcional)
+// acumula la variacion del error
+void dibujar_linea_bresenham(Imagen *img, Residuo *res, int x1, int y1, int x2, int y2, 
+                             unsigned char valor, int *num_pixels, long long *error) {
+    int dx = abs(x2 - x1);
+    int dy = abs(y2 - y1);
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+    int err = dx - dy;
+    
+    int x = x1;
+    int y = y1;
+    *num_pixels = 0;
+    
+    int max_pixels = (int)sqrt(img->ancho * img->ancho + img->alto * img->alto) + 10;
+    
+    while (*num_pixels < max_pixels) {
+        if (x >= 0 && x < img->ancho && y >= 0 && y < img->alto) {
+            oscurecer_pixel(img, res, (size_t)y * img->paso + x, valor, error);
+            (*num_pixels)++;
+        }
+        
+        if (x == x2 && y == y2) break;
+        
+        int e2 = 2 * err;
+        
+        if (e2 > -dy) {
+            err -= dy;
+            x += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+// Oscurece los dos pixeles de cada entrada de una linea con antialiasing en
+// 'valor' por su peso de cobertura, redondeado
+void dibujar_linea_ponderada(Imagen *img, Residuo *res, const int *pixeles, const unsigned char *pesos,
+                             int num_pixeles, bool transpuesta, unsigned char valor, long long *error) {
+    int paso_t = paso_transpuesto(img->alto);
+    for (int i = 0; i < num_pixeles; i++) {
+        size_t d = (size_t)pixeles[i];
+        size_t vecino = 1;
+        if (transpuesta) {
+            d = (d % paso_t) * img->paso + d / paso_t;
+            vecino = img->paso;
+        }
+        for (int k = 0; k < 2; k++) {
+            int oscuridad = (valor * pesos[2 * i + k] + PESO_MAXIMO_AA / 2) / PESO_MAXIMO_AA;
+            if (oscuridad > 0) {
+                oscurecer_pixel(img, res, d + k * vecino, (unsigned char)oscuridad, error);
+            }
+        }
+    }
+}
+
+// Rasteriza con Bresenham la linea (x1,y1)-(x2,y2) guardando en 'pixeles' el
+// desplazamiento y * paso + x de cada pixel dentro de la imagen
+// Devuelve el numero de pixeles escritos
+int rasterizar_linea(int x1, int y1, int x2, int y2, int ancho, int alto, int paso, int *pixeles) {
+    int dx = abs(x2 - x1);
+    int dy = abs(y2 - y1);
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+    int err = dx - dy;
+    
+    int x = x1;
+    int y = y1;
+    int num_pixeles = 0;
+    int max_pixeles = (int)sqrt(ancho * ancho + alto * alto) + 10;
+    int iteraciones = 0;
+    
+    while (iteraciones < max_pixeles) {
+        if (x >= 0 && x < ancho && y >= 0 && y < alto) {
+            pixeles[num_pixeles++] = y * paso + x;
+        }
+        
+        if (x == x2 && y == y2) break;
+        
+        int e2 = 2 * err;
+        
+        if (e2 > -dy) {
+            err -= dy;
+            x += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y += sy;
+        }
+        
+        iteraciones++;
+    }
+    
+    return num_pixeles;
+}
+
+// Rasteriza con el algoritmo de Wu la linea entre dos puntos de coordenadas
+// reales. En cada paso del eje mayor la linea cubre dos pixeles vecinos del
+// eje menor con pesos proporcionales a su cercania que suman PESO_MAXIMO_AA;
+// se guarda una entrada por paso: en 'pixeles' el desplazamiento del primero
+// y en 'pesos' los dos pesos. La pareja queda contigua en memoria: en el
+// plano normal si la linea es empinada y en el traspuesto si no, lo que se
+// indica en '*transpuesta'. Un pixel fuera de la imagen se queda con peso 0
+// Devuelve el numero de entradas escritas
+int rasterizar_linea_aa(double x1, double y1, double x2, double y2, int ancho, int alto, int paso,
+                        int *pixeles, unsigned char *pesos, bool *transpuesta) {
+    bool empinada = fabs(y2 - y1) > fabs(x2 - x1);
+    if (empinada) {
+        double tmp = x1; x1 = y1; y1 = tmp;
+        tmp = x2; x2 = y2; y2 = tmp;
+    }
+    if (x1 > x2) {
+        double tmp = x1; x1 = x2; x2 = tmp;
+        tmp = y1; y1 = y2; y2 = tmp;
+    }
+    double pendiente = (x2 > x1) ? (y2 - y1) / (x2 - x1) : 0.0;
+    int limite_mayor = empinada ? alto : ancho;
+    int limite_menor = empinada ? ancho : alto;
+    int paso_mayor = empinada ? paso : paso_transpuesto(alto);
+    *transpuesta = !empinada;
+    
+    int num_pixeles = 0;
+    int inicio = (int)floor(x1 + 0.5);
+    int fin = (int)floor(x2 + 0.5);
+    for (int mayor = inicio; mayor <= fin; mayor++) {
+        if (mayor < 0 || mayor >= limite_mayor) continue;
+        double y = y1 + pendiente * (mayor - x1);
+        int menor = (int)floor(y);
+        int peso1 = (int)((1.0 - (y - menor)) * PESO_MAXIMO_AA + 0.5);
+        int peso2 = PESO_MAXIMO_AA - peso1;
+        if (menor == -1) {
+            menor = 0;
+            peso1 = peso2;
+            peso2 = 0;
+        } else if (menor == limite_menor - 1) {
+            peso2 = 0;
+        } else if (menor < 0 || menor >= limite_menor) {
+            continue;
+        }
+        if (peso1 + peso2 == 0) continue;
+        pixeles[num_pixeles] = mayor * paso_mayor + menor;
+        pesos[2 * num_pixeles] = (unsigned char)peso1;
+        pesos[2 * num_pixeles + 1] = (unsigned char)peso2;
+        num_pixeles++;
+    }
+    
+    return num_pixeles;
+}
+
+// Indice de la entrada de cache del par no ordenado (clavo1, clavo2)
+static long indice_par(int n, int clavo1, int clavo2) {
+    if (clavo1 > clavo2) {
+        int tmp = clavo1;
+        clavo1 = clavo2;
+        clavo2 = tmp;
+    }
+    return (long)clavo1 * n - (long)clavo1 * (clavo1 + 1) / 2 + (clavo2 - clavo1 - 1);
+}
+
+// Resolucion (en fracciones de pixel) con la que se comparan las posiciones de los clavos
+#define SUBPIXELES_SIMETRIA 256
+
+// Clavo y clave de su posicion (cuantizada a 1/SUBPIXELES_SIMETRIA de pixel)
+typedef struct {
+    long long clave;
+    int clavo;
+} ClaveClavo;
+
+static int comparar_claves_clavos(const void *a, const void *b) {
+    long long ca = ((const ClaveClavo*)a)->clave, cb = ((const ClaveClavo*)b)->clave;
+    return (ca > cb) - (ca < cb);
+}
+
+// Busca las simetrias del grupo D4 que llevan cada clavo a otro clavo. Se
+// comparan las posiciones reales (dos clavos pueden redondear al mismo pixel)
+// y ademas se exige que la simetria lleve el pixel de cada clavo al pixel del
+// otro, que es lo que permite reutilizar la linea rasterizada
+// Las permutaciones se reservan en 'arena'. Devuelve false si no hay memoria
+bool detectar_simetrias(Arena *arena, const Punto *clavos, int n, int ancho, int alto,
+                        SimetriasClavos *simetrias) {
+    simetrias->num = 1;
+    for (int g = 0; g < NUM_SIMETRIAS; g++) simetrias->permutacion[g] = NULL;
+    
+    // Las coordenadas cuantizadas forman una rejilla de ancho_q x alto_q puntos
+    int ancho_q = (ancho - 1) * SUBPIXELES_SIMETRIA + 1;
+    int alto_q = (alto - 1) * SUBPIXELES_SIMETRIA + 1;
+    ClaveClavo *orden = (ClaveClavo*)malloc(n * sizeof(ClaveClavo));
+    if (orden == NULL) return false;
+    for (int i = 0; i < n; i++) {
+        orden[i].clave = llround(clavos[i].y * SUBPIXELES_SIMETRIA) * ancho_q +
+                         llround(clavos[i].x * SUBPIXELES_SIMETRIA);
+        orden[i].clavo = i;
+    }
+    qsort(orden, n, sizeof(ClaveClavo), comparar_claves_clavos);
+    for (int i = 1; i < n; i++) {
+        if (orden[i].clave == orden[i - 1].clave) {
+            free(orden);
+            return true;
+        }
+    }
+    
+    bool correcto = true;
+    int num_simetrias = (ancho == alto) ? NUM_SIMETRIAS : SIMETRIA_TRASPUESTA;
+    for (int g = 1; g < num_simetrias; g++) {
+        int *permutacion = (int*)arena_reservar(arena, n * sizeof(int));
+        if (permutacion == NULL) {
+            correcto = false;
+            break;
+        }
+        bool valida = true;
+        for (int i = 0; i < n && valida; i++) {
+            int xq = (int)llround(clavos[i].x * SUBPIXELES_SIMETRIA);
+            int yq = (int)llround(clavos[i].y * SUBPIXELES_SIMETRIA);
+            transformar_pixel((Simetria)g, ancho_q, alto_q, &xq, &yq);
+            ClaveClavo buscada = { (long long)yq * ancho_q + xq, 0 };
+            ClaveClavo *encontrada = (ClaveClavo*)bsearch(&buscada, orden, n, sizeof(ClaveClavo),
+                                                          comparar_claves_clavos);
+            if (encontrada == NULL) {
+                valida = false;
+                break;
+            }
+            int j = encontrada->clavo;
+            int x = (int)round(clavos[i].x), y = (int)round(clavos[i].y);
+            transformar_pixel((Simetria)g, ancho, alto, &x, &y);
+            valida = (x == (int)round(clavos[j].x) && y == (int)round(clavos[j].y));
+            permutacion[i] = j;
+        }
+        if (valida) {
+            simetrias->permutacion[g] = permutacion;
+            simetrias->num++;
+        }
+    }
+    free(orden);
+    return correcto;
+}
+
+// Lleva el par (*clavo1, *clavo2) a su representante: el de menor indice de
+// par entre sus imagenes por las simetrias validas. Devuelve la simetria usada
+static Simetria canonizar_par(const SimetriasClavos *simetrias, int n, int *clavo1, int *clavo2) {
+    if (simetrias->num == 1) return SIMETRIA_IDENTIDAD;
+    Simetria elegida = SIMETRIA_IDENTIDAD;
+    long mejor = indice_par(n, *clavo1, *clavo2);
+    for (int g = 1; g < NUM_SIMETRIAS; g++) {
+        const int *permutacion = simetrias->permutacion[g];
+        if (permutacion == NULL) continue;
+        long indice = indice_par(n, permutacion[*clavo1], permutacion[*clavo2]);
+        if (indice < mejor) {
+            mejor = indice;
+            elegida = (Simetria)g;
+        }
+    }
+    if (elegida != SIMETRIA_IDENTIDAD) {
+        int a = simetrias->permutacion[elegida][*clavo1];
+        int b = simetrias->permutacion[elegida][*clavo2];
+        *clavo1 = a;
+        *clavo2 = b;
+    }
+    return elegida;
+}
+
+// Clase de tamaño del bloque para una linea de 'num_pixeles' pixeles (con
+// antialiasing los pesos ocupan dos bytes por entrada detras de los desplazamientos)
+static inline int clase_bloque(const CacheLineas *cache, int num_pixeles) {
+    int enteros = num_pixeles + (cache->antialias ? (num_pixeles + 1) / 2 : 0);
+    return enteros / PIXELES_POR_CLASE + 1;
+}
+
+static inline size_t bytes_bloque(const CacheLineas *cache, int num_pixeles) {
+    return (size_t)clase_bloque(cache, num_pixeles) * PIXELES_POR_CLASE * sizeof(int);
+}
+
+// Crea una cache de lineas vacia para los clavos dados
+// memoria_maxima: bytes maximos dedicados a pixeles de lineas
+// Con 'compartir_simetrias' (y sin antialiasing) las lineas que son imagen de
+// otra por una simetria de los clavos reutilizan sus pixeles
+CacheLineas* crear_cache_lineas(Punto *clavos, int n, int ancho, int alto, int paso,
+                                size_t memoria_maxima, bool antialias, bool compartir_simetrias) {
+    CacheLineas *cache = (CacheLineas*)malloc(sizeof(CacheLineas));
+    if (cache == NULL) return NULL;
+    iniciar_arena(&cache->arena, BLOQUE_ARENA);
+    
+    long num_pares = (long)n * (n - 1) / 2;
+    cache->n = n;
+    cache->ancho = ancho;
+    cache->alto = alto;
+    cache->paso = paso;
+    cache->max_pixeles = (int)sqrt(ancho * ancho + alto * alto) + 10;
+    cache->antialias = antialias;
+    cache->memoria_usada = 0;
+    cache->memoria_reservada = 0;
+    cache->memoria_maxima = memoria_maxima;
+    cache->aciertos = 0;
+    cache->fallos = 0;
+    cache->expulsiones = 0;
+    cache->simetricas = 0;
+    cache->reutilizados = 0;
+    cache->num_clases = clase_bloque(cache, cache->max_pixeles) + 1;
+    cache->extremos = (int*)arena_reservar(&cache->arena, n * 2 * sizeof(int));
+    cache->extremos_reales = NULL;
+    if (antialias) {
+        cache->extremos_reales = (double*)arena_reservar(&cache->arena, n * 2 * sizeof(double));
+    }
+    cache->entradas = (EntradaLinea*)arena_reservar(&cache->arena, num_pares * sizeof(EntradaLinea));
+    cache->cabezas = (int*)arena_reservar(&cache->arena, cache->num_clases * 2 * sizeof(int));
+    cache->simetrias.num = 1;
+    for (int g = 0; g < NUM_SIMETRIAS; g++) cache->simetrias.permutacion[g] = NULL;
+    bool simetrias_correctas = true;
+    if (compartir_simetrias && !antialias) {
+        simetrias_correctas = detectar_simetrias(&cache->arena, clavos, n, ancho, alto, &cache->simetrias);
+    }
+    if (cache->extremos == NULL || cache->entradas == NULL || cache->cabezas == NULL ||
+        (antialias && cache->extremos_reales == NULL) || !simetrias_correctas) {
+        liberar_arena(&cache->arena);
+        free(cache);
+        return NULL;
+    }
+    cache->colas = cache->cabezas + cache->num_clases;
+    for (int c = 0; c < cache->num_clases; c++) {
+        cache->cabezas[c] = -1;
+        cache->colas[c] = -1;
+    }
+    pthread_mutex_init(&cache->cerrojo, NULL);
+    
+    for (int i = 0; i < n; i++) {
+        cache->extremos[i * 2] = (int)round(clavos[i].x);
+        cache->extremos[i * 2 + 1] = (int)round(clavos[i].y);
+        if (antialias) {
+            cache->extremos_reales[i * 2] = clavos[i].x;
+            cache->extremos_reales[i * 2 + 1] = clavos[i].y;
+        }
+    }
+    
+    for (long i = 0; i < num_pares; i++) {
+        cache->entradas[i].pixeles = NULL;
+        cache->entradas[i].pesos = NULL;
+        cache->entradas[i].num_pixeles = 0;
+        cache->entradas[i].transpuesta = false;
+        cache->entradas[i].simetria = SIMETRIA_IDENTIDAD;
+        cache->entradas[i].canonica = (int)i;
+        cache->entradas[i].fijaciones = 0;
+        cache->entradas[i].anterior = -1;
+        cache->entradas[i].siguiente = -1;
+    }
+    
+    return cache;
+}
+
+// Saca una entrada de la lista LRU de su clase
+static void desenlazar_entrada(CacheLineas *cache, int indice) {
+    EntradaLinea *e = &cache->entradas[indice];
+    int clase = clase_bloque(cache, e->num_pixeles);
+    if (e->anterior != -1) cache->entradas[e->anterior].siguiente = e->siguiente;
+    else cache->cabezas[clase] = e->siguiente;
+    if (e->siguiente != -1) cache->entradas[e->siguiente].anterior = e->anterior;
+    else cache->colas[clase] = e->anterior;
+    e->anterior = -1;
+    e->siguiente = -1;
+}
+
+// Inserta una entrada al principio de la lista LRU de su clase (mas reciente)
+static void enlazar_entrada(CacheLineas *cache, int indice) {
+    EntradaLinea *e = &cache->entradas[indice];
+    int clase = clase_bloque(cache, e->num_pixeles);
+    e->anterior = -1;
+    e->siguiente = cache->cabezas[clase];
+    if (cache->cabezas[clase] != -1) cache->entradas[cache->cabezas[clase]].anterior = indice;
+    cache->cabezas[clase] = indice;
+    if (cache->colas[clase] == -1) cache->colas[clase] = indice;
+}
+
+// Bloque para una linea de 'num_pixeles': se pide a la arena mientras quepa
+// en el limite y, despues, se quita a la linea no fijada de su misma clase
+// usada hace mas tiempo, que queda expulsada. Solo si la clase no tiene
+// ninguna se pide uno nuevo por encima del limite. Con el cerrojo tomado
+static int* reservar_bloque_pixeles(CacheLineas *cache, int num_pixeles) {
+    size_t bytes = bytes_bloque(cache, num_pixeles);
+    if (cache->memoria_reservada + bytes > cache->memoria_maxima) {
+        int victima = cache->colas[clase_bloque(cache, num_pixeles)];
+        while (victima != -1 && cache->entradas[victima].fijaciones > 0) {
+            victima = cache->entradas[victima].anterior;
+        }
+        if (victima != -1) {
+            EntradaLinea *v = &cache->entradas[victima];
+            int *bloque = v->pixeles;
+            desenlazar_entrada(cache, victima);
+            v->pixeles = NULL;
+            v->pesos = NULL;
+            cache->memoria_usada -= bytes;
+            cache->expulsiones++;
+            cache->reutilizados++;
+            return bloque;
+        }
+    }
+    int *bloque = (int*)arena_reservar(&cache->arena, bytes);
+    if (bloque != NULL) cache->memoria_reservada += bytes;
+    return bloque;
+}
+
+// Entrada que se devuelve para el par 'pedida' cuando sus pixeles son los de
+// la entrada canonica 'indice' vistos por 'simetria': comparte el bloque de
+// pixeles sin copiarlo. Con el cerrojo tomado y la canonica fijada (mientras
+// alguien use la vista la canonica no se expulsa y sus campos no cambian)
+static EntradaLinea* vista_linea(CacheLineas *cache, int pedida, int indice, Simetria simetria) {
+    EntradaLinea *e = &cache->entradas[indice];
+    if (pedida == indice) return e;
+    cache->simetricas++;
+    EntradaLinea *vista = &cache->entradas[pedida];
+    if (vista->pixeles != e->pixeles || vista->canonica != indice) {
+        vista->pixeles = e->pixeles;
+        vista->num_pixeles = e->num_pixeles;
+        vista->simetria = (unsigned char)simetria;
+        vista->canonica = indice;
+    }
+    return vista;
+}
+
+// Rasteriza en 'pixeles' (y con antialiasing en 'pesos') la linea del par
+// (a, b), a < b, tal como la guarda la cache. Devuelve el numero de pixeles
+static int rasterizar_par(CacheLineas *cache, int a, int b, int *pixeles, unsigned char *pesos,
+                          bool *transpuesta) {
+    *transpuesta = false;
+    if (cache->antialias) {
+        const double *extremos = cache->extremos_reales;
+        return rasterizar_linea_aa(extremos[a * 2], extremos[a * 2 + 1],
+                                   extremos[b * 2], extremos[b * 2 + 1],
+                                   cache->ancho, cache->alto, cache->paso, pixeles, pesos,
+                                   transpuesta);
+    }
+    return rasterizar_linea(cache->extremos[a * 2], cache->extremos[a * 2 + 1],
+                            cache->extremos[b * 2], cache->extremos[b * 2 + 1],
+                            cache->ancho, cache->alto, cache->paso, pixeles);
+}
+
+// Devuelve la linea entre dos clavos, rasterizandola si no estaba en cache
+// La linea queda fijada (no se expulsa) hasta llamar a soltar_linea
+// Devuelve NULL si no hay memoria para rasterizarla
+EntradaLinea* obtener_linea(CacheLineas *cache, int clavo1, int clavo2) {
+    int pedida = (int)indice_par(cache->n, clavo1, clavo2);
+    Simetria simetria = canonizar_par(&cache->simetrias, cache->n, &clavo1, &clavo2);
+    int indice = (int)indice_par(cache->n, clavo1, clavo2);
+    EntradaLinea *e = &cache->entradas[indice];
+    
+    pthread_mutex_lock(&cache->cerrojo);
+    if (e->pixeles != NULL) {
+        cache->aciertos++;
+        e->fijaciones++;
+        if (cache->cabezas[clase_bloque(cache, e->num_pixeles)] != indice) {
+            desenlazar_entrada(cache, indice);
+            enlazar_entrada(cache, indice);
+        }
+        EntradaLinea *linea = vista_linea(cache, pedida, indice, simetria);
+        pthread_mutex_unlock(&cache->cerrojo);
+        return linea;
+    }
+    cache->fallos++;
+    pthread_mutex_unlock(&cache->cerrojo);
+    
+    // Se rasteriza fuera del cerrojo (en la pila) y siempre desde el clavo de
+    // menor indice para que (a, b) y (b, a) compartan exactamente los mismos pixeles
+    int a = (clavo1 < clavo2) ? clavo1 : clavo2;
+    int b = (clavo1 < clavo2) ? clavo2 : clavo1;
+    int temporal[cache->max_pixeles];
+    unsigned char pesos[cache->antialias ? 2 * cache->max_pixeles : 1];
+    bool transpuesta;
+    int num_pixeles = rasterizar_par(cache, a, b, temporal, pesos, &transpuesta);
+    size_t bytes = bytes_bloque(cache, num_pixeles);
+    
+    pthread_mutex_lock(&cache->cerrojo);
+    if (e->pixeles == NULL) {
+        int *pixeles = reservar_bloque_pixeles(cache, num_pixeles);
+        if (pixeles == NULL) {
+            pthread_mutex_unlock(&cache->cerrojo);
+            return NULL;
+        }
+        memcpy(pixeles, temporal, num_pixeles * sizeof(int));
+        if (cache->antialias) {
+            e->pesos = (unsigned char*)(pixeles + num_pixeles);
+            memcpy(e->pesos, pesos, 2 * (size_t)num_pixeles);
+        }
+        e->transpuesta = transpuesta;
+        e->pixeles = pixeles;
+        e->num_pixeles = num_pixeles;
+        cache->memoria_usada += bytes;
+        enlazar_entrada(cache, indice);
+    }
+    // Si no, otro trabajador la inserto mientras tanto
+    e->fijaciones++;
+    EntradaLinea *linea = vista_linea(cache, pedida, indice, simetria);
+    pthread_mutex_unlock(&cache->cerrojo);
+    
+    return linea;
+}
+
+// Prepara en 'linea' la entrada que tendria en la cache el par (clavo1,
+// clavo2), con los pixeles y pesos en la memoria de quien llama (de
+// cache->max_pixeles y 2 * cache->max_pixeles elementos). Sirve cuando
+// obtener_linea no tiene memoria: antialiasing y simetria son los mismos que
+// en la cache, asi que el resultado no depende de si la linea cabia
+static void linea_sin_cache(CacheLineas *cache, int clavo1, int clavo2, EntradaLinea *linea,
+                            int *pixeles, unsigned char *pesos) {
+    Simetria simetria = canonizar_par(&cache->simetrias, cache->n, &clavo1, &clavo2);
+    int a = (clavo1 < clavo2) ? clavo1 : clavo2;
+    int b = (clavo1 < clavo2) ? clavo2 : clavo1;
+    linea->num_pixeles = rasterizar_par(cache, a, b, pixeles, pesos, &linea->transpuesta);
+    linea->pixeles = pixeles;
+    linea->pesos = cache->antialias ? pesos : NULL;
+    linea->simetria = (unsigned char)simetria;
+    linea->canonica = -1;
+    linea->fijaciones = 0;
+    linea->anterior = linea->siguiente = -1;
+}
+
+// Libera la fijacion de una linea obtenida con obtener_linea
+void soltar_linea(CacheLineas *cache, EntradaLinea *linea) {
+    pthread_mutex_lock(&cache->cerrojo);
+    cache->entradas[linea->canonica].fijaciones--;
+    pthread_mutex_unlock(&cache->cerrojo);
+}
+
+// Crea las copias del plano de oscuridad faltante que necesitan las lineas de
+// 'cache': la traspuesta con antialiasing y una por simetria compartida
+// Devuelve false si no hay memoria
+bool preparar_planos(Residuo *res, const CacheLineas *cache) {
+    if (cache == NULL) return true;
+    if (cache->antialias && !crear_plano_transpuesto(res)) return false;
+    return crear_planos_simetricos(res, &cache->simetrias);
+}
+
+// Desplazamiento en la imagen del pixel i de una linea cacheada
+static inline size_t pixel_linea(const EntradaLinea *linea, int i, int ancho, int alto, int paso) {
+    size_t d = (size_t)linea->pixeles[i];
+    if (linea->simetria == SIMETRIA_IDENTIDAD) return d;
+    return transformar_desplazamiento(simetria_inversa[linea->simetria], ancho, alto, paso, d);
+}
+
+// Libera la cache de lineas y todos sus pixeles
+void liberar_cache_lineas(CacheLineas *cache) {
+    if (cache == NULL) return;
+    pthread_mutex_lock(&cerrojo_memoria);
+    memoria_liberada.bloques_reutilizados += cache->reutilizados;
+    pthread_mutex_unlock(&cerrojo_memoria);
+    pthread_mutex_destroy(&cache->cerrojo);
+    liberar_arena(&cache->arena);
+    free(cache);
+}
+
+// Oscurece en 'valor' los pixeles de una linea cacheada (con antialiasing,
+// en proporcion a la cobertura de cada pixel)
+void dibujar_linea_cache(Imagen *img, Residuo *res, EntradaLinea *linea, unsigned char valor,
+                         long long *error) {
+    if (linea->pesos != NULL) {
+        dibujar_linea_ponderada(img, res, linea->pixeles, linea->pesos, linea->num_pixeles,
+                                linea->transpuesta, valor, error);
+        return;
+    }
+    for (int i = 0; i < linea->num_pixeles; i++) {
+        oscurecer_pixel(img, res, pixel_linea(linea, i, img->ancho, img->alto, img->paso), valor, error);
+    }
+}
+
+// Dibuja el hilo entre dos clavos, usando la cache de lineas si existe
+// 'res' (opcional) se mantiene al dia y 'error' acumula la variacion del error
+void dibujar_hilo(Imagen *img, Residuo *res, Punto *clavos, CacheLineas *cache,
+                  int clavo1, int clavo2, unsigned char valor, long long *error) {
+    EntradaLinea *linea = (cache != NULL) ? obtener_linea(cache, clavo1, clavo2) : NULL;
+    if (linea != NULL) {
+        dibujar_linea_cache(img, res, linea, valor, error);
+        soltar_linea(cache, linea);
+        return;
+    }
+    if (cache != NULL) {
+        // La cache no tiene memoria: la misma linea, rasterizada en la pila
+        EntradaLinea temporal;
+        int pixeles[cache->max_pixeles];
+        unsigned char pesos[cache->antialias ? 2 * cache->max_pixeles : 1];
+        linea_sin_cache(cache, clavo1, clavo2, &temporal, pixeles, pesos);
+        dibujar_linea_cache(img, res, &temporal, valor, error);
+        return;
+    }
+    
+    // Sin cache se traza igual que en ella, desde el clavo de menor indice
+    if (clavo2 < clavo1) {
+        int tmp = clavo1; clavo1 = clavo2; clavo2 = tmp;
+    }
+    int num_pixels;
+    dibujar_linea_bresenham(img, res,
+                            (int)round(clavos[clavo1].x),
+                            (int)round(clavos[clavo1].y),
+                            (int)round(clavos[clavo2].x),
+                            (int)round(clavos[clavo2].y),
+                            valor,
+                            &num_pixels,
+                            error);
+}
+
+// Nucleo de puntuacion: suma la oscuridad faltante positiva de los pixeles
+// indicados. Todas las variantes suman enteros, asi que dan el mismo valor
+typedef int (*NucleoPuntuacion)(const short *faltante, const int *pixeles, int num_pixeles);
+
+// Variante ponderada para las lineas con antialiasing: cada entrada es una
+// pareja de pixeles contiguos (faltante[d], faltante[d + 1]) y suma la
+// oscuridad faltante positiva de ambos multiplicada por su peso. Cada pareja
+// aporta hasta 2 * 255 * 255, asi que la suma es de 64 bits
+typedef long long (*NucleoPonderado)(const short *faltante, const int *pixeles, const unsigned char *pesos,
+                               int num_pixeles);
+
+// Version escalar de referencia
+static int puntuar_escalar(const short *faltante, const int *pixeles, int num_pixeles) {
+    int beneficio_total = 0;
+    for (int i = 0; i < num_pixeles; i++) {
+        int oscuridad_faltante = faltante[pixeles[i]];
+        if (oscuridad_faltante > 0) {
+            beneficio_total += oscuridad_faltante;
+        }
+    }
+    return beneficio_total;
+}
+
+static long long puntuar_ponderado_escalar(const short *faltante, const int *pixeles,
+                                           const unsigned char *pesos, int num_pixeles) {
+    long long beneficio_total = 0;
+    for (int i = 0; i < num_pixeles; i++) {
+        const short *pareja = faltante + pixeles[i];
+        if (pareja[0] > 0) beneficio_total += pareja[0] * pesos[2 * i];
+        if (pareja[1] > 0) beneficio_total += pareja[1] * pesos[2 * i + 1];
+    }
+    return beneficio_total;
+}
+
+#ifdef HAY_SIMD_X86
+// Parejas que los nucleos ponderados suman en carriles de 32 bits antes de
+// volcarlas al total de 64 bits (8192 * 2 * 255 * 255 cabe en un int)
+#define PAREJAS_POR_BLOQUE 8192
+
+// SSE2: se cargan 8 pixeles en un vector de 16 bits, se anulan los negativos
+// con max(v, 0) y madd con unos los suma por parejas en 32 bits
+__attribute__((target("sse2")))
+static int puntuar_sse2(const short *faltante, const int *pixeles, int num_pixeles) {
+    const __m128i cero = _mm_setzero_si128();
+    const __m128i unos = _mm_set1_epi16(1);
+    __m128i suma = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= num_pixeles; i += 8) {
+        __m128i v = _mm_set_epi16(faltante[pixeles[i + 7]], faltante[pixeles[i + 6]],
+                                  faltante[pixeles[i + 5]], faltante[pixeles[i + 4]],
+                                  faltante[pixeles[i + 3]], faltante[pixeles[i + 2]],
+                                  faltante[pixeles[i + 1]], faltante[pixeles[i]]);
+        v = _mm_max_epi16(v, cero);
+        suma = _mm_add_epi32(suma, _mm_madd_epi16(v, unos));
+    }
+    suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, _MM_SHUFFLE(1, 0, 3, 2)));
+    suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(suma) + puntuar_escalar(faltante, pixeles + i, num_pixeles - i);
+}
+
+// SSE2 ponderado: 4 parejas por vector; los pesos se amplian a 16 bits y
+// madd multiplica y suma cada pareja (faltante y peso caben en 16 bits)
+__attribute__((target("sse2")))
+static long long puntuar_ponderado_sse2(const short *faltante, const int *pixeles,
+                                        const unsigned char *pesos, int num_pixeles) {
+    const __m128i cero = _mm_setzero_si128();
+    long long total = 0;
+    int i = 0;
+    while (i + 4 <= num_pixeles) {
+        int fin = (num_pixeles - i > PAREJAS_POR_BLOQUE) ? i + PAREJAS_POR_BLOQUE : num_pixeles;
+        __m128i suma = _mm_setzero_si128();
+        for (; i + 4 <= fin; i += 4) {
+            const short *p0 = faltante + pixeles[i], *p1 = faltante + pixeles[i + 1];
+            const short *p2 = faltante + pixeles[i + 2], *p3 = faltante + pixeles[i + 3];
+            __m128i v = _mm_set_epi16(p3[1], p3[0], p2[1], p2[0], p1[1], p1[0], p0[1], p0[0]);
+            v = _mm_max_epi16(v, cero);
+            __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pesos + 2 * i)), cero);
+            suma = _mm_add_epi32(suma, _mm_madd_epi16(v, w));
+        }
+        suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, _MM_SHUFFLE(1, 0, 3, 2)));
+        suma = _mm_add_epi32(suma, _mm_shuffle_epi32(suma, _MM_SHUFFLE(2, 3, 0, 1)));
+        total += _mm_cvtsi128_si32(suma);
+    }
+    return total + puntuar_ponderado_escalar(faltante, pixeles + i, pesos + 2 * i, num_pixeles - i);
+}
+
+// AVX2: gather de 8 palabras de 32 bits (el pixel queda en los 16 bits bajos),
+// extension de signo con desplazamientos y max(v, 0) antes de acumular
+__attribute__((target("avx2")))
+static int puntuar_avx2(const short *faltante, const int *pixeles, int num_pixeles) {
+    const __m256i cero = _mm256_setzero_si256();
+    __m256i suma = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= num_pixeles; i += 8) {
+        __m256i indices = _mm256_loadu_si256((const __m256i*)(pixeles + i));
+        __m256i v = _mm256_i32gather_epi32((const int*)faltante, indices, 2);
+        v = _mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16);
+        suma = _mm256_add_epi32(suma, _mm256_max_epi32(v, cero));
+    }
+    __m128i suma128 = _mm_add_epi32(_mm256_castsi256_si128(suma), _mm256_extracti128_si256(suma, 1));
+    suma128 = _mm_hadd_epi32(suma128, suma128);
+    suma128 = _mm_hadd_epi32(suma128, suma128);
+    return _mm_cvtsi128_si32(suma128) + puntuar_escalar(faltante, pixeles + i, num_pixeles - i);
+}
+
+// AVX2 ponderado: el mismo gather de 32 bits que la version sin pesos trae
+// ya la pareja entera, asi que cuesta un acceso por paso de la linea igual
+// que Bresenham; max de 16 bits y madd con los pesos ampliados la puntuan
+__attribute__((target("avx2")))
+static long long puntuar_ponderado_avx2(const short *faltante, const int *pixeles,
+                                        const unsigned char *pesos, int num_pixeles) {
+    const __m256i cero = _mm256_setzero_si256();
+    long long total = 0;
+    int i = 0;
+    while (i + 8 <= num_pixeles) {
+        int fin = (num_pixeles - i > PAREJAS_POR_BLOQUE) ? i + PAREJAS_POR_BLOQUE : num_pixeles;
+        __m256i suma = _mm256_setzero_si256();
+        for (; i + 8 <= fin; i += 8) {
+            __m256i indices = _mm256_loadu_si256((const __m256i*)(pixeles + i));
+            __m256i v = _mm256_i32gather_epi32((const int*)faltante, indices, 2);
+            v = _mm256_max_epi16(v, cero);
+            __m256i w = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(pesos + 2 * i)));
+            suma = _mm256_add_epi32(suma, _mm256_madd_epi16(v, w));
+        }
+        __m128i suma128 = _mm_add_epi32(_mm256_castsi256_si128(suma), _mm256_extracti128_si256(suma, 1));
+        suma128 = _mm_hadd_epi32(suma128, suma128);
+        suma128 = _mm_hadd_epi32(suma128, suma128);
+        total += _mm_cvtsi128_si32(suma128);
+    }
+    return total + puntuar_ponderado_escalar(faltante, pixeles + i, pesos + 2 * i, num_pixeles - i);
+}
+#endif
+
+// Nucleos usados por calcular_error_linea (se eligen una vez al arrancar)
+static NucleoPuntuacion nucleo_puntuacion = puntuar_escalar;
+static NucleoPonderado nucleo_ponderado = puntuar_ponderado_escalar;
+static const char *nombre_nucleo = "escalar";
+
+// Devuelve el nucleo con ese nombre si la CPU lo soporta ("auto" elige el
+// mejor disponible) y deja en 'ponderado' su variante ponderada. Devuelve
+// NULL si no existe o no esta soportado
+NucleoPuntuacion buscar_nucleo(const char *nombre, const char **nombre_elegido,
+                               NucleoPonderado *ponderado) {
+#ifdef HAY_SIMD_X86
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse2 = __builtin_cpu_supports("sse2");
+    if ((strcmp(nombre, "auto") == 0 && avx2) || (strcmp(nombre, "avx2") == 0 && avx2)) {
+        *nombre_elegido = "avx2";
+        *ponderado = puntuar_ponderado_avx2;
+        return puntuar_avx2;
+    }
+    if ((strcmp(nombre, "auto") == 0 && sse2) || (strcmp(nombre, "sse2") == 0 && sse2)) {
+        *nombre_elegido = "sse2";
+        *ponderado = puntuar_ponderado_sse2;
+        return puntuar_sse2;
+    }
+#endif
+    if (strcmp(nombre, "auto") == 0 || strcmp(nombre, "escalar") == 0) {
+        *nombre_elegido = "escalar";
+        *ponderado = puntuar_ponderado_escalar;
+        return puntuar_escalar;
+    }
+    return NULL;
+}
+
+// Selecciona el nucleo de puntuacion. Devuelve false si no esta disponible
+bool seleccionar_nucleo(const char *nombre) {
+    const char *elegido;
+    NucleoPonderado ponderado;
+    NucleoPuntuacion nucleo = buscar_nucleo(nombre, &elegido, &ponderado);
+    if (nucleo == NULL) return false;
+    nucleo_puntuacion = nucleo;
+    nucleo_ponderado = ponderado;
+    nombre_nucleo = elegido;
+    return true;
+}
+
+// Nombre del nucleo de puntuacion en uso
+const char* nucleo_seleccionado(void) {
+    return nombre_nucleo;
+}
+
+// Calcula el beneficio de un hilo a partir de sus pixeles cacheados
+// (con antialiasing, en unidades de PESO_MAXIMO_AA por pixel cubierto)
+double calcular_error_linea(Residuo *res, EntradaLinea *linea) {
+    if (linea->pesos != NULL) {
+        const short *plano = linea->transpuesta ? res->transpuesta : res->valores;
+        return nucleo_ponderado(plano, linea->pixeles, linea->pesos, linea->num_pixeles);
+    }
+    const short *plano = (linea->simetria != SIMETRIA_IDENTIDAD) ? res->simetricos[linea->simetria]
+                                                                 : res->valores;
+    return nucleo_puntuacion(plano, linea->pixeles, linea->num_pixeles);
+}
+
+// Calcula el beneficio de dibujar un hilo entre dos clavos
+// Mayor beneficio = mas oscuridad falta por cubrir en esa trayectoria
+// Suma a 'pixeles' los pixeles recorridos
+double calcular_error_hilo(Residuo *res, Punto *clavos, CacheLineas *cache,
+                           int clavo1, int clavo2, long long *pixeles) {
+    EntradaLinea *linea = (cache != NULL) ? obtener_linea(cache, clavo1, clavo2) : NULL;
+    if (linea != NULL) {
+        *pixeles += linea->num_pixeles;
+        double beneficio = calcular_error_linea(res, linea);
+        soltar_linea(cache, linea);
+        return beneficio;
+    }
+    if (cache != NULL) {
+        // La cache no tiene memoria: la misma linea, rasterizada en la pila
+        EntradaLinea temporal;
+        int desplazamientos[cache->max_pixeles];
+        unsigned char pesos[cache->antialias ? 2 * cache->max_pixeles : 1];
+        linea_sin_cache(cache, clavo1, clavo2, &temporal, desplazamientos, pesos);
+        *pixeles += temporal.num_pixeles;
+        return calcular_error_linea(res, &temporal);
+    }
+    
+    // Sin cache se traza igual que en ella, desde el clavo de menor indice
+    if (clavo2 < clavo1) {
+        int tmp = clavo1; clavo1 = clavo2; clavo2 = tmp;
+    }
+    int x1 = (int)round(clavos[clavo1].x);
+    int y1 = (int)round(clavos[clavo1].y);
+    int x2 = (int)round(clavos[clavo2].x);
+    int y2 = (int)round(clavos[clavo2].y);
+    
+    int dx = abs(x2 - x1);
+    int dy = abs(y2 - y1);
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+    int err = dx - dy;
+    
+    int x = x1;
+    int y = y1;
+    double beneficio_total = 0.0;
+    int max_iteraciones = (int)sqrt(res->ancho * res->ancho + res->alto * res->alto) + 10;
+    int iteraciones = 0;
+    
+    while (iteraciones < max_iteraciones) {
+        if (x >= 0 && x < res->ancho && y >= 0 && y < res->alto) {
+            int oscuridad_faltante = res->valores[(size_t)y * res->paso + x];
+            if (oscuridad_faltante > 0) {
+                beneficio_total += oscuridad_faltante;
+            }
+        }
+        
+        if (x == x2 && y == y2) break;
+        
+        int e2 = 2 * err;
+        
+        if (e2 > -dy) {
+            err -= dy;
+            x += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y += sy;
+        }
+        
+        iteraciones++;
+    }
+    
+    *pixeles += iteraciones + 1;
+    return beneficio_total;
+}
+
+// Calcula el error total entre dos imagenes (suma de diferencias al cuadrado)
+double calcular_error_total(Imagen *original, Imagen *actual) {
+    if (original->ancho != actual->ancho || original->alto != actual->alto) {
+        return -1.0;
+    }
+    
+    long long error_total = 0;
+    for (int i = 0; i < original->alto; i++) {
+        const unsigned char *fila_original = original->pixels + (size_t)i * original->paso;
+        const unsigned char *fila_actual = actual->pixels + (size_t)i * actual->paso;
+        long long error_fila = 0;
+        for (int j = 0; j < original->ancho; j++) {
+            int diff = (int)fila_original[j] - (int)fila_actual[j];
+            error_fila += diff * diff;
+        }
+        error_total += error_fila;
+    }
+    
+    return (double)error_total;
+}
+
+// Comprueba el error acumulado contra un recalculo completo de la imagen
+// Devuelve 1 si no coinciden (y lo informa por stderr), 0 si coinciden
+int verificar_error_acumulado(Imagen *original, Imagen *actual, long long error_acumulado) {
+    long long error_real = (long long)calcular_error_total(original, actual);
+    if (error_real != error_acumulado) {
+        fprintf(stderr, "Aviso: Error acumulado %lld distinto del recalculado %lld\n",
+                error_acumulado, error_real);
+        return 1;
+    }
+    return 0;
+}
+
+// Recalcula desde las imagenes los mosaicos que han cambiado desde la ultima
+// verificacion, los contrasta con las sumas mantenidas al dibujar y los
+// marca como limpios; contrasta tambien 'error_acumulado' con el total de los
+// mosaicos. Suma a 'revisados' los mosaicos recalculados
+// Devuelve el numero de discrepancias (informadas por stderr)
+int verificar_mosaicos(Residuo *res, Imagen *original, Imagen *actual, long long error_acumulado,
+                       long long *revisados) {
+    Mosaicos *m = res->mosaicos;
+    int discrepancias = 0;
+    for (int i = 0; i < m->num_sucios; i++) {
+        int k = m->sucios[i];
+        m->sucio[k] = 0;
+        int x0 = (k % m->columnas) * LADO_MOSAICO, y0 = (k / m->columnas) * LADO_MOSAICO;
+        int x1 = (x0 + LADO_MOSAICO < res->ancho) ? x0 + LADO_MOSAICO : res->ancho;
+        int y1 = (y0 + LADO_MOSAICO < res->alto) ? y0 + LADO_MOSAICO : res->alto;
+        long long error = 0, positivo = 0;
+        for (int y = y0; y < y1; y++) {
+            const unsigned char *fila_original = original->pixels + (size_t)y * original->paso;
+            const unsigned char *fila_actual = actual->pixels + (size_t)y * actual->paso;
+            for (int x = x0; x < x1; x++) {
+                int faltante = (int)fila_actual[x] - (int)fila_original[x];
+                error += faltante * faltante;
+                if (faltante > 0) positivo += faltante;
+            }
+        }
+        if (error != m->error[k] || positivo != m->positivo[k]) {
+            fprintf(stderr, "Aviso: Mosaico (%d, %d) con error %lld y oscuridad %lld, recalculados %lld y %lld\n",
+                    x0 / LADO_MOSAICO, y0 / LADO_MOSAICO, m->error[k], m->positivo[k], error, positivo);
+            discrepancias++;
+        }
+    }
+    *revisados += m->num_sucios;
+    m->num_sucios = 0;
+    long long total = error_mosaicos(m);
+    if (total != error_acumulado) {
+        fprintf(stderr, "Aviso: Error acumulado %lld distinto de la suma de los mosaicos %lld\n",
+                error_acumulado, total);
+        discrepancias++;
+    }
+    return discrepancias;
+}
+
+// Instante actual en segundos de un reloj monotono (tiempo real, no de CPU)
+double tiempo_actual(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Suma a 'fase' el tiempo transcurrido desde 'inicio' y devuelve el instante
+// actual, que sirve de inicio de la fase siguiente
+double medir_fase(Estadisticas *stats, Fase fase, double inicio) {
+    double ahora = tiempo_actual();
+    stats->tiempo_fase[fase] += ahora - inicio;
+    return ahora;
+}
+
+// Funcion de comparacion para qsort (ordena hilos por beneficio descendente)
+int comparar_hilos(const void *a, const void *b) {
+    Hilo *hilo_a = (Hilo*)a;
+    Hilo *hilo_b = (Hilo*)b;
+    
+    if (hilo_a->error > hilo_b->error) return -1;
+    if (hilo_a->error < hilo_b->error) return 1;
+    return 0;
+}
+
+// Semilla del flujo aleatorio independiente numero 'flujo' (mezcla splitmix)
+unsigned int semilla_flujo(unsigned int semilla, int flujo) {
+    unsigned long long z = semilla + (unsigned long long)(flujo + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (unsigned int)(z ^ (z >> 31));
+}
+
+// Siguiente valor de splitmix64 (solo para sembrar los generadores)
+static uint64_t splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t rotar64(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+// Paso de xoshiro256**: 64 bits nuevos
+static inline uint64_t xoshiro_siguiente(uint64_t *e) {
+    uint64_t resultado = rotar64(e[1] * 5, 7) * 9;
+    uint64_t t = e[1] << 17;
+    e[2] ^= e[0];
+    e[3] ^= e[1];
+    e[1] ^= e[2];
+    e[0] ^= e[3];
+    e[2] ^= t;
+    e[3] = rotar64(e[3], 45);
+    return resultado;
+}
+
+// Avanza xoshiro256** 2^128 pasos: cada flujo queda en un tramo disjunto
+static void xoshiro_saltar(uint64_t *e) {
+    static const uint64_t salto[4] = { 0x180EC6D33CFD0ABAULL, 0xD5A61266F0C9392CULL,
+                                       0xA9582618E03FC9AAULL, 0x39ABDC4529B1661CULL };
+    uint64_t nuevo[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (salto[i] & (1ULL << b)) {
+                for (int j = 0; j < 4; j++) nuevo[j] ^= e[j];
+            }
+            xoshiro_siguiente(e);
+        }
+    }
+    memcpy(e, nuevo, sizeof(nuevo));
+}
+
+// Paso de PCG32 (XSH-RR): 32 bits nuevos
+static inline uint32_t pcg_siguiente(uint64_t *e) {
+    uint64_t anterior = e[0];
+    e[0] = anterior * 6364136223846793005ULL + e[1];
+    uint32_t mezcla = (uint32_t)(((anterior >> 18) ^ anterior) >> 27);
+    uint32_t rotacion = (uint32_t)(anterior >> 59);
+    return (mezcla >> rotacion) | (mezcla << ((32 - rotacion) & 31));
+}
+
+// Prepara el flujo numero 'flujo' de la semilla dada. Dos flujos distintos
+// de la misma semilla no se solapan, asi que cada trabajador tiene el suyo
+void iniciar_generador(Generador *g, TipoGenerador tipo, unsigned int semilla, int flujo) {
+    uint64_t x = semilla;
+    g->tipo = tipo;
+    if (tipo == GENERADOR_PCG) {
+        g->estado[0] = 0;
+        g->estado[1] = ((uint64_t)flujo << 1) | 1;
+        pcg_siguiente(g->estado);
+        g->estado[0] += splitmix64(&x);
+        pcg_siguiente(g->estado);
+        g->estado[2] = g->estado[3] = 0;
+    } else {
+        for (int i = 0; i < 4; i++) g->estado[i] = splitmix64(&x);
+        for (int i = 0; i < flujo; i++) xoshiro_saltar(g->estado);
+    }
+}
+
+// Siguiente valor de 32 bits del generador
+static inline uint32_t generador_siguiente(Generador *g) {
+    if (g->tipo == GENERADOR_PCG) return pcg_siguiente(g->estado);
+    return (uint32_t)(xoshiro_siguiente(g->estado) >> 32);
+}
+
+// Entero uniforme en [0, limite) sin sesgo (multiplicacion de Lemire: se
+// rechazan los pocos valores que harian unos restos mas probables que otros)
+uint32_t generador_acotado(Generador *g, uint32_t limite) {
+    uint64_t m = (uint64_t)generador_siguiente(g) * limite;
+    uint32_t bajo = (uint32_t)m;
+    if (bajo < limite) {
+        uint32_t umbral = (uint32_t)(-limite) % limite;
+        while (bajo < umbral) {
+            m = (uint64_t)generador_siguiente(g) * limite;
+            bajo = (uint32_t)m;
+        }
+    }
+    return (uint32_t)(m >> 32);
+}
+
+// Rellena 'valores' con 'cantidad' valores de 32 bits (xoshiro aprovecha las
+// dos mitades de cada paso)
+static void generador_bloque(Generador *g, uint32_t *valores, int cantidad) {
+    int i = 0;
+    if (g->tipo == GENERADOR_PCG) {
+        for (; i < cantidad; i++) valores[i] = pcg_siguiente(g->estado);
+        return;
+    }
+    for (; i + 1 < cantidad; i += 2) {
+        uint64_t v = xoshiro_siguiente(g->estado);
+        valores[i] = (uint32_t)(v >> 32);
+        valores[i + 1] = (uint32_t)v;
+    }
+    if (i < cantidad) valores[i] = (uint32_t)(xoshiro_siguiente(g->estado) >> 32);
+}
+
+// Pares de clavos generados de una vez en generar_pares_clavos
+#define PARES_POR_BLOQUE 256
+
+// Genera 'num_pares' pares (clavo1, clavo2) distintos, uniformes entre los
+// n*(n-1) pares ordenados, en 'pares' (clavo1 en 2*i y clavo2 en 2*i+1).
+// Los valores en bruto salen en bloque y se acotan con un bucle sin saltos que
+// el compilador puede vectorizar; solo los rechazos (probabilidad < n/2^32)
+// se repiten uno a uno. clavo2 se toma entre los n-1 restantes, sin reintentos
+void generar_pares_clavos(Generador *g, int *pares, int num_pares, int n) {
+    const uint32_t limites[2] = { (uint32_t)n, (uint32_t)(n - 1) };
+    const uint32_t umbrales[2] = { (uint32_t)(-limites[0]) % limites[0],
+                                   (uint32_t)(-limites[1]) % limites[1] };
+    uint32_t brutos[2 * PARES_POR_BLOQUE];
+    
+    for (int base = 0; base < num_pares; base += PARES_POR_BLOQUE) {
+        int cuantos = num_pares - base;
+        if (cuantos > PARES_POR_BLOQUE) cuantos = PARES_POR_BLOQUE;
+        int *destino = pares + 2 * base;
+        generador_bloque(g, brutos, 2 * cuantos);
+        
+        int rechazos = 0;
+        for (int i = 0; i < 2 * cuantos; i++) {
+            uint64_t m = (uint64_t)brutos[i] * limites[i & 1];
+            destino[i] = (int)(m >> 32);
+            rechazos += (uint32_t)m < umbrales[i & 1];
+        }
+        if (rechazos > 0) {
+            for (int i = 0; i < 2 * cuantos; i++) {
+                uint64_t m = (uint64_t)brutos[i] * limites[i & 1];
+                if ((uint32_t)m < umbrales[i & 1]) {
+                    destino[i] = (int)generador_acotado(g, limites[i & 1]);
+                }
+            }
+        }
+        for (int i = 0; i < cuantos; i++) {
+            destino[2 * i + 1] += destino[2 * i + 1] >= destino[2 * i];
+        }
+    }
+}
+
+// Selecciona p hilos candidatos aleatorios y calcula su beneficio
+// 'generador' es el flujo aleatorio propio de quien llama, y 'stats' sus
+// contadores (tiempos de muestreo y puntuacion, lineas y pixeles)
+void seleccionar_hilos_candidatos(Hilo *candidatos, int p, int n, Punto *clavos, CacheLineas *cache,
+                                  Residuo *res, Generador *generador, Estadisticas *stats) {
+    int pares[2 * PARES_POR_BLOQUE];
+    double t = tiempo_actual();
+    
+    for (int base = 0; base < p; base += PARES_POR_BLOQUE) {
+        int cuantos = p - base;
+        if (cuantos > PARES_POR_BLOQUE) cuantos = PARES_POR_BLOQUE;
+        generar_pares_clavos(generador, pares, cuantos, n);
+        t = medir_fase(stats, FASE_MUESTREO, t);
+        
+        for (int i = 0; i < cuantos; i++) {
+            Hilo *candidato = &candidatos[base + i];
+            candidato->clavo1 = pares[2 * i];
+            candidato->clavo2 = pares[2 * i + 1];
+            candidato->error = calcular_error_hilo(res, clavos, cache, candidato->clavo1,
+                                                   candidato->clavo2, &stats->pixeles_visitados);
+            candidato->puntuacion = candidato->error;
+        }
+        t = medir_fase(stats, FASE_PUNTUACION, t);
+    }
+    stats->lineas_puntuadas += p;
+}
+
+typedef struct PoolTrabajo PoolTrabajo;
+void liberar_pool(PoolTrabajo *pool);
+
+// Hilo de ejecucion del pool con su propio flujo aleatorio
+typedef struct {
+    PoolTrabajo *pool;
+    int id;
+    Generador generador;
+    Estadisticas stats;   // Contadores de la ronda en curso
+    pthread_t hilo;
+} Trabajador;
+
+// Pool de trabajadores que reparte los p candidatos de cada iteracion
+// El trabajador i evalua siempre el mismo tramo, asi que el resultado solo
+// depende de la semilla y del numero de trabajadores
+struct PoolTrabajo {
+    int num_trabajadores;
+    Trabajador *trabajadores;
+    pthread_mutex_t cerrojo;
+    pthread_cond_t hay_trabajo;
+    pthread_cond_t trabajo_hecho;
+    long ronda;       // Se incrementa con cada reparto
+    int pendientes;   // Trabajadores que aun no han terminado la ronda
+    bool terminar;
+    
+    // Trabajo de la ronda actual
+    Hilo *candidatos;
+    int p, n;
+    Punto *clavos;
+    CacheLineas *cache;
+    Residuo *res;
+};
+
+// Bucle de cada trabajador: espera una ronda, evalua su tramo y avisa
+static void* bucle_trabajador(void *arg) {
+    Trabajador *t = (Trabajador*)arg;
+    PoolTrabajo *pool = t->pool;
+    long ronda_vista = 0;
+    
+    while (true) {
+        pthread_mutex_lock(&pool->cerrojo);
+        while (!pool->terminar && pool->ronda == ronda_vista) {
+            pthread_cond_wait(&pool->hay_trabajo, &pool->cerrojo);
+        }
+        if (pool->terminar) {
+            pthread_mutex_unlock(&pool->cerrojo);
+            break;
+        }
+        ronda_vista = pool->ronda;
+        pthread_mutex_unlock(&pool->cerrojo);
+        
+        int inicio = (int)((long)pool->p * t->id / pool->num_trabajadores);
+        int fin = (int)((long)pool->p * (t->id + 1) / pool->num_trabajadores);
+        seleccionar_hilos_candidatos(pool->candidatos + inicio, fin - inicio, pool->n, pool->clavos,
+                                     pool->cache, pool->res, &t->generador, &t->stats);
+        
+        pthread_mutex_lock(&pool->cerrojo);
+        pool->pendientes--;
+        if (pool->pendientes == 0) {
+            pthread_cond_signal(&pool->trabajo_hecho);
+        }
+        pthread_mutex_unlock(&pool->cerrojo);
+    }
+    
+    return NULL;
+}
+
+// Crea un pool de 'num_trabajadores' hilos de ejecucion
+PoolTrabajo* crear_pool(int num_trabajadores, unsigned int semilla, TipoGenerador tipo) {
+    PoolTrabajo *pool = (PoolTrabajo*)malloc(sizeof(PoolTrabajo));
+    if (pool == NULL) return NULL;
+    
+    pool->trabajadores = (Trabajador*)malloc(num_trabajadores * sizeof(Trabajador));
+    if (pool->trabajadores == NULL) {
+        free(pool);
+        return NULL;
+    }
+    
+    pool->num_trabajadores = 0;
+    pool->ronda = 0;
+    pool->pendientes = 0;
+    pool->terminar = false;
+    pthread_mutex_init(&pool->cerrojo, NULL);
+    pthread_cond_init(&pool->hay_trabajo, NULL);
+    pthread_cond_init(&pool->trabajo_hecho, NULL);
+    
+    for (int i = 0; i < num_trabajadores; i++) {
+        Trabajador *t = &pool->trabajadores[i];
+        t->pool = pool;
+        t->id = i;
+        iniciar_generador(&t->generador, tipo, semilla, i);
+        memset(&t->stats, 0, sizeof(t->stats));
+        if (pthread_create(&t->hilo, NULL, bucle_trabajador, t) != 0) {
+            break;
+        }
+        pool->num_trabajadores++;
+    }
+    
+    if (pool->num_trabajadores == 0) {
+        liberar_pool(pool);
+        return NULL;
+    }
+    if (pool->num_trabajadores < num_trabajadores) {
+        fprintf(stderr, "Aviso: Solo se pudieron crear %d de %d trabajadores\n",
+                pool->num_trabajadores, num_trabajadores);
+    }
+    
+    return pool;
+}
+
+// Reparte la evaluacion de p candidatos entre los trabajadores y espera
+// Los trabajadores miden en paralelo, asi que el tiempo de la ronda se reparte
+// entre muestreo y puntuacion en la proporcion que han medido entre todos
+void evaluar_candidatos_pool(PoolTrabajo *pool, Hilo *candidatos, int p, int n, Punto *clavos,
+                             CacheLineas *cache, Residuo *res, Estadisticas *stats) {
+    double inicio = tiempo_actual();
+    pthread_mutex_lock(&pool->cerrojo);
+    pool->candidatos = candidatos;
+    pool->p = p;
+    pool->n = n;
+    pool->clavos = clavos;
+    pool->cache = cache;
+    pool->res = res;
+    pool->pendientes = pool->num_trabajadores;
+    pool->ronda++;
+    pthread_cond_broadcast(&pool->hay_trabajo);
+    while (pool->pendientes > 0) {
+        pthread_cond_wait(&pool->trabajo_hecho, &pool->cerrojo);
+    }
+    pthread_mutex_unlock(&pool->cerrojo);
+    
+    double muestreo = 0.0, puntuacion = 0.0;
+    for (int i = 0; i < pool->num_trabajadores; i++) {
+        Estadisticas *ronda = &pool->trabajadores[i].stats;
+        muestreo += ronda->tiempo_fase[FASE_MUESTREO];
+        puntuacion += ronda->tiempo_fase[FASE_PUNTUACION];
+        stats->lineas_puntuadas += ronda->lineas_puntuadas;
+        stats->pixeles_visitados += ronda->pixeles_visitados;
+        memset(ronda, 0, sizeof(*ronda));
+    }
+    double transcurrido = tiempo_actual() - inicio;
+    double medido = muestreo + puntuacion;
+    double parte_muestreo = (medido > 0) ? transcurrido * muestreo / medido : 0.0;
+    stats->tiempo_fase[FASE_MUESTREO] += parte_muestreo;
+    stats->tiempo_fase[FASE_PUNTUACION] += transcurrido - parte_muestreo;
+}
+
+// Detiene los trabajadores y libera el pool
+void liberar_pool(PoolTrabajo *pool) {
+    if (pool == NULL) return;
+    
+    pthread_mutex_lock(&pool->cerrojo);
+    pool->terminar = true;
+    pthread_cond_broadcast(&pool->hay_trabajo);
+    pthread_mutex_unlock(&pool->cerrojo);
+    
+    for (int i = 0; i < pool->num_trabajadores; i++) {
+        pthread_join(pool->trabajadores[i].hilo, NULL);
+    }
+    
+    pthread_mutex_destroy(&pool->cerrojo);
+    pthread_cond_destroy(&pool->hay_trabajo);
+    pthread_cond_destroy(&pool->trabajo_hecho);
+    free(pool->trabajadores);
+    free(pool);
+}
+
+// Indice inverso para el modo continuo: beneficio actual de todas las lineas
+// y, para cada pixel, las lineas que lo atraviesan (formato CSR). Al dibujar
+// un hilo solo se corrigen las lineas que cruzan pixeles cuyo beneficio cambia
+typedef struct {
+    int n;
+    long num_lineas;
+    int *puntuaciones;        // Beneficio de cada linea, indexado por indice_par
+    size_t *inicio;           // Lineas del pixel d: lineas[inicio[d] .. inicio[d + 1])
+    int *lineas;
+    size_t memoria;           // Bytes ocupados por el indice
+    size_t num_entradas;      // Pixeles de todas las lineas (tamano de 'lineas')
+    
+    // Registro opcional de lineas cuyo beneficio ha cambiado desde la ultima
+    // consulta (solo si 'sucias' no es NULL)
+    unsigned char *es_sucia;
+    int *sucias;
+    int num_sucias;
+} IndiceInverso;
+
+// Construye el indice inverso y puntua todas las lineas sobre 'res'
+// Devuelve NULL si no hay memoria o el indice no cabe en 'memoria_maxima'
+IndiceInverso* crear_indice_inverso(CacheLineas *cache, Residuo *res, size_t memoria_maxima) {
+    int n = cache->n;
+    size_t num_pixeles = (size_t)res->paso * res->alto;
+    IndiceInverso *indice = (IndiceInverso*)malloc(sizeof(IndiceInverso));
+    if (indice == NULL) return NULL;
+    
+    indice->n = n;
+    indice->num_lineas = (long)n * (n - 1) / 2;
+    indice->lineas = NULL;
+    indice->es_sucia = NULL;
+    indice->sucias = NULL;
+    indice->num_sucias = 0;
+    indice->puntuaciones = (int*)malloc(indice->num_lineas * sizeof(int));
+    indice->inicio = (size_t*)calloc(num_pixeles + 1, sizeof(size_t));
+    if (indice->puntuaciones == NULL || indice->inicio == NULL) {
+        free(indice->puntuaciones);
+        free(indice->inicio);
+        free(indice);
+        return NULL;
+    }
+    
+    // Primera pasada: puntuar cada linea y contar cuantas cruzan cada pixel
+    for (int a = 0; a < n; a++) {
+        for (int b = a + 1; b < n; b++) {
+            EntradaLinea *linea = obtener_linea(cache, a, b);
+            if (linea == NULL) goto sin_memoria;
+            indice->puntuaciones[indice_par(n, a, b)] = (int)calcular_error_linea(res, linea);
+            for (int i = 0; i < linea->num_pixeles; i++) {
+                indice->inicio[pixel_linea(linea, i, res->ancho, res->alto, res->paso) + 1]++;
+            }
+            soltar_linea(cache, linea);
+        }
+    }
+    for (size_t d = 0; d < num_pixeles; d++) {
+        indice->inicio[d + 1] += indice->inicio[d];
+    }
+    
+    size_t total = indice->inicio[num_pixeles];
+    indice->num_entradas = total;
+    indice->memoria = indice->num_lineas * sizeof(int) + (num_pixeles + 1) * sizeof(size_t)
+                      + total * sizeof(int);
+    if (indice->memoria > memoria_maxima) {
+        fprintf(stderr, "Error: El indice inverso necesita %.1f MB (limite %.1f MB)\n",
+                indice->memoria / (1024.0 * 1024.0), memoria_maxima / (1024.0 * 1024.0));
+        goto liberar;
+    }
+    
+    indice->lineas = (int*)malloc((total > 0 ? total : 1) * sizeof(int));
+    if (indice->lineas == NULL) goto sin_memoria;
+    
+    // Segunda pasada: rellenar las listas usando 'inicio' como cursor
+    for (int a = 0; a < n; a++) {
+        for (int b = a + 1; b < n; b++) {
+            EntradaLinea *linea = obtener_linea(cache, a, b);
+            if (linea == NULL) goto sin_memoria;
+            int id = (int)indice_par(n, a, b);
+            for (int i = 0; i < linea->num_pixeles; i++) {
+                indice->lineas[indice->inicio[pixel_linea(linea, i, res->ancho, res->alto, res->paso)]++] = id;
+            }
+            soltar_linea(cache, linea);
+        }
+    }
+    // Cada cursor avanzo hasta el inicio del pixel siguiente: se desplazan
+    for (size_t d = num_pixeles; d > 0; d--) {
+        indice->inicio[d] = indice->inicio[d - 1];
+    }
+    indice->inicio[0] = 0;
+    
+    return indice;
+    
+sin_memoria:
+    fprintf(stderr, "Error: No se pudo asignar memoria para el indice inverso\n");
+liberar:
+    free(indice->lineas);
+    free(indice->puntuaciones);
+    free(indice->inicio);
+    free(indice);
+    return NULL;
+}
+
+// Activa el registro de lineas sucias. Devuelve false si no hay memoria
+bool registrar_lineas_sucias(IndiceInverso *indice) {
+    indice->es_sucia = (unsigned char*)calloc(indice->num_lineas, 1);
+    indice->sucias = (int*)malloc(indice->num_lineas * sizeof(int));
+    indice->num_sucias = 0;
+    if (indice->es_sucia == NULL || indice->sucias == NULL) {
+        free(indice->es_sucia);
+        free(indice->sucias);
+        indice->es_sucia = NULL;
+        indice->sucias = NULL;
+        return false;
+    }
+    indice->memoria += indice->num_lineas * (1 + sizeof(int));
+    return true;
+}
+
+// Libera el indice inverso
+void liberar_indice_inverso(IndiceInverso *indice) {
+    if (indice == NULL) return;
+    free(indice->es_sucia);
+    free(indice->sucias);
+    free(indice->lineas);
+    free(indice->puntuaciones);
+    free(indice->inicio);
+    free(indice);
+}
+
+// Dibuja una linea cacheada y corrige el beneficio de todas las lineas que
+// cruzan los pixeles cuya oscuridad faltante positiva ha cambiado
+// Devuelve cuantas puntuaciones se han actualizado
+long long dibujar_linea_indexada(IndiceInverso *indice, Imagen *img, Residuo *res,
+                                 EntradaLinea *linea, unsigned char valor, long long *error) {
+    long long actualizaciones = 0;
+    for (int i = 0; i < linea->num_pixeles; i++) {
+        size_t d = pixel_linea(linea, i, res->ancho, res->alto, res->paso);
+        int antes = res->valores[d];
+        oscurecer_pixel(img, res, d, valor, error);
+        int despues = res->valores[d];
+        int delta = (despues > 0 ? despues : 0) - (antes > 0 ? antes : 0);
+        if (delta == 0) continue;
+        for (size_t k = indice->inicio[d]; k < indice->inicio[d + 1]; k++) {
+            indice->puntuaciones[indice->lineas[k]] += delta;
+        }
+        if (indice->sucias != NULL) {
+            for (size_t k = indice->inicio[d]; k < indice->inicio[d + 1]; k++) {
+                int l = indice->lineas[k];
+                if (!indice->es_sucia[l]) {
+                    indice->es_sucia[l] = 1;
+                    indice->sucias[indice->num_sucias++] = l;
+                }
+            }
+        }
+        actualizaciones += indice->inicio[d + 1] - indice->inicio[d];
+    }
+    return actualizaciones;
+}
+
+// Monticulo binario de maximos indexado sobre las lineas: guarda en que
+// posicion esta cada linea para poder reajustar su clave en O(log N)
+typedef struct {
+    int *elementos;       // Lineas en orden de monticulo
+    int *posicion;        // Posicion de cada linea en 'elementos' (-1 si no esta)
+    int tam;
+    const int *claves;    // Beneficio de cada linea (IndiceInverso.puntuaciones)
+} Monticulo;
+
+// true si la linea a debe ir por encima de la b (desempata el menor indice)
+static inline bool monticulo_antes(const Monticulo *m, int a, int b) {
+    return m->claves[a] > m->claves[b] || (m->claves[a] == m->claves[b] && a < b);
+}
+
+static void monticulo_colocar(Monticulo *m, int i, int linea) {
+    m->elementos[i] = linea;
+    m->posicion[linea] = i;
+}
+
+static void monticulo_subir(Monticulo *m, int i) {
+    int linea = m->elementos[i];
+    while (i > 0) {
+        int padre = (i - 1) / 2;
+        if (!monticulo_antes(m, linea, m->elementos[padre])) break;
+        monticulo_colocar(m, i, m->elementos[padre]);
+        i = padre;
+    }
+    monticulo_colocar(m, i, linea);
+}
+
+static void monticulo_bajar(Monticulo *m, int i) {
+    int linea = m->elementos[i];
+    while (true) {
+        int hijo = 2 * i + 1;
+        if (hijo >= m->tam) break;
+        if (hijo + 1 < m->tam && monticulo_antes(m, m->elementos[hijo + 1], m->elementos[hijo])) hijo++;
+        if (!monticulo_antes(m, m->elementos[hijo], linea)) break;
+        monticulo_colocar(m, i, m->elementos[hijo]);
+        i = hijo;
+    }
+    monticulo_colocar(m, i, linea);
+}
+
+// Crea el monticulo con todas las lineas (construccion en O(N))
+Monticulo* crear_monticulo(const int *claves, int num_lineas) {
+    Monticulo *m = (Monticulo*)malloc(sizeof(Monticulo));
+    if (m == NULL) return NULL;
+    m->elementos = (int*)malloc(num_lineas * sizeof(int));
+    m->posicion = (int*)malloc(num_lineas * sizeof(int));
+    if (m->elementos == NULL || m->posicion == NULL) {
+        free(m->elementos);
+        free(m->posicion);
+        free(m);
+        return NULL;
+    }
+    m->claves = claves;
+    m->tam = num_lineas;
+    for (int i = 0; i < num_lineas; i++) {
+        monticulo_colocar(m, i, i);
+    }
+    for (int i = num_lineas / 2 - 1; i >= 0; i--) {
+        monticulo_bajar(m, i);
+    }
+    return m;
+}
+
+// Extrae la linea de mayor beneficio
+int monticulo_extraer(Monticulo *m) {
+    int cima = m->elementos[0];
+    m->posicion[cima] = -1;
+    m->tam--;
+    if (m->tam > 0) {
+        monticulo_colocar(m, 0, m->elementos[m->tam]);
+        monticulo_bajar(m, 0);
+    }
+    return cima;
+}
+
+// Inserta una linea que no estaba en el monticulo
+void monticulo_insertar(Monticulo *m, int linea) {
+    monticulo_colocar(m, m->tam, linea);
+    m->tam++;
+    monticulo_subir(m, m->tam - 1);
+}
+
+// Recoloca una linea del monticulo tras cambiar su clave
+void monticulo_reajustar(Monticulo *m, int linea) {
+    int i = m->posicion[linea];
+    if (i < 0) return;
+    monticulo_subir(m, i);
+    monticulo_bajar(m, m->posicion[linea]);
+}
+
+void liberar_monticulo(Monticulo *m) {
+    if (m == NULL) return;
+    free(m->elementos);
+    free(m->posicion);
+    free(m);
+}
+
+// Extremos (clavo1 < clavo2) de la linea con indice_par 'id'
+static void clavos_de_linea(int n, long id, int *clavo1, int *clavo2) {
+    int a = 0;
+    long primero = 0;  // indice_par(n, a, a + 1)
+    while (primero + (n - a - 1) <= id) {
+        primero += n - a - 1;
+        a++;
+    }
+    *clavo1 = a;
+    *clavo2 = a + 1 + (int)(id - primero);
+}
+
+// Estado de un contexto de resolucion
+typedef enum {
+    CONTEXTO_SIN_EMPEZAR,   // Aun no se ha dado ningun paso
+    CONTEXTO_EN_CURSO,      // La estrategia tiene su estado preparado
+    CONTEXTO_TERMINADO      // La estrategia se detuvo y libero su estado
+} EstadoContexto;
+
+// Resolucion de una imagen: sus recursos (clavos, cache de lineas, imagen
+// resultado y secuencia) y el estado de la estrategia entre dos llamadas a
+// resolver_paso
+struct ContextoHilos {
+    Parametros params;
+    Imagen *original;          // Imagen de entrada (de quien llama)
+    Imagen *resultado;
+    Punto *clavos;
+    CacheLineas *cache;
+    bool recursos_propios;     // Los clavos y la cache los ha creado el contexto
+    Arena arena;               // Memoria de los clavos propios
+    SecuenciaHilos *secuencia;
+    Estadisticas stats;
+    
+    FuncionProgreso progreso;  // NULL si nadie sigue el progreso
+    void *datos_progreso;
+    pthread_mutex_t cerrojo;   // Protege 'cancelado' (se cancela desde otros hilos)
+    bool cancelado;
+    double inicio;             // Instante del primer paso
+    
+    EstadoContexto estado;
+    MotivoParada motivo;       // Motivo de la parada definitiva
+    
+    // Estado comun de las estrategias
+    Residuo *res;
+    long long error_actual, error_anterior;
+    int sin_mejora;            // Iteraciones (hilos en el modo continuo) sin mejora
+    int discrepancias;         // Encontradas por las verificaciones del error
+    
+    // Modo muestreo
+    Arena arena_algoritmo;     // Candidatos y clavos del nivel grueso
+    Hilo *candidatos;
+    Punto *clavos_gruesos;
+    CacheLineas *cache_gruesa;
+    PoolTrabajo *pool;         // NULL con un solo trabajador
+    Generador generador;       // Flujo del hilo principal (sin pool)
+    int num_refinar;
+    
+    // Modos continuo y monticulo
+    IndiceInverso *indice;
+    Monticulo *monticulo;
+    int *extraidas;            // Lineas extraidas del monticulo en la iteracion
+    int clavo_actual;          // Extremo del hilo continuo
+    long long reajustes;
+};
+
+// Nombre de cada motivo de parada (para las estadisticas)
+static const char *nombres_paradas[NUM_PARADAS] = {
+    "ninguna", "limite", "sin_mejora", "sin_hilos_utiles", "sin_oscuridad", "cancelada", "plazo", "error"
+};
+
+// Pide que la resolucion de 'ctx' se detenga al terminar la iteracion en
+// curso. Se puede llamar desde cualquier hilo
+void cancelar_contexto(ContextoHilos *ctx) {
+    pthread_mutex_lock(&ctx->cerrojo);
+    ctx->cancelado = true;
+    pthread_mutex_unlock(&ctx->cerrojo);
+}
+
+// Indica si se ha pedido cancelar la resolucion
+static bool contexto_cancelado(ContextoHilos *ctx) {
+    pthread_mutex_lock(&ctx->cerrojo);
+    bool cancelado = ctx->cancelado;
+    pthread_mutex_unlock(&ctx->cerrojo);
+    return cancelado;
+}
+
+// Entrega a la funcion de progreso el estado actual y 'mensaje' (NULL en el
+// aviso de fin de iteracion); si devuelve false se cancela la resolucion
+static void avisar_progreso(ContextoHilos *ctx, const char *mensaje) {
+    if (ctx->progreso == NULL) return;
+    ProgresoHilos progreso;
+    progreso.hilos = ctx->secuencia->num_hilos;
+    progreso.error = (double)ctx->error_actual;
+    progreso.segundos = tiempo_actual() - ctx->inicio;
+    progreso.mensaje = mensaje;
+    if (!ctx->progreso(&progreso, ctx->datos_progreso)) {
+        cancelar_contexto(ctx);
+    }
+}
+
+// printf para los mensajes de progreso de las estrategias: el texto se
+// entrega a la funcion de progreso (y se omite si no hay ninguna)
+static void informar(ContextoHilos *ctx, const char *formato, ...) {
+    if (ctx->progreso == NULL) return;
+    char mensaje[256];
+    va_list args;
+    va_start(args, formato);
+    vsnprintf(mensaje, sizeof(mensaje), formato, args);
+    va_end(args);
+    avisar_progreso(ctx, mensaje);
+}
+
+// Prepara el modo muestreo: candidatos, nivel grueso y pool de trabajadores
+static bool iniciar_voraz(ContextoHilos *ctx) {
+    Parametros *params = &ctx->params;
+    Residuo *res = ctx->res;
+    
+    ctx->candidatos = (Hilo*)arena_reservar(&ctx->arena_algoritmo, params->p * sizeof(Hilo));
+    if (ctx->candidatos == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para candidatos\n");
+        return false;
+    }
+    
+    // Multirresolucion: los p candidatos se puntuan sobre el nivel grueso con
+    // clavos y cache propios, y solo los 'refinar' mejores se repuntuan sobre
+    // el plano completo antes de elegir los s que se dibujan
+    if (params->escala > 1) {
+        ctx->clavos_gruesos = (Punto*)arena_reservar(&ctx->arena_algoritmo, params->n * sizeof(Punto));
+        bool correcto = ctx->clavos_gruesos != NULL && crear_nivel_grueso(res, params->escala);
+        if (correcto) {
+            for (int i = 0; i < params->n; i++) {
+                ctx->clavos_gruesos[i].x = (int)round(ctx->clavos[i].x) / params->escala;
+                ctx->clavos_gruesos[i].y = (int)round(ctx->clavos[i].y) / params->escala;
+            }
+            // La cache del nivel grueso no descuenta nada de la de -c: la
+            // memoria total de lineas es c * (1 + 1/e)
+            if (ctx->cache != NULL) {
+                ctx->cache_gruesa = crear_cache_lineas(ctx->clavos_gruesos, params->n, res->grueso->ancho,
+                                                       res->grueso->alto, res->grueso->paso,
+                                                       ctx->cache->memoria_maxima / params->escala,
+                                                       false, false);
+                correcto = ctx->cache_gruesa != NULL;
+            }
+        }
+        if (!correcto) {
+            fprintf(stderr, "Error: No se pudo asignar memoria para el nivel grueso\n");
+            return false;
+        }
+        informar(ctx, "Multirresolucion: nivel grueso %d x %d (factor %d), refinando %d candidatos\n",
+                 res->grueso->ancho, res->grueso->alto, params->escala, params->refinar);
+    }
+    ctx->num_refinar = (params->refinar < params->p) ? params->refinar : params->p;
+    
+    // Con un solo trabajador se evalua en el hilo principal usando el
+    // mismo flujo aleatorio que tendria el trabajador 0 del pool
+    iniciar_generador(&ctx->generador, params->generador, params->semilla, 0);
+    if (params->trabajadores > 1) {
+        ctx->pool = crear_pool(params->trabajadores, params->semilla, params->generador);
+        if (ctx->pool == NULL) {
+            fprintf(stderr, "Error: No se pudo crear el pool de trabajadores\n");
+            return false;
+        }
+    }
+    
+    informar(ctx, "Iniciando algoritmo voraz...\n");
+    informar(ctx, "Error inicial: %.2f\n", (double)ctx->error_actual);
+    return true;
+}
+
+// Una iteracion del modo muestreo: selecciona los s mejores hilos de p
+// candidatos aleatorios (como mucho 'restantes') y los dibuja
+static MotivoParada iteracion_voraz(ContextoHilos *ctx, int restantes) {
+    Parametros *params = &ctx->params;
+    Estadisticas *stats = &ctx->stats;
+    SecuenciaHilos *secuencia = ctx->secuencia;
+    Residuo *res = ctx->res;
+    Hilo *candidatos = ctx->candidatos;
+    Residuo *res_evaluacion = (res->grueso != NULL) ? res->grueso : res;
+    Punto *clavos_evaluacion = (ctx->clavos_gruesos != NULL) ? ctx->clavos_gruesos : ctx->clavos;
+    CacheLineas *cache_evaluacion = (ctx->clavos_gruesos != NULL) ? ctx->cache_gruesa : ctx->cache;
+    const int max_iteraciones_sin_mejora = 20;
+    
+    double inicio_evaluacion = tiempo_actual();
+    if (ctx->pool != NULL) {
+        evaluar_candidatos_pool(ctx->pool, candidatos, params->p, params->n, clavos_evaluacion,
+                                cache_evaluacion, res_evaluacion, stats);
+    } else {
+        seleccionar_hilos_candidatos(candidatos, params->p, params->n, clavos_evaluacion,
+                                     cache_evaluacion, res_evaluacion, &ctx->generador, stats);
+    }
+    stats->candidatos_evaluados += params->p;
+    
+    double t = tiempo_actual();
+    qsort(candidatos, params->p, sizeof(Hilo), comparar_hilos);
+    t = medir_fase(stats, FASE_ORDENACION, t);
+    
+    if (res->grueso != NULL) {
+        for (int i = 0; i < ctx->num_refinar; i++) {
+            candidatos[i].error = calcular_error_hilo(res, ctx->clavos, ctx->cache, candidatos[i].clavo1,
+                                                      candidatos[i].clavo2, &stats->pixeles_visitados);
+            candidatos[i].puntuacion = candidatos[i].error;
+        }
+        stats->lineas_puntuadas += ctx->num_refinar;
+        t = medir_fase(stats, FASE_PUNTUACION, t);
+        qsort(candidatos, ctx->num_refinar, sizeof(Hilo), comparar_hilos);
+        t = medir_fase(stats, FASE_ORDENACION, t);
+        stats->candidatos_refinados += ctx->num_refinar;
+    }
+    stats->tiempo_evaluacion += t - inicio_evaluacion;
+    
+    int hilos_a_dibujar = (params->s < params->p) ? params->s : params->p;
+    if (hilos_a_dibujar > restantes) hilos_a_dibujar = restantes;
+    if (!reservar_hilos(secuencia, hilos_a_dibujar)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la secuencia de hilos\n");
+        return PARADA_ERROR;
+    }
+    
+    bool mejora_encontrada = false;
+    
+    for (int i = 0; i < hilos_a_dibujar; i++) {
+        int clavo1 = candidatos[i].clavo1;
+        int clavo2 = candidatos[i].clavo2;
+    
+        dibujar_hilo(ctx->resultado, res, ctx->clavos, ctx->cache, clavo1, clavo2, 5, &ctx->error_actual);
+    
+        anadir_hilo(secuencia, clavo1, clavo2);
+    
+        mejora_encontrada = true;
+    }
+    medir_fase(stats, FASE_DIBUJO, t);
+    
+    // El error se compara en las 5 primeras iteraciones y despues cada 30
+    // (leerlo es O(1); lo que marca la parada es el espaciado)
+    int num_iteraciones = secuencia->num_hilos / params->s;
+    if (num_iteraciones % 30 == 0 || num_iteraciones < 5) {
+        if (ctx->error_actual < ctx->error_anterior) {
+            ctx->error_anterior = ctx->error_actual;
+            ctx->sin_mejora = 0;
+        } else {
+            ctx->sin_mejora++;
+        }
+    }
+    
+    if (ctx->sin_mejora >= max_iteraciones_sin_mejora) {
+        informar(ctx, "Parada: No hay mejora en %d iteraciones\n", max_iteraciones_sin_mejora);
+        return PARADA_SIN_MEJORA;
+    }
+    
+    if (!mejora_encontrada) {
+        informar(ctx, "Parada: No se encontraron hilos utiles\n");
+        return PARADA_SIN_HILOS_UTILES;
+    }
+    
+    // Sin oscuridad faltante positiva ningun hilo tiene beneficio: no hace
+    // falta esperar a que pasen las iteraciones sin mejora
+    if (res->mosaicos->con_oscuridad == 0) {
+        informar(ctx, "Parada: No queda oscuridad por cubrir\n");
+        return PARADA_SIN_OSCURIDAD;
+    }
+    return PARADA_NINGUNA;
+}
+
+// Prepara el modo continuo: indice inverso con el beneficio de todas las
+// lineas y clavo de partida (extremo de la mejor linea de toda la imagen)
+static bool iniciar_continuo(ContextoHilos *ctx) {
+    Parametros *params = &ctx->params;
+    Estadisticas *stats = &ctx->stats;
+    
+    informar(ctx, "Construyendo indice inverso de %ld lineas...\n", (long)params->n * (params->n - 1) / 2);
+    double inicio_indice = tiempo_actual();
+    ctx->indice = crear_indice_inverso(ctx->cache, ctx->res, (size_t)params->memoria_cache_mb * 1024 * 1024);
+    if (ctx->indice == NULL) {
+        return false;
+    }
+    IndiceInverso *indice = ctx->indice;
+    double t = medir_fase(stats, FASE_PUNTUACION, inicio_indice);
+    stats->tiempo_evaluacion += t - inicio_indice;
+    stats->candidatos_evaluados += indice->num_lineas;
+    stats->lineas_puntuadas += indice->num_lineas;
+    stats->pixeles_visitados += (long long)indice->num_entradas;
+    informar(ctx, "Indice inverso: %.1f MB\n", indice->memoria / (1024.0 * 1024.0));
+    
+    informar(ctx, "Iniciando algoritmo de hilo continuo...\n");
+    informar(ctx, "Error inicial: %.2f\n", (double)ctx->error_actual);
+    
+    int n = params->n;
+    long mejor_inicial = 0;
+    for (long l = 1; l < indice->num_lineas; l++) {
+        if (indice->puntuaciones[l] > indice->puntuaciones[mejor_inicial]) mejor_inicial = l;
+    }
+    ctx->clavo_actual = 0;
+    while ((long)(ctx->clavo_actual + 1) * n - (long)(ctx->clavo_actual + 1) * (ctx->clavo_actual + 2) / 2 <= mejor_inicial) {
+        ctx->clavo_actual++;
+    }
+    return true;
+}
+
+// Una iteracion del modo continuo: desde el clavo actual se dibuja la linea
+// de mayor beneficio (argmax exacto sobre las n - 1 lineas que salen de el)
+// y el otro extremo pasa a ser el clavo actual
+static MotivoParada iteracion_continuo(ContextoHilos *ctx) {
+    Parametros *params = &ctx->params;
+    Estadisticas *stats = &ctx->stats;
+    SecuenciaHilos *secuencia = ctx->secuencia;
+    IndiceInverso *indice = ctx->indice;
+    int n = params->n;
+    const int max_hilos_sin_mejora = 20 * params->s;
+    
+    double inicio_evaluacion = tiempo_actual();
+    int siguiente = -1;
+    int mejor = 0;
+    for (int j = 0; j < n; j++) {
+        if (j == ctx->clavo_actual) continue;
+        int beneficio = indice->puntuaciones[indice_par(n, ctx->clavo_actual, j)];
+        if (beneficio > mejor) {
+            mejor = beneficio;
+            siguiente = j;
+        }
+    }
+    double t = medir_fase(stats, FASE_ORDENACION, inicio_evaluacion);
+    stats->tiempo_evaluacion += t - inicio_evaluacion;
+    stats->candidatos_evaluados += n - 1;
+    
+    if (siguiente == -1) {
+        informar(ctx, "Parada: No se encontraron hilos utiles\n");
+        return PARADA_SIN_HILOS_UTILES;
+    }
+    
+    if (!reservar_hilos(secuencia, 1)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la secuencia de hilos\n");
+        return PARADA_ERROR;
+    }
+    EntradaLinea *linea = obtener_linea(ctx->cache, ctx->clavo_actual, siguiente);
+    if (linea == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la linea\n");
+        return PARADA_ERROR;
+    }
+    dibujar_linea_indexada(indice, ctx->resultado, ctx->res, linea, 5, &ctx->error_actual);
+    soltar_linea(ctx->cache, linea);
+    
+    anadir_hilo(secuencia, ctx->clavo_actual, siguiente);
+    ctx->clavo_actual = siguiente;
+    medir_fase(stats, FASE_DIBUJO, t);
+    
+    if (ctx->error_actual < ctx->error_anterior) {
+        ctx->error_anterior = ctx->error_actual;
+        ctx->sin_mejora = 0;
+    } else if (++ctx->sin_mejora >= max_hilos_sin_mejora) {
+        informar(ctx, "Parada: No hay mejora en %d hilos\n", max_hilos_sin_mejora);
+        return PARADA_SIN_MEJORA;
+    }
+    return PARADA_NINGUNA;
+}
+
+// Prepara el modo monticulo: indice inverso (registrando las lineas sucias)
+// y monticulo con el beneficio de todas las lineas
+static bool iniciar_monticulo(ContextoHilos *ctx) {
+    Parametros *params = &ctx->params;
+    Estadisticas *stats = &ctx->stats;
+    
+    ctx->extraidas = (int*)malloc(params->s * sizeof(int));
+    if (ctx->extraidas == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para el algoritmo\n");
+        return false;
+    }
+    
+    informar(ctx, "Construyendo indice inverso y monticulo de %ld lineas...\n",
+             (long)params->n * (params->n - 1) / 2);
+    double inicio_indice = tiempo_actual();
+    ctx->indice = crear_indice_inverso(ctx->cache, ctx->res, (size_t)params->memoria_cache_mb * 1024 * 1024);
+    if (ctx->indice == NULL || !registrar_lineas_sucias(ctx->indice) ||
+        (ctx->monticulo = crear_monticulo(ctx->indice->puntuaciones, (int)ctx->indice->num_lineas)) == NULL) {
+        if (ctx->indice != NULL) fprintf(stderr, "Error: No se pudo asignar memoria para el monticulo\n");
+        return false;
+    }
+    IndiceInverso *indice = ctx->indice;
+    double t = medir_fase(stats, FASE_PUNTUACION, inicio_indice);
+    stats->tiempo_evaluacion += t - inicio_indice;
+    stats->candidatos_evaluados += indice->num_lineas;
+    stats->lineas_puntuadas += indice->num_lineas;
+    stats->pixeles_visitados += (long long)indice->num_entradas;
+    informar(ctx, "Indice inverso: %.1f MB\n", indice->memoria / (1024.0 * 1024.0));
+    
+    informar(ctx, "Iniciando algoritmo voraz con monticulo...\n");
+    informar(ctx, "Error inicial: %.2f\n", (double)ctx->error_actual);
+    return true;
+}
+
+// Una iteracion del modo monticulo: se extraen las s lineas de mayor
+// beneficio de entre todas (como mucho 'restantes'). Al dibujarlas, el indice
+// inverso corrige los beneficios afectados y marca esas lineas como sucias;
+// al final de la iteracion solo se reajustan en el monticulo esas lineas,
+// cada una una sola vez
+static MotivoParada iteracion_monticulo(ContextoHilos *ctx, int restantes) {
+    Parametros *params = &ctx->params;
+    Estadisticas *stats = &ctx->stats;
+    SecuenciaHilos *secuencia = ctx->secuencia;
+    IndiceInverso *indice = ctx->indice;
+    Monticulo *monticulo = ctx->monticulo;
+    int *extraidas = ctx->extraidas;
+    const int max_iteraciones_sin_mejora = 20;
+    
+    int a_extraer = (params->s < restantes) ? params->s : restantes;
+    if (!reservar_hilos(secuencia, a_extraer)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la secuencia de hilos\n");
+        return PARADA_ERROR;
+    }
+    
+    // Extraer las s mejores lineas con beneficio positivo
+    double inicio_evaluacion = tiempo_actual();
+    int num_extraidas = 0;
+    while (num_extraidas < a_extraer && monticulo->tam > 0 &&
+           indice->puntuaciones[monticulo->elementos[0]] > 0) {
+        extraidas[num_extraidas++] = monticulo_extraer(monticulo);
+    }
+    double t = medir_fase(stats, FASE_ORDENACION, inicio_evaluacion);
+    stats->tiempo_evaluacion += t - inicio_evaluacion;
+    
+    if (num_extraidas == 0) {
+        informar(ctx, "Parada: No se encontraron hilos utiles\n");
+        return PARADA_SIN_HILOS_UTILES;
+    }
+    
+    bool sin_memoria = false;
+    for (int i = 0; i < num_extraidas; i++) {
+        int clavo1, clavo2;
+        clavos_de_linea(params->n, extraidas[i], &clavo1, &clavo2);
+        EntradaLinea *linea = obtener_linea(ctx->cache, clavo1, clavo2);
+        if (linea == NULL) {
+            sin_memoria = true;
+            break;
+        }
+        dibujar_linea_indexada(indice, ctx->resultado, ctx->res, linea, 5, &ctx->error_actual);
+        soltar_linea(ctx->cache, linea);
+    
+        anadir_hilo(secuencia, clavo1, clavo2);
+    }
+    
+    // Devolver las extraidas y reajustar solo las lineas cuyo beneficio cambio
+    inicio_evaluacion = medir_fase(stats, FASE_DIBUJO, t);
+    for (int i = 0; i < num_extraidas; i++) {
+        monticulo_insertar(monticulo, extraidas[i]);
+    }
+    for (int i = 0; i < indice->num_sucias; i++) {
+        int l = indice->sucias[i];
+        indice->es_sucia[l] = 0;
+        monticulo_reajustar(monticulo, l);
+    }
+    ctx->reajustes += indice->num_sucias;
+    stats->candidatos_evaluados += indice->num_sucias;
+    indice->num_sucias = 0;
+    t = medir_fase(stats, FASE_ORDENACION, inicio_evaluacion);
+    stats->tiempo_evaluacion += t - inicio_evaluacion;
+    
+    if (sin_memoria) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la linea\n");
+        return PARADA_ERROR;
+    }
+    
+    if (ctx->error_actual < ctx->error_anterior) {
+        ctx->error_anterior = ctx->error_actual;
+        ctx->sin_mejora = 0;
+    } else {
+        ctx->sin_mejora++;
+    }
+    
+    if (ctx->sin_mejora >= max_iteraciones_sin_mejora) {
+        informar(ctx, "Parada: No hay mejora en %d iteraciones\n", max_iteraciones_sin_mejora);
+        return PARADA_SIN_MEJORA;
+    }
+    return PARADA_NINGUNA;
+}
+
+// Libera el estado de la estrategia (lo que no se haya creado sigue a NULL)
+static void liberar_estado(ContextoHilos *ctx) {
+    liberar_pool(ctx->pool);
+    liberar_cache_lineas(ctx->cache_gruesa);
+    liberar_monticulo(ctx->monticulo);
+    liberar_indice_inverso(ctx->indice);
+    free(ctx->extraidas);
+    liberar_residuo(ctx->res);
+    liberar_arena(&ctx->arena_algoritmo);
+    ctx->pool = NULL;
+    ctx->cache_gruesa = NULL;
+    ctx->monticulo = NULL;
+    ctx->indice = NULL;
+    ctx->extraidas = NULL;
+    ctx->res = NULL;
+    ctx->candidatos = NULL;
+    ctx->clavos_gruesos = NULL;
+}
+
+// Prepara el plano de oscuridad faltante, el error inicial y el estado de la
+// estrategia elegida. Devuelve false (tras informar por stderr) si no hay memoria
+static bool iniciar_estrategia(ContextoHilos *ctx) {
+    ctx->res = crear_residuo(ctx->original, ctx->resultado);
+    if (ctx->res == NULL || !preparar_planos(ctx->res, ctx->cache)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la oscuridad faltante\n");
+        return false;
+    }
+    
+    // Error acumulado: sale de los mosaicos (calculados con el plano de
+    // oscuridad faltante) y cada hilo dibujado le suma la variacion de los
+    // pixeles que atraviesa
+    ctx->error_actual = error_mosaicos(ctx->res->mosaicos);
+    ctx->error_anterior = ctx->error_actual;
+    
+    if (ctx->params.modo == MODO_CONTINUO) return iniciar_continuo(ctx);
+    if (ctx->params.modo == MODO_MONTICULO) return iniciar_monticulo(ctx);
+    return iniciar_voraz(ctx);
+}
+
+// Verificacion final del error, resumen de la estrategia y liberacion de su estado
+static void terminar_estrategia(ContextoHilos *ctx) {
+    Parametros *params = &ctx->params;
+    
+    if (params->verificar_error) {
+        double t = tiempo_actual();
+        ctx->discrepancias += verificar_error_acumulado(ctx->original, ctx->resultado, ctx->error_actual);
+        medir_fase(&ctx->stats, FASE_ERROR, t);
+        informar(ctx, "Verificacion del error acumulado: %d discrepancias\n", ctx->discrepancias);
+    }
+    
+    const char *nombre = (params->modo == MODO_CONTINUO) ? "de hilo continuo" :
+                         (params->modo == MODO_MONTICULO) ? "voraz con monticulo" : "voraz";
+    informar(ctx, "Algoritmo %s completado. Hilos dibujados: %d, Error final: %.2f\n",
+             nombre, ctx->secuencia->num_hilos, (double)ctx->error_actual);
+    if (params->modo == MODO_MONTICULO) {
+        informar(ctx, "Lineas reajustadas en el monticulo: %lld\n", ctx->reajustes);
+    }
+    
+    if (ctx->cache_gruesa != NULL) {
+        ctx->stats.aciertos_cache += ctx->cache_gruesa->aciertos;
+        ctx->stats.fallos_cache += ctx->cache_gruesa->fallos;
+    }
+    liberar_estado(ctx);
+    if (params->modo == MODO_MUESTREO) {
+        informar(ctx, "Memoria liberada correctamente\n");
+    }
+}
+
+// Deja el contexto detenido definitivamente por 'motivo' y cierra el fichero de secuencia
+static MotivoParada detener_contexto(ContextoHilos *ctx, MotivoParada motivo) {
+    if (!cerrar_fichero_secuencia(ctx->secuencia)) {
+        fprintf(stderr, "Error: No se pudo escribir la secuencia de hilos %s\n", ctx->params.secuencia);
+    }
+    ctx->estado = CONTEXTO_TERMINADO;
+    ctx->motivo = motivo;
+    return motivo;
+}
+
+// Crea el contexto de resolucion de 'original' con una copia de 'params'
+// Sin 'clavos' (NULL) el contexto genera los suyos y su cache de lineas; si
+// se dan, junto con 'cache' (que puede ser NULL), deben corresponder a las
+// dimensiones de la imagen y a params->n, siguen siendo de quien llama y se
+// pueden compartir entre contextos. 'original' debe vivir tanto como el contexto
+// Devuelve NULL (tras informar por stderr) si los parametros no son validos
+// o no hay memoria
+ContextoHilos* crear_contexto(Imagen *original, const Parametros *params, Punto *clavos,
+                              CacheLineas *cache) {
+    ContextoHilos *ctx = (ContextoHilos*)calloc(1, sizeof(ContextoHilos));
+    if (ctx == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para el contexto\n");
+        return NULL;
+    }
+    ctx->params = *params;
+    if (!validar_parametros(&ctx->params) || !validar_opciones(&ctx->params)) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->original = original;
+    iniciar_arena(&ctx->arena, BLOQUE_ARENA);
+    iniciar_arena(&ctx->arena_algoritmo, BLOQUE_ARENA);
+    pthread_mutex_init(&ctx->cerrojo, NULL);
+    ctx->estado = CONTEXTO_SIN_EMPEZAR;
+    ctx->motivo = PARADA_NINGUNA;
+    params = &ctx->params;
+    
+    ctx->resultado = crear_imagen(original->ancho, original->alto);
+    if (ctx->resultado == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para imagen resultado\n");
+        liberar_contexto(ctx);
+        return NULL;
+    }
+    memset(ctx->resultado->pixels, 255, (size_t)ctx->resultado->paso * ctx->resultado->alto);
+    
+    if (clavos != NULL) {
+        ctx->clavos = clavos;
+        ctx->cache = cache;
+    } else {
+        ctx->recursos_propios = true;
+        double inicio_clavos = tiempo_actual();
+        ctx->clavos = generar_clavos(&ctx->arena, params->disposicion, params->fichero_clavos, params->n,
+                                     original->ancho, original->alto);
+        medir_fase(&ctx->stats, FASE_CLAVOS, inicio_clavos);
+        if (ctx->clavos == NULL) {
+            fprintf(stderr, "Error: No se pudo generar clavos\n");
+            liberar_contexto(ctx);
+            return NULL;
+        }
+    
+        if (params->memoria_cache_mb > 0) {
+            ctx->cache = crear_cache_lineas(ctx->clavos, params->n, original->ancho, original->alto,
+                                            original->paso, (size_t)params->memoria_cache_mb * 1024 * 1024,
+                                            params->antialias, params->compartir_simetrias);
+            if (ctx->cache == NULL) {
+                fprintf(stderr, "Error: No se pudo crear la cache de lineas\n");
+                liberar_contexto(ctx);
+                return NULL;
+            }
+        }
+    }
+    
+    ctx->secuencia = crear_secuencia(1024);
+    if (ctx->secuencia == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para hilos seleccionados\n");
+        liberar_contexto(ctx);
+        return NULL;
+    }
+    
+    if (params->secuencia != NULL) {
+        CabeceraSecuencia cabecera;
+        cabecera.ancho = original->ancho;
+        cabecera.alto = original->alto;
+        cabecera.n = params->n;
+        cabecera.p = params->p;
+        cabecera.s = params->s;
+        cabecera.semilla = params->semilla;
+        cabecera.modo = (int)params->modo;
+        cabecera.escala = params->escala;
+        cabecera.valor = 5;
+        // Con cache o sin ella las lineas se rasterizan desde el clavo de menor indice
+        cabecera.desde_menor = true;
+        cabecera.antialias = params->antialias;
+        cabecera.disposicion = (int)params->disposicion;
+        cabecera.simetrias = (ctx->cache != NULL && ctx->cache->simetrias.num > 1);
+        cabecera.clavos = ctx->clavos;
+        if (!abrir_fichero_secuencia(ctx->secuencia, params->secuencia, &cabecera, params->s)) {
+            liberar_contexto(ctx);
+            return NULL;
+        }
+    }
+    return ctx;
+}
+
+// Fija la funcion a la que se informa del progreso (NULL = ninguna)
+void fijar_progreso(ContextoHilos *ctx, FuncionProgreso funcion, void *datos) {
+    ctx->progreso = funcion;
+    ctx->datos_progreso = datos;
+}
+
+// Dibuja hasta k hilos mas (k <= 0: hasta que la estrategia se detenga) y
+// devuelve por que se ha parado. Con PARADA_NINGUNA se puede volver a llamar
+// y se sigue donde se quedo; con k multiplo de s los hilos son los mismos que
+// resolviendo de una vez. Los demas motivos son definitivos: la estrategia
+// libera su estado y las llamadas siguientes devuelven el mismo motivo.
+// La cancelacion y el limite de tiempo se comprueban antes de cada iteracion
+MotivoParada resolver_paso(ContextoHilos *ctx, int k) {
+    if (ctx->estado == CONTEXTO_TERMINADO) return ctx->motivo;
+    if (ctx->estado == CONTEXTO_SIN_EMPEZAR) {
+        ctx->inicio = tiempo_actual();
+        if (!iniciar_estrategia(ctx)) {
+            liberar_estado(ctx);
+            return detener_contexto(ctx, PARADA_ERROR);
+        }
+        ctx->estado = CONTEXTO_EN_CURSO;
+    }
+    
+    Parametros *params = &ctx->params;
+    SecuenciaHilos *secuencia = ctx->secuencia;
+    int pendientes = (k > 0) ? k : INT_MAX;
+    MotivoParada motivo = PARADA_NINGUNA;
+    
+    while (motivo == PARADA_NINGUNA) {
+        int restantes = hilos_restantes(params, secuencia);
+        if (restantes <= 0) {
+            informar(ctx, "Parada: Se alcanzo el limite de %d hilos\n", params->max_hilos);
+            motivo = PARADA_LIMITE;
+            break;
+        }
+        if (contexto_cancelado(ctx)) {
+            informar(ctx, "Parada: Resolucion cancelada\n");
+            motivo = PARADA_CANCELADA;
+            break;
+        }
+        if (params->limite_tiempo > 0 && tiempo_actual() - ctx->inicio >= params->limite_tiempo) {
+            informar(ctx, "Parada: Se agoto el limite de %.2f segundos\n", params->limite_tiempo);
+            motivo = PARADA_PLAZO;
+            break;
+        }
+        if (pendientes <= 0) return PARADA_NINGUNA;
+        if (restantes > pendientes) restantes = pendientes;
+    
+        int antes = secuencia->num_hilos;
+        if (params->modo == MODO_CONTINUO) {
+            motivo = iteracion_continuo(ctx);
+        } else if (params->modo == MODO_MONTICULO) {
+            motivo = iteracion_monticulo(ctx, restantes);
+        } else {
+            motivo = iteracion_voraz(ctx, restantes);
+        }
+        pendientes -= secuencia->num_hilos - antes;
+    
+        if (motivo == PARADA_NINGUNA && secuencia->num_hilos % 500 == 0) {
+            if (params->verificar_error) {
+                double t = tiempo_actual();
+                ctx->discrepancias += verificar_mosaicos(ctx->res, ctx->original, ctx->resultado,
+                                                         ctx->error_actual, &ctx->stats.mosaicos_revisados);
+                medir_fase(&ctx->stats, FASE_ERROR, t);
+            }
+            informar(ctx, "Hilos dibujados: %d, Error actual: %.2f\n", secuencia->num_hilos,
+                     (double)ctx->error_actual);
+        }
+        avisar_progreso(ctx, NULL);
+    }
+    
+    terminar_estrategia(ctx);
+    return detener_contexto(ctx, motivo);
+}
+
+// Imagen resultado con los hilos dibujados hasta ahora (y su error en
+// 'error', si no es NULL). Entre pasos, o tras una parada, es la mejor
+// imagen disponible
+const Imagen* obtener_resultado(const ContextoHilos *ctx, double *error) {
+    if (error != NULL) *error = (double)ctx->error_actual;
+    return ctx->resultado;
+}
+
+// Hilos dibujados hasta ahora
+const SecuenciaHilos* obtener_secuencia(const ContextoHilos *ctx) {
+    return ctx->secuencia;
+}
+
+// Cache de lineas del contexto (NULL si no usa cache)
+const CacheLineas* obtener_cache(const ContextoHilos *ctx) {
+    return ctx->cache;
+}
+
+// Contadores de la resolucion. Quien llama puede anotar en ellos las fases
+// que mide por su cuenta (lectura y escritura de las imagenes)
+Estadisticas* obtener_estadisticas(ContextoHilos *ctx) {
+    return &ctx->stats;
+}
+
+// Resumen de las reservas en arenas: las ya liberadas mas las del contexto y su cache
+void obtener_memoria(const ContextoHilos *ctx, ContadoresMemoria *memoria) {
+    pthread_mutex_lock(&cerrojo_memoria);
+    *memoria = memoria_liberada;
+    pthread_mutex_unlock(&cerrojo_memoria);
+    memoria->reservas += ctx->arena.reservas;
+    memoria->bloques_sistema += ctx->arena.bloques_sistema;
+    if (ctx->cache != NULL) {
+        memoria->reservas += ctx->cache->arena.reservas;
+        memoria->bloques_sistema += ctx->cache->arena.bloques_sistema;
+        memoria->bloques_reutilizados += ctx->cache->reutilizados;
+    }
+}
+
+// Nombre de un motivo de parada
+const char* nombre_parada(MotivoParada motivo) {
+    return nombres_paradas[motivo];
+}
+
+// Libera el contexto (con el estado de la estrategia si no se habia detenido)
+// Los clavos y la cache dados a crear_contexto no se liberan
+void liberar_contexto(ContextoHilos *ctx) {
+    if (ctx == NULL) return;
+    liberar_estado(ctx);
+    liberar_secuencia(ctx->secuencia);
+    if (ctx->recursos_propios) {
+        liberar_cache_lineas(ctx->cache);
+    }
+    liberar_arena(&ctx->arena);
+    liberar_imagen(ctx->resultado);
+    pthread_mutex_destroy(&ctx->cerrojo);
+    free(ctx);
+}
+
+// Microbenchmark de los nucleos de puntuacion: puntua repetidamente el mismo
+// conjunto de lineas aleatorias con cada nucleo disponible y comprueba que
+// todos devuelven exactamente los mismos beneficios que el escalar. Se mide
+// con las lineas de Bresenham y con las mismas lineas con antialiasing
+int ejecutar_bench_nucleos(const char *nombre_imagen, int n, int num_lineas) {
+    Imagen *original = leer_pgm(nombre_imagen);
+    if (original == NULL) return 1;
+    Imagen *actual = crear_imagen(original->ancho, original->alto);
+    Arena arena;
+    iniciar_arena(&arena, BLOQUE_ARENA);
+    Punto *clavos = generar_clavos(&arena, DISPOSICION_RECTANGULO, NULL, n, original->ancho, original->alto);
+    CacheLineas *caches[2] = { NULL, NULL };
+    for (int modelo = 0; modelo < 2 && clavos != NULL; modelo++) {
+        caches[modelo] = crear_cache_lineas(clavos, n, original->ancho, original->alto, original->paso,
+                                            (size_t)-1, modelo == 1, false);
+    }
+    EntradaLinea **lineas = (EntradaLinea**)calloc(2 * (size_t)num_lineas, sizeof(EntradaLinea*));
+    int *pares = (int*)malloc(2 * (size_t)num_lineas * sizeof(int));
+    long long *referencia = (long long*)malloc(num_lineas * sizeof(long long));
+    Residuo *res = NULL;
+    int resultado = 1;
+    if (actual == NULL || clavos == NULL || caches[0] == NULL || caches[1] == NULL || lineas == NULL ||
+        pares == NULL || referencia == NULL) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para el benchmark\n");
+        goto fin;
+    }
+    memset(actual->pixels, 255, (size_t)actual->paso * actual->alto);
+    res = crear_residuo(original, actual);
+    if (res == NULL || !crear_plano_transpuesto(res)) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para el benchmark\n");
+        goto fin;
+    }
+    
+    // Unos cuantos hilos previos dejan oscuridad faltante positiva y negativa
+    Generador generador;
+    iniciar_generador(&generador, GENERADOR_XOSHIRO, 12345, 0);
+    for (int i = 0; i < 4 * n; i++) {
+        int par[2];
+        generar_pares_clavos(&generador, par, 1, n);
+        dibujar_hilo(actual, res, clavos, caches[0], par[0], par[1], 5, NULL);
+    }
+    generar_pares_clavos(&generador, pares, num_lineas, n);
+    
+    printf("Benchmark de nucleos: %s, n=%d, %d lineas\n", nombre_imagen, n, num_lineas);
+    printf("%-10s %-10s %16s %16s %12s\n", "lineas", "nucleo", "lineas/s", "Mpixeles/s", "resultado");
+    
+    const char *nombres[] = {"escalar", "sse2", "avx2"};
+    for (int modelo = 0; modelo < 2; modelo++) {
+        EntradaLinea **conjunto = lineas + (size_t)modelo * num_lineas;
+        long long total_pixeles = 0;
+        for (int i = 0; i < num_lineas; i++) {
+            conjunto[i] = obtener_linea(caches[modelo], pares[2 * i], pares[2 * i + 1]);
+            if (conjunto[i] == NULL) {
+                fprintf(stderr, "Error: No se pudo asignar memoria para el benchmark\n");
+                goto fin;
+            }
+            referencia[i] = (modelo == 0)
+                ? puntuar_escalar(res->valores, conjunto[i]->pixeles, conjunto[i]->num_pixeles)
+                : puntuar_ponderado_escalar(conjunto[i]->transpuesta ? res->transpuesta : res->valores,
+                                            conjunto[i]->pixeles, conjunto[i]->pesos, conjunto[i]->num_pixeles);
+            total_pixeles += conjunto[i]->num_pixeles;
+        }
+        const char *nombre_modelo = (modelo == 0) ? "bresenham" : "aa";
+        printf("(%s: %.0f %s de media por linea)\n", nombre_modelo, (double)total_pixeles / num_lineas,
+               modelo == 0 ? "pixeles" : "parejas de pixeles");
+        
+        for (int k = 0; k < 3; k++) {
+            const char *elegido;
+            NucleoPonderado ponderado;
+            NucleoPuntuacion nucleo = buscar_nucleo(nombres[k], &elegido, &ponderado);
+            if (nucleo == NULL) {
+                printf("%-10s %-10s %16s %16s %12s\n", nombre_modelo, nombres[k], "-", "-", "no soportado");
+                continue;
+            }
+            
+            bool identico = true;
+            for (int i = 0; i < num_lineas; i++) {
+                EntradaLinea *l = conjunto[i];
+                const short *plano = l->transpuesta ? res->transpuesta : res->valores;
+                long long v = (modelo == 0) ? nucleo(res->valores, l->pixeles, l->num_pixeles)
+                                            : ponderado(plano, l->pixeles, l->pesos, l->num_pixeles);
+                if (v != referencia[i]) identico = false;
+            }
+            
+            // Repetir el conjunto hasta acumular al menos medio segundo
+            long long repeticiones = 0;
+            volatile long long sumidero = 0;
+            double inicio = tiempo_actual();
+            double transcurrido;
+            do {
+                if (modelo == 0) {
+                    for (int i = 0; i < num_lineas; i++) {
+                        sumidero += nucleo(res->valores, conjunto[i]->pixeles, conjunto[i]->num_pixeles);
+                    }
+                } else {
+                    for (int i = 0; i < num_lineas; i++) {
+                        EntradaLinea *l = conjunto[i];
+                        sumidero += ponderado(l->transpuesta ? res->transpuesta : res->valores,
+                                              l->pixeles, l->pesos, l->num_pixeles);
+                    }
+                }
+                repeticiones++;
+                transcurrido = tiempo_actual() - inicio;
+            } while (transcurrido < 0.5);
+            
+            printf("%-10s %-10s %16.0f %16.1f %12s\n", nombre_modelo, nombres[k],
+                   repeticiones * num_lineas / transcurrido,
+                   repeticiones * total_pixeles / transcurrido / 1e6,
+                   identico ? "identico" : "DISTINTO");
+        }
+    }
+    resultado = 0;
+    
+fin:
+    for (int modelo = 0; modelo < 2; modelo++) {
+        for (int i = 0; lineas != NULL && i < num_lineas; i++) {
+            EntradaLinea *l = lineas[(size_t)modelo * num_lineas + i];
+            if (l != NULL) soltar_linea(caches[modelo], l);
+        }
+        liberar_cache_lineas(caches[modelo]);
+    }
+    free(referencia);
+    free(pares);
+    free(lineas);
+    liberar_residuo(res);
+    liberar_arena(&arena);
+    liberar_imagen(actual);
+    liberar_imagen(original);
+    return resultado;
+}
+
+// Redibuja la imagen de un fichero de secuencia sin volver a resolver
+// Un ultimo hilo a medio escribir (secuencia aun en curso) se ignora
+int reproducir_secuencia(const char *nombre_secuencia, const char *nombre_salida, bool binario) {
+    double inicio = tiempo_actual();
+    FicheroMemoria f;
+    if (!cargar_fichero(nombre_secuencia, &f)) {
+        fprintf(stderr, "Error: No se pudo abrir el archivo %s\n", nombre_secuencia);
+        return 1;
+    }
+    
+    const unsigned char *pos = f.datos;
+    const unsigned char *fin = f.datos + f.tam;
+    // La version 1 no tenia el campo de antialiasing y la 2 no tenia los de
+    // la disposicion (en ambas los clavos estan en el rectangulo)
+    if (f.tam < 5 || memcmp(pos, SECUENCIA_MAGICO, 4) != 0 || pos[4] < 1 || pos[4] > SECUENCIA_VERSION) {
+        fprintf(stderr, "Error: %s no es una secuencia de hilos valida\n", nombre_secuencia);
+        descargar_fichero(&f);
+        return 1;
+    }
+    int num_campos = (pos[4] == 1) ? 10 : (pos[4] == 2) ? 11 : 13;
+    pos += 5;
+    
+    unsigned int campos[13] = { 0 };
+    for (int i = 0; i < num_campos && pos != NULL; i++) {
+        pos = leer_varint(pos, fin, &campos[i]);
+    }
+    CabeceraSecuencia cabecera;
+    if (pos != NULL) {
+        cabecera.ancho = (int)campos[0];
+        cabecera.alto = (int)campos[1];
+        cabecera.n = (int)campos[2];
+        cabecera.p = (int)campos[3];
+        cabecera.s = (int)campos[4];
+        cabecera.semilla = campos[5];
+        cabecera.modo = (int)campos[6];
+        cabecera.escala = (int)campos[7];
+        cabecera.valor = (int)campos[8];
+        cabecera.desde_menor = campos[9] != 0;
+        cabecera.antialias = campos[10] != 0;
+        cabecera.disposicion = (int)campos[11];
+        cabecera.simetrias = campos[12] != 0;
+    }
+    if (pos == NULL || cabecera.ancho <= 0 || cabecera.alto <= 0 || cabecera.n < 2 ||
+        cabecera.valor > 255 || cabecera.disposicion >= NUM_DISPOSICIONES) {
+        fprintf(stderr, "Error: Cabecera de secuencia no valida en %s\n", nombre_secuencia);
+        descargar_fichero(&f);
+        return 1;
+    }
+    
+    Imagen *img = crear_imagen(cabecera.ancho, cabecera.alto);
+    Arena arena;
+    iniciar_arena(&arena, BLOQUE_ARENA);
+    Punto *clavos;
+    if (cabecera.disposicion == DISPOSICION_FICHERO) {
+        // Las coordenadas van en la cabecera
+        clavos = (Punto*)arena_reservar(&arena, cabecera.n * sizeof(Punto));
+        for (int i = 0; clavos != NULL && i < cabecera.n && pos != NULL; i++) {
+            pos = leer_real(pos, fin, &clavos[i].x);
+            if (pos != NULL) pos = leer_real(pos, fin, &clavos[i].y);
+        }
+        if (pos == NULL) {
+            fprintf(stderr, "Error: Cabecera de secuencia no valida en %s\n", nombre_secuencia);
+            liberar_imagen(img);
+            liberar_arena(&arena);
+            descargar_fichero(&f);
+            return 1;
+        }
+    } else {
+        clavos = generar_clavos(&arena, (TipoDisposicion)cabecera.disposicion, NULL, cabecera.n,
+                                cabecera.ancho, cabecera.alto);
+    }
+    // Buffers de una linea (de Bresenham o, con antialiasing, una entrada por
+    // paso del eje mayor)
+    int max_pixeles = (int)sqrt(cabecera.ancho * cabecera.ancho + cabecera.alto * cabecera.alto) + 10;
+    int *pixeles = (int*)arena_reservar(&arena, max_pixeles * sizeof(int));
+    unsigned char *pesos = (unsigned char*)arena_reservar(&arena, 2 * (size_t)max_pixeles);
+    // Las mismas simetrias que la cache que resolvio la secuencia
+    SimetriasClavos simetrias;
+    simetrias.num = 1;
+    bool simetrias_correctas = clavos == NULL || !cabecera.simetrias ||
+        detectar_simetrias(&arena, clavos, cabecera.n, cabecera.ancho, cabecera.alto, &simetrias);
+    if (img == NULL || clavos == NULL || pixeles == NULL || pesos == NULL || !simetrias_correctas) {
+        fprintf(stderr, "Error: No se pudo asignar memoria para la reproduccion\n");
+        liberar_imagen(img);
+        liberar_arena(&arena);
+        descargar_fichero(&f);
+        return 1;
+    }
+    memset(img->pixels, 255, (size_t)img->paso * img->alto);
+    
+    int num_hilos = 0;
+    int ultimo_clavo = 0;
+    bool correcto = true;
+    while (pos < fin) {
+        unsigned int delta1, delta2;
+        const unsigned char *siguiente = leer_varint(pos, fin, &delta1);
+        if (siguiente != NULL) siguiente = leer_varint(siguiente, fin, &delta2);
+        if (siguiente == NULL) {
+            fprintf(stderr, "Aviso: Secuencia incompleta, se ignora el ultimo hilo\n");
+            break;
+        }
+        pos = siguiente;
+        
+        int clavo1 = ultimo_clavo + deshacer_zigzag(delta1);
+        int clavo2 = clavo1 + deshacer_zigzag(delta2);
+        if (clavo1 < 0 || clavo1 >= cabecera.n || clavo2 < 0 || clavo2 >= cabecera.n) {
+            fprintf(stderr, "Error: Clavo fuera de rango en el hilo %d de la secuencia\n", num_hilos);
+            correcto = false;
+            break;
+        }
+        ultimo_clavo = clavo2;
+        
+        // Mismo sentido de trazado que al resolver para obtener los mismos pixeles
+        int a = clavo1, b = clavo2;
+        if (cabecera.desde_menor && b < a) {
+            a = clavo2;
+            b = clavo1;
+        }
+        if (cabecera.antialias) {
+            bool transpuesta;
+            int num_pixels = rasterizar_linea_aa(clavos[a].x, clavos[a].y, clavos[b].x, clavos[b].y,
+                                                 img->ancho, img->alto, img->paso, pixeles, pesos,
+                                                 &transpuesta);
+            dibujar_linea_ponderada(img, NULL, pixeles, pesos, num_pixels, transpuesta,
+                                    (unsigned char)cabecera.valor, NULL);
+        } else if (simetrias.num > 1) {
+            // Como en la cache: la linea es la imagen de la de su par canonico,
+            // trazada desde el clavo de menor indice
+            int c1 = a, c2 = b;
+            Simetria simetria = canonizar_par(&simetrias, cabecera.n, &c1, &c2);
+            if (c2 < c1) {
+                int tmp = c1; c1 = c2; c2 = tmp;
+            }
+            int num_pixels = rasterizar_linea((int)round(clavos[c1].x), (int)round(clavos[c1].y),
+                                              (int)round(clavos[c2].x), (int)round(clavos[c2].y),
+                                              img->ancho, img->alto, img->paso, pixeles);
+            for (int i = 0; i < num_pixels; i++) {
+                size_t d = transformar_desplazamiento(simetria_inversa[simetria], img->ancho, img->alto,
+                                                      img->paso, (size_t)pixeles[i]);
+                oscurecer_pixel(img, NULL, d, (unsigned char)cabecera.valor, NULL);
+            }
+        } else {
+            int num_pixels;
+            dibujar_linea_bresenham(img, NULL,
+                                    (int)round(clavos[a].x), (int)round(clavos[a].y),
+                                    (int)round(clavos[b].x), (int)round(clavos[b].y),
+                                    (unsigned char)cabecera.valor, &num_pixels, NULL);
+        }
+        num_hilos++;
+    }
+    descargar_fichero(&f);
+    
+    if (correcto && !escribir_pgm(nombre_salida, img, binario)) {
+        correcto = false;
+    }
+    if (correcto) {
+        printf("Secuencia %s: %d x %d, n=%d, p=%d, s=%d, semilla %u\n", nombre_secuencia,
+               cabecera.ancho, cabecera.alto, cabecera.n, cabecera.p, cabecera.s, cabecera.semilla);
+        printf("Hilos redibujados: %d\n", num_hilos);
+        printf("Tiempo de reproduccion: %.3f segundos\n", tiempo_actual() - inicio);
+    }
+    
+    liberar_arena(&arena);
+    liberar_imagen(img);
+    return correcto ? 0 : 1;
+}
+
+// Valores por defecto de los parametros
+void parametros_por_defecto(Parametros *params) {
+    params->n = 0;
+    params->p = 0;
+    params->s = 0;
+    params->memoria_cache_mb = MEMORIA_CACHE_MB_DEFECTO;
+    params->trabajadores = 1;
+    params->escala = 1;
+    params->refinar = 0;
+    params->max_hilos = 0;
+    params->limite_tiempo = 0.0;
+    params->semilla = (unsigned int)time(NULL);
+    params->generador = GENERADOR_XOSHIRO;
+    params->verificar_error = false;
+    params->salida_binaria = false;
+    params->estadisticas_json = false;
+    params->antialias = false;
+    params->compartir_simetrias = false;
+    params->disposicion = DISPOSICION_RECTANGULO;
+    params->fichero_clavos = NULL;
+    params->modo = MODO_MUESTREO;
+    params->secuencia = NULL;
+}
+
+// Comprueba las opciones comunes a todas las imagenes
+bool validar_opciones(const Parametros *params) {
+    if (params->memoria_cache_mb < 0) {
+        fprintf(stderr, "Error: La memoria de la cache no puede ser negativa\n");
+        return false;
+    }
+    
+    if (params->trabajadores <= 0) {
+        fprintf(stderr, "Error: El numero de trabajadores debe ser positivo\n");
+        return false;
+    }
+    
+    if (params->max_hilos < 0) {
+        fprintf(stderr, "Error: El limite de hilos no puede ser negativo\n");
+        return false;
+    }
+    
+    if (params->limite_tiempo < 0) {
+        fprintf(stderr, "Error: El limite de tiempo no puede ser negativo\n");
+        return false;
+    }
+    
+    if (params->escala != 1 && params->escala != 2 && params->escala != 4 && params->escala != 8) {
+        fprintf(stderr, "Error: El factor de escala debe ser 1, 2, 4 u 8\n");
+        return false;
+    }
+    
+    if (params->refinar < 0) {
+        fprintf(stderr, "Error: El numero de candidatos a refinar no puede ser negativo\n");
+        return false;
+    }
+    
+    if (params->escala > 1 && params->modo != MODO_MUESTREO) {
+        fprintf(stderr, "Error: La multirresolucion (-e) solo esta disponible en el modo muestreo\n");
+        return false;
+    }
+    
+    if (params->modo != MODO_MUESTREO && params->memoria_cache_mb == 0) {
+        fprintf(stderr, "Error: Los modos continuo y monticulo necesitan la cache de lineas (-c > 0)\n");
+        return false;
+    }
+    
+    // Los pesos de cada linea se precalculan en la cache; el indice inverso de
+    // los otros modos no guarda pesos
+    if (params->antialias && (params->modo != MODO_MUESTREO || params->memoria_cache_mb == 0)) {
+        fprintf(stderr, "Error: El antialiasing (--aa) necesita el modo muestreo y la cache de lineas (-c > 0)\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// Comprueba n, p y s de una imagen y completa lo que depende de ellos
+bool validar_parametros(Parametros *params) {
+    if (params->n <= 0 || params->p <= 0 || params->s <= 0) {
+        fprintf(stderr, "Error: Los parametros deben ser positivos\n");
+        return false;
+    }
+    
+    if (params->n < 2) {
+        fprintf(stderr, "Error: Se necesitan al menos 2 clavos\n");
+        return false;
+    }
+    
+    if (params->s > params->p) {
+        fprintf(stderr, "Error: s no puede ser mayor que p\n");
+        return false;
+    }
+    
+    if (params->refinar == 0) {
+        params->refinar = 4 * params->s;
+    }
+    if (params->refinar < params->s) {
+        fprintf(stderr, "Error: Hay que refinar al menos s candidatos\n");
+        return false;
+    }
+    return true;
+}
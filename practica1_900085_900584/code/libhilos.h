@@ -0,0 +1,289 @@
+// Biblioteca de resolucion de string art: dada una imagen PGM y los
+// parametros, elige y dibuja hilos entre clavos con un algoritmo voraz
+//
+// Uso basico:
+//   ContextoHilos *ctx = crear_contexto(original, &params, NULL, NULL);
+//   fijar_progreso(ctx, funcion, datos);       // opcional
+//   while (resolver_paso(ctx, 500) == PARADA_NINGUNA) { ... }
+//   const Imagen *resultado = obtener_resultado(ctx, &error);
+//   liberar_contexto(ctx);
+#ifndef LIBHILOS_H
+#define LIBHILOS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Memoria por defecto de la cache de lineas (MB)
+#define MEMORIA_CACHE_MB_DEFECTO 512
+
+// Alineacion de los buffers de imagen (una linea de cache)
+#define ALINEACION 64
+
+// Tamaño por defecto de los bloques que las arenas piden al sistema
+#define BLOQUE_ARENA (1 << 20)
+
+// Representa un punto en el plano 2D (coordenadas de clavos)
+typedef struct {
+    double x, y;
+} Punto;
+
+// Disposicion de los clavos alrededor de la imagen
+typedef enum {
+    DISPOSICION_RECTANGULO,  // Perimetro rectangular de la imagen
+    DISPOSICION_CIRCULO,     // Circulo inscrito en la imagen
+    DISPOSICION_ELIPSE,      // Elipse inscrita (ejes iguales a los lados)
+    DISPOSICION_FICHERO,     // Coordenadas leidas de un fichero de texto
+    NUM_DISPOSICIONES
+} TipoDisposicion;
+
+// Simetrias del cuadrado (grupo D4) como transformaciones de los pixeles de
+// una imagen ancho x alto. Las cuatro ultimas intercambian los ejes y solo se
+// usan con imagenes cuadradas
+typedef enum {
+    SIMETRIA_IDENTIDAD,       // (x, y)
+    SIMETRIA_ESPEJO_X,        // (ancho-1-x, y)
+    SIMETRIA_ESPEJO_Y,        // (x, alto-1-y)
+    SIMETRIA_GIRO_180,        // (ancho-1-x, alto-1-y)
+    SIMETRIA_TRASPUESTA,      // (y, x)
+    SIMETRIA_GIRO_90,         // (ancho-1-y, x)
+    SIMETRIA_GIRO_270,        // (y, alto-1-x)
+    SIMETRIA_ANTITRASPUESTA,  // (ancho-1-y, alto-1-x)
+    NUM_SIMETRIAS
+} Simetria;
+
+// Simetrias que dejan invariante el conjunto de clavos (redondeados a pixeles)
+// y a que clavo lleva cada una a cada clavo
+typedef struct {
+    int num;                          // Simetrias validas, contando la identidad
+    int *permutacion[NUM_SIMETRIAS];  // NULL si la simetria no es valida (y en la identidad)
+} SimetriasClavos;
+
+// Representa una imagen en escala de grises formato PGM
+// Los pixeles estan en un unico buffer contiguo alineado a 64 bytes; cada
+// fila ocupa 'paso' bytes (ancho redondeado a multiplo de 64)
+typedef struct {
+    int ancho, alto;
+    int paso;                // Bytes entre el inicio de dos filas consecutivas
+    unsigned char *pixels;   // Buffer [alto * paso]
+} Imagen;
+
+// Estrategia de seleccion de hilos
+typedef enum {
+    MODO_MUESTREO,   // s mejores de p pares aleatorios por iteracion
+    MODO_CONTINUO,   // Hilo continuo: mejor linea desde el clavo actual
+    MODO_MONTICULO   // s mejores de todas las lineas con un monticulo indexado
+} ModoSeleccion;
+
+// Generador pseudoaleatorio de los candidatos
+typedef enum {
+    GENERADOR_XOSHIRO,  // xoshiro256**: flujos por salto de 2^128 pasos
+    GENERADOR_PCG       // PCG32 (XSH-RR): un flujo por incremento
+} TipoGenerador;
+
+// Parametros del algoritmo voraz
+typedef struct {
+    int n;  // Numero de clavos
+    int p;  // Numero de hilos candidatos por iteracion
+    int s;  // Numero de mejores hilos a seleccionar
+    int memoria_cache_mb;  // Limite de memoria de la cache de lineas (0 = sin cache)
+    int trabajadores;      // Hilos de ejecucion para evaluar candidatos
+    int escala;            // Factor de reduccion del nivel grueso (1 = sin multirresolucion)
+    int refinar;           // Candidatos que se vuelven a puntuar a resolucion completa
+    int max_hilos;         // Limite de hilos dibujados (0 = sin limite)
+    double limite_tiempo;  // Segundos de resolucion (0 = sin limite)
+    unsigned int semilla;  // Semilla de los generadores aleatorios
+    TipoGenerador generador; // Algoritmo de los generadores aleatorios
+    bool verificar_error;  // Contrastar el error acumulado con recalculos completos
+    bool salida_binaria;   // Escribir el resultado en P5 en lugar de P2
+    bool antialias;        // Lineas con antialiasing y clavos en coordenadas reales
+    bool estadisticas_json; // Estadisticas finales en JSON en lugar de texto
+    bool compartir_simetrias; // Reutilizar en la cache las lineas simetricas
+    TipoDisposicion disposicion; // Colocacion de los clavos
+    const char *fichero_clavos;  // Coordenadas de los clavos (DISPOSICION_FICHERO)
+    ModoSeleccion modo;    // Estrategia de seleccion de hilos
+    const char *secuencia; // Fichero de secuencia de hilos (NULL = no se escribe)
+} Parametros;
+
+// Fases en las que se reparte el tiempo de una ejecucion
+typedef enum {
+    FASE_LECTURA,      // Lectura de la imagen de entrada
+    FASE_CLAVOS,       // Generacion de los clavos
+    FASE_MUESTREO,     // Generacion de los pares candidatos
+    FASE_PUNTUACION,   // Beneficio de los candidatos (y construccion de indices)
+    FASE_ORDENACION,   // qsort de candidatos u operaciones del monticulo
+    FASE_DIBUJO,       // Dibujo de los hilos elegidos
+    FASE_ERROR,        // Calculo completo del error (inicial y verificaciones)
+    FASE_ESCRITURA,    // Escritura de la imagen resultado
+    NUM_FASES
+} Fase;
+
+// Contadores de rendimiento de una ejecucion
+typedef struct {
+    long long candidatos_evaluados;  // Hilos candidatos puntuados
+    double tiempo_evaluacion;        // Segundos dedicados a puntuarlos
+    long long candidatos_refinados;  // Repuntuados a resolucion completa (multirresolucion)
+    double tiempo_fase[NUM_FASES];   // Segundos de reloj real en cada fase
+    long long lineas_puntuadas;      // Lineas cuyo beneficio se ha sumado pixel a pixel
+    long long pixeles_visitados;     // Pixeles leidos al sumar esos beneficios
+    long long aciertos_cache, fallos_cache;  // Consultas a las caches de lineas
+    long long mosaicos_revisados;    // Mosaicos recalculados por las verificaciones del error
+} Estadisticas;
+
+// Hilos dibujados, en orden, y el fichero de secuencia al que se van volcando
+// segun se dibujan para que otro proceso pueda consumirlos antes de terminar
+typedef struct {
+    int *clavos;         // Pares (clavo1, clavo2) de cada hilo
+    int num_hilos;
+    int capacidad;       // Hilos que caben en 'clavos' (crece al doble cuando se llena)
+    FILE *fichero;       // NULL si no se escribe secuencia
+    long bytes;          // Bytes escritos en el fichero
+    int ultimo_clavo;    // Referencia de la codificacion delta
+    int volcar_cada;     // Hilos entre dos fflush del fichero
+    int sin_volcar;
+} SecuenciaHilos;
+
+// Bloque de memoria pedido al sistema del que una arena sirve reservas
+typedef struct BloqueArena {
+    struct BloqueArena *siguiente;
+    size_t tam, usado;    // Bytes de datos del bloque y ya servidos
+    unsigned char *datos;
+} BloqueArena;
+
+// Arena: reservas que se sirven avanzando un puntero dentro de bloques grandes
+// y que se liberan todas de una vez con liberar_arena
+typedef struct {
+    BloqueArena *bloques;   // El primero es el bloque actual
+    size_t tam_bloque;
+    long long reservas;         // Reservas servidas
+    long long bloques_sistema;  // Bloques pedidos al sistema
+    size_t bytes;               // Bytes pedidos al sistema
+} Arena;
+
+// Contadores de las arenas ya liberadas, para el resumen de memoria
+typedef struct {
+    long long reservas, bloques_sistema, bloques_reutilizados;
+} ContadoresMemoria;
+
+// Linea rasterizada entre un par de clavos, enlazada en la lista LRU de su clase
+typedef struct {
+    int *pixeles;             // Desplazamientos y * paso + x (NULL si no esta en cache)
+    unsigned char *pesos;     // Con antialiasing, los dos pesos de cada entrada (si no, NULL)
+    int num_pixeles;          // Pixeles (con antialiasing, parejas de pixeles)
+    bool transpuesta;         // Desplazamientos en el plano traspuesto del residuo
+    unsigned char simetria;   // Simetria g: los pixeles son los de la linea canonica,
+                              // el pixel real es g^-1(d) (SIMETRIA_IDENTIDAD si es propia)
+    int canonica;             // Entrada duena de los pixeles (ella misma si es propia)
+    int fijaciones;           // Usuarios actuales (no se puede expulsar si > 0)
+    int anterior, siguiente;  // Indices de las entradas vecinas en la lista LRU
+} EntradaLinea;
+
+// Cache de lineas: rasteriza cada par de clavos una sola vez y, cuando se
+// alcanza el limite de memoria, reutiliza el bloque de la linea de su misma
+// clase de tamano usada hace mas tiempo
+typedef struct {
+    int n;
+    int ancho, alto, paso;
+    int max_pixeles;         // Longitud maxima de una linea rasterizada
+    bool antialias;          // Lineas de Wu con pesos en lugar de Bresenham
+    int *extremos;           // Coordenadas redondeadas de los clavos (x, y)
+    double *extremos_reales; // Coordenadas exactas de los clavos (solo con antialiasing)
+    SimetriasClavos simetrias; // Solo se rasteriza el par canonico de cada orbita
+    EntradaLinea *entradas;  // Una entrada por par no ordenado de clavos
+    size_t memoria_usada;    // Bytes de los bloques con una linea dentro
+    size_t memoria_reservada; // Bytes de todos los bloques pedidos a la arena
+    size_t memoria_maxima;   // Limite de memoria_reservada
+    pthread_mutex_t cerrojo; // Protege las listas LRU y los contadores
+    long long aciertos, fallos, expulsiones;
+    long long simetricas;    // Consultas servidas con la linea de un par simetrico
+    
+    // Toda la memoria de la cache sale de su arena. Los pixeles de cada linea
+    // (seguidos de sus pesos, si hay antialiasing) ocupan un bloque de
+    // k * PIXELES_POR_CLASE enteros. Cada clase k tiene su propia lista LRU:
+    // alcanzado el limite, una linea nueva se queda con el bloque de otra de
+    // su clase, y solo se pide memoria por encima de el para una clase que no
+    // tiene ninguna linea que se pueda expulsar
+    Arena arena;
+    int *cabezas, *colas;    // Lista LRU de cada clase: cabeza = mas reciente
+    int num_clases;
+    long long reutilizados;  // Bloques quitados a una linea expulsada
+} CacheLineas;
+
+// Motivo por el que resolver_paso devuelve el control
+typedef enum {
+    PARADA_NINGUNA,          // Se dibujaron los k hilos pedidos: se puede seguir
+    PARADA_LIMITE,           // Se alcanzo Parametros.max_hilos
+    PARADA_SIN_MEJORA,       // El error no mejora desde hace 20 iteraciones
+    PARADA_SIN_HILOS_UTILES, // Ningun hilo tiene beneficio positivo
+    PARADA_SIN_OSCURIDAD,    // No queda oscuridad faltante por cubrir
+    PARADA_CANCELADA,        // cancelar_contexto o la funcion de progreso lo pidieron
+    PARADA_PLAZO,            // Se agoto Parametros.limite_tiempo
+    PARADA_ERROR,            // Falta de memoria (informada por stderr)
+    NUM_PARADAS
+} MotivoParada;
+
+// Estado que recibe la funcion de progreso
+typedef struct {
+    int hilos;            // Hilos dibujados hasta ahora
+    double error;         // Error acumulado de la imagen resultado
+    double segundos;      // Tiempo resolviendo desde el primer paso
+    const char *mensaje;  // Mensaje informativo (con su salto de linea) o NULL
+                          // en el aviso que sigue a cada iteracion
+} ProgresoHilos;
+
+// Funcion de progreso: se llama tras cada iteracion y con cada mensaje
+// informativo. Si devuelve false la resolucion se cancela
+typedef bool (*FuncionProgreso)(const ProgresoHilos *progreso, void *datos);
+
+// Resolucion en curso de una imagen (opaco)
+typedef struct ContextoHilos ContextoHilos;
+
+// Imagenes PGM
+Imagen* crear_imagen(int ancho, int alto);
+void liberar_imagen(Imagen *img);
+bool leer_dimensiones_pgm(const char *nombre_archivo, int *ancho, int *alto);
+Imagen* leer_pgm(const char *nombre_archivo);
+int escribir_pgm(const char *nombre_archivo, const Imagen *img, bool binario);
+
+// Arenas
+void iniciar_arena(Arena *arena, size_t tam_bloque);
+void* arena_reservar(Arena *arena, size_t bytes);
+void liberar_arena(Arena *arena);
+
+// Clavos y cache de lineas (compartibles entre contextos de igual ancho, alto y n)
+Punto* generar_clavos(Arena *arena, TipoDisposicion disposicion, const char *fichero,
+                      int n, int ancho, int alto);
+CacheLineas* crear_cache_lineas(Punto *clavos, int n, int ancho, int alto, int paso,
+                                size_t memoria_maxima, bool antialias, bool compartir_simetrias);
+void liberar_cache_lineas(CacheLineas *cache);
+
+// Parametros
+void parametros_por_defecto(Parametros *params);
+bool validar_opciones(const Parametros *params);
+bool validar_parametros(Parametros *params);
+bool seleccionar_nucleo(const char *nombre);
+const char* nucleo_seleccionado(void);
+
+// Resolucion
+ContextoHilos* crear_contexto(Imagen *original, const Parametros *params, Punto *clavos,
+                              CacheLineas *cache);
+void fijar_progreso(ContextoHilos *ctx, FuncionProgreso funcion, void *datos);
+MotivoParada resolver_paso(ContextoHilos *ctx, int k);
+void cancelar_contexto(ContextoHilos *ctx);
+const Imagen* obtener_resultado(const ContextoHilos *ctx, double *error);
+const SecuenciaHilos* obtener_secuencia(const ContextoHilos *ctx);
+const CacheLineas* obtener_cache(const ContextoHilos *ctx);
+Estadisticas* obtener_estadisticas(ContextoHilos *ctx);
+void obtener_memoria(const ContextoHilos *ctx, ContadoresMemoria *memoria);
+const char* nombre_parada(MotivoParada motivo);
+void liberar_contexto(ContextoHilos *ctx);
+
+// Utilidades
+double tiempo_actual(void);
+double medir_fase(Estadisticas *stats, Fase fase, double inicio);
+unsigned int semilla_flujo(unsigned int semilla, int flujo);
+int reproducir_secuencia(const char *nombre_secuencia, const char *nombre_salida, bool binario);
+int ejecutar_bench_nucleos(const char *nombre_imagen, int n, int num_lineas);
+
+#endif
@@ -11,7 +11,7 @@ echo ""
 
 # Compilar
 echo "Compilando programa..."
-gcc -O2 -o hilos code/hilos.c -lm -std=c99
+gcc -O2 -pthread -o hilos code/hilos.c code/libhilos.c -lm -std=c99
 if [ $? -ne 0 ]; then
     echo "Error: Fallo en la compilacion"
     exit 1
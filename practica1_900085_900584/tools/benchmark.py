@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+# benchmark.py - Benchmark y regresion del programa de string art
+# Practica 1: Algoritmos Voraces - String Art
+#
+# Ejecuta una bateria fija de cargas (imagen, n, p, s, opciones) con semilla
+# fija sobre pruebas/*.pgm, repite cada una varias veces y muestra la mediana
+# y el percentil 95 del tiempo real, los candidatos evaluados por segundo y el
+# error final. Despues compara con un fichero base y termina con codigo 1 si
+# el rendimiento baja mas de un umbral o si cambia el resultado (error final
+# o hilos dibujados) de alguna carga, que con semilla fija es determinista.
+#
+# Ejecutar desde la carpeta p1/:
+#   python3 tools/benchmark.py                 # medir y comparar con la base
+#   python3 tools/benchmark.py --guardar-base  # medir y guardar como nueva base
+#
+# Resultados: experimentos/benchmark.csv
+# Solo usa la biblioteca estandar de Python
+
+import argparse
+import csv
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+BINARIO = "./hilos"
+COMPILAR = ["gcc", "-O2", "-pthread", "-o", "hilos", "code/hilos.c", "code/libhilos.c", "-lm", "-std=c99"]
+BASE = "tools/benchmark_base.json"
+CSV = "experimentos/benchmark.csv"
+SEMILLA = 12345
+
+# Cargas: (nombre, imagen, n, p, s, opciones extra)
+# Cubren las tres estrategias, antialiasing, multirresolucion y disposiciones
+CARGAS = [
+    ("qr_muestreo",        "qr",          100,  500, 10, []),
+    ("emoji_muestreo",     "emoji",       200, 1000, 10, []),
+    ("messi_enunciado",    "messi",      1000, 1100, 30, []),
+    ("messi_multires",     "messi",       400, 2000, 20, ["-e", "4"]),
+    ("ilia_circulo_aa",    "iliaTopuria", 300, 1000, 20, ["--clavos", "circulo", "--aa"]),
+    ("emoji_continuo",     "emoji",       200, 1000, 10, ["-m", "continuo"]),
+    ("ilia_monticulo",     "iliaTopuria", 200, 1000, 20, ["-m", "monticulo"]),
+]
+
+
+def percentil(valores, q):
+    """Percentil q (0-100) con interpolacion lineal entre muestras ordenadas."""
+    orden = sorted(valores)
+    if len(orden) == 1:
+        return orden[0]
+    pos = (len(orden) - 1) * q / 100.0
+    i = int(pos)
+    if i + 1 >= len(orden):
+        return orden[-1]
+    return orden[i] + (orden[i + 1] - orden[i]) * (pos - i)
+
+
+def ejecutar_carga(binario, carga, salida):
+    """Ejecuta una carga con --stats=json y devuelve el objeto de estadisticas."""
+    nombre, imagen, n, p, s, extra = carga
+    orden = [binario, str(n), str(p), str(s), f"pruebas/{imagen}.pgm", salida,
+             "--seed", str(SEMILLA), "--stats=json"] + extra
+    proceso = subprocess.run(orden, capture_output=True, text=True)
+    if proceso.returncode != 0:
+        print(f"Error: Fallo la carga {nombre}: {proceso.stderr.strip()}")
+        return None
+    return json.loads(proceso.stdout.strip().splitlines()[-1])
+
+
+def medir_carga(binario, carga, repeticiones, salida):
+    """Repite una carga y resume tiempos, candidatos por segundo y resultado."""
+    tiempos, velocidades, resultados = [], [], set()
+    for _ in range(repeticiones):
+        stats = ejecutar_carga(binario, carga, salida)
+        if stats is None:
+            return None
+        tiempo = stats["tiempo_ejecucion"]
+        tiempos.append(tiempo)
+        velocidades.append(stats["contadores"]["candidatos_evaluados"] / tiempo if tiempo > 0 else 0.0)
+        resultados.add((stats["error_final"], stats["hilos_dibujados"]))
+    if len(resultados) != 1:
+        print(f"Aviso: {carga[0]} no da el mismo resultado en todas las repeticiones")
+    error, hilos = sorted(resultados)[0]
+    return {
+        "tiempo_mediana": round(statistics.median(tiempos), 6),
+        "tiempo_p95": round(percentil(tiempos, 95), 6),
+        "candidatos_por_segundo": round(statistics.median(velocidades)),
+        "error_final": error,
+        "hilos_dibujados": hilos,
+        "nucleo": stats["nucleo"],
+    }
+
+
+def comparar(medidas, base, umbral):
+    """Compara con la base. Devuelve la lista de regresiones encontradas."""
+    regresiones = []
+    for nombre, m in medidas.items():
+        b = base.get(nombre)
+        if b is None:
+            print(f"  {nombre:18s} sin base")
+            continue
+        cambio = 100.0 * (m["candidatos_por_segundo"] / b["candidatos_por_segundo"] - 1.0)
+        estado = "ok"
+        if m["error_final"] != b["error_final"] or m["hilos_dibujados"] != b["hilos_dibujados"]:
+            estado = "RESULTADO DISTINTO"
+            regresiones.append(f"{nombre}: error {b['error_final']:.0f} -> {m['error_final']:.0f}, "
+                               f"hilos {b['hilos_dibujados']} -> {m['hilos_dibujados']}")
+        elif cambio < -umbral:
+            estado = "MAS LENTO"
+            regresiones.append(f"{nombre}: {cambio:+.1f}% candidatos/s (umbral -{umbral:.0f}%)")
+        print(f"  {nombre:18s} {cambio:+7.1f}% candidatos/s  {estado}")
+    return regresiones
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark y regresion de hilos")
+    parser.add_argument("--repeticiones", type=int, default=5, help="ejecuciones por carga (por defecto 5)")
+    parser.add_argument("--umbral", type=float, default=10.0,
+                        help="caida maxima de candidatos/s admitida, en %% (por defecto 10)")
+    parser.add_argument("--base", default=BASE, help=f"fichero base (por defecto {BASE})")
+    parser.add_argument("--guardar-base", action="store_true", help="guarda las medidas como nueva base")
+    parser.add_argument("--cargas", nargs="+", metavar="NOMBRE", help="ejecuta solo estas cargas")
+    parser.add_argument("--binario", default=BINARIO, help=f"ejecutable a medir (por defecto {BINARIO})")
+    parser.add_argument("--no-compilar", action="store_true", help="no recompila el ejecutable")
+    args = parser.parse_args()
+
+    if args.repeticiones <= 0:
+        print("Error: El numero de repeticiones debe ser positivo")
+        return 2
+
+    if not args.no_compilar:
+        print("Compilando...")
+        if subprocess.run(COMPILAR).returncode != 0:
+            print("Error: Fallo en la compilacion")
+            return 2
+
+    cargas = [c for c in CARGAS if args.cargas is None or c[0] in args.cargas]
+    if not cargas:
+        print("Error: Ninguna carga coincide con --cargas")
+        return 2
+
+    medidas = {}
+    with tempfile.TemporaryDirectory() as directorio:
+        salida = os.path.join(directorio, "salida.pgm")
+        print(f"{'carga':18s} {'mediana':>9s} {'p95':>9s} {'candidatos/s':>13s} {'error final':>14s} {'hilos':>7s}")
+        for carga in cargas:
+            m = medir_carga(args.binario, carga, args.repeticiones, salida)
+            if m is None:
+                return 2
+            medidas[carga[0]] = m
+            print(f"{carga[0]:18s} {m['tiempo_mediana']:8.3f}s {m['tiempo_p95']:8.3f}s "
+                  f"{m['candidatos_por_segundo']:13.0f} {m['error_final']:14.0f} {m['hilos_dibujados']:7d}")
+
+    os.makedirs(os.path.dirname(CSV), exist_ok=True)
+    with open(CSV, "w", newline="") as f:
+        escritor = csv.writer(f)
+        escritor.writerow(["carga", "imagen", "n", "p", "s", "opciones", "repeticiones", "tiempo_mediana",
+                           "tiempo_p95", "candidatos_por_segundo", "error_final", "hilos_dibujados"])
+        for nombre, imagen, n, p, s, extra in cargas:
+            m = medidas[nombre]
+            escritor.writerow([nombre, imagen, n, p, s, " ".join(extra), args.repeticiones,
+                               f"{m['tiempo_mediana']:.6f}", f"{m['tiempo_p95']:.6f}",
+                               f"{m['candidatos_por_segundo']:.0f}", f"{m['error_final']:.0f}",
+                               m["hilos_dibujados"]])
+    print(f"Resultados: {CSV}")
+
+    if args.guardar_base:
+        base = {}
+        if os.path.exists(args.base):
+            with open(args.base) as f:
+                base = json.load(f)
+        base.update(medidas)
+        with open(args.base, "w") as f:
+            json.dump(base, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print(f"Base guardada en {args.base}")
+        return 0
+
+    if not os.path.exists(args.base):
+        print(f"Aviso: No existe la base {args.base} (crearla con --guardar-base)")
+        return 0
+    with open(args.base) as f:
+        base = json.load(f)
+    print(f"Comparacion con {args.base}:")
+    regresiones = comparar(medidas, base, args.umbral)
+    if regresiones:
+        print("Regresiones:")
+        for r in regresiones:
+            print(f"  {r}")
+        return 1
+    print("Sin regresiones")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,77 @@
+#!/bin/bash
+
+# comparar_modos.sh - Comparacion de las estrategias de seleccion de hilos
+# Practica 1: Algoritmos Voraces - String Art
+#
+# Ejecuta cada imagen de pruebas/ con los modos muestreo, continuo y
+# monticulo (-m) y con varios numeros de clavos, con una semilla fija, y
+# registra tiempo, hilos dibujados y error final de cada ejecucion.
+#
+# Ejecutar desde la carpeta p1/:  bash tools/comparar_modos.sh
+#
+# Variables de entorno opcionales:
+#   CLAVOS     lista de valores de n (por defecto 100 200 300)
+#   P, S       parametros del algoritmo (por defecto p=1100, s=30)
+#   SEMILLA    semilla aleatoria del modo muestreo (por defecto 12345)
+#   MODOS      modos a comparar (por defecto muestreo continuo monticulo)
+#   CACHE_MB   limite de -c, que debe alojar el indice inverso (por defecto 2048)
+#
+# Resultados: experimentos/modos.csv
+
+BINARY=./hilos
+IMG_DIR=pruebas
+OUT_DIR=experimentos
+IMG_OUT=$OUT_DIR/imagenes
+CSV=$OUT_DIR/modos.csv
+
+CLAVOS=${CLAVOS:-"100 200 300"}
+P=${P:-1100}
+S=${S:-30}
+SEMILLA=${SEMILLA:-12345}
+MODOS=${MODOS:-"muestreo continuo monticulo"}
+CACHE_MB=${CACHE_MB:-2048}
+
+# ─── Compilar ──────────────────────────────────────────────────────────────
+echo "=========================================="
+echo " Compilando..."
+echo "=========================================="
+gcc -O2 -pthread -o hilos code/hilos.c code/libhilos.c -lm -std=c99
+if [ $? -ne 0 ]; then
+    echo "ERROR: Fallo en la compilacion"
+    exit 1
+fi
+echo "Compilacion exitosa"
+echo ""
+
+mkdir -p "$IMG_OUT"
+
+echo "imagen,modo,n,p,s,hilos_dibujados,error_final,tiempo_seg" > "$CSV"
+
+for img in messi iliaTopuria emoji qr; do
+    echo "=========================================="
+    echo " $img.pgm  (p=$P, s=$S, semilla=$SEMILLA)"
+    echo "=========================================="
+    for n in $CLAVOS; do
+        for modo in $MODOS; do
+            output="$IMG_OUT/modos_${img}_${modo}_n${n}.pgm"
+            salida=$($BINARY "$n" "$P" "$S" "$IMG_DIR/${img}.pgm" "$output" \
+                     -m "$modo" -c "$CACHE_MB" --seed "$SEMILLA" 2>/dev/null)
+
+            hilos=$(echo "$salida" | grep "Numero de hilos dibujados" | grep -oE '[0-9]+' | tail -1)
+            error=$(echo "$salida" | grep "Error final" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+            tiempo=$(echo "$salida" | grep "Tiempo de ejecucion" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+            hilos=${hilos:-0}
+            error=${error:-0}
+            tiempo=${tiempo:-0}
+
+            printf "  n=%-4s %-10s tiempo=%ss  hilos=%s  error=%s\n" "$n" "$modo" "$tiempo" "$hilos" "$error"
+            echo "$img,$modo,$n,$P,$S,$hilos,$error,$tiempo" >> "$CSV"
+        done
+    done
+    echo ""
+done
+
+echo "=========================================="
+echo " Tabla comparativa: $CSV"
+echo "=========================================="
+cat "$CSV"
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+# escalado.sh - Escalabilidad de la evaluacion multihilo de candidatos
+# Practica 1: Algoritmos Voraces - String Art
+#
+# Mide el tiempo real de ejecucion frente al numero de trabajadores (-t)
+# sobre messi.pgm e iliaTopuria.pgm con una semilla fija, de forma que
+# para cada numero de trabajadores la ejecucion es reproducible.
+#
+# Ejecutar desde la carpeta p1/:  bash tools/escalado.sh
+#
+# Variables de entorno opcionales:
+#   N, P, S        parametros del algoritmo (por defecto los del enunciado)
+#   SEMILLA        semilla aleatoria (por defecto 12345)
+#   TRABAJADORES   lista de valores de -t (por defecto 1 2 4 ... hasta nproc)
+#
+# Resultados: experimentos/escalado.csv
+
+BINARY=./hilos
+IMG_DIR=pruebas
+OUT_DIR=experimentos
+IMG_OUT=$OUT_DIR/imagenes
+CSV=$OUT_DIR/escalado.csv
+
+N=${N:-1000}
+P=${P:-1100}
+S=${S:-30}
+SEMILLA=${SEMILLA:-12345}
+
+if [ -z "$TRABAJADORES" ]; then
+    NUCLEOS=$(nproc 2>/dev/null || echo 1)
+    TRABAJADORES="1"
+    t=2
+    while [ "$t" -le "$NUCLEOS" ]; do
+        TRABAJADORES="$TRABAJADORES $t"
+        t=$((t * 2))
+    done
+    if [ "$NUCLEOS" -gt 1 ] && [ $((t / 2)) -ne "$NUCLEOS" ]; then
+        TRABAJADORES="$TRABAJADORES $NUCLEOS"
+    fi
+fi
+
+# ─── Compilar ──────────────────────────────────────────────────────────────
+echo "=========================================="
+echo " Compilando..."
+echo "=========================================="
+gcc -O2 -pthread -o hilos code/hilos.c code/libhilos.c -lm -std=c99
+if [ $? -ne 0 ]; then
+    echo "ERROR: Fallo en la compilacion"
+    exit 1
+fi
+echo "Compilacion exitosa"
+echo ""
+
+mkdir -p "$IMG_OUT"
+
+echo "imagen,n,p,s,trabajadores,hilos_dibujados,error_final,tiempo_seg,aceleracion" > "$CSV"
+
+for img in messi iliaTopuria; do
+    echo "=========================================="
+    echo " $img.pgm  (n=$N, p=$P, s=$S, semilla=$SEMILLA)"
+    echo "=========================================="
+    base=""
+    for t in $TRABAJADORES; do
+        output="$IMG_OUT/escalado_${img}_t${t}.pgm"
+        salida=$($BINARY "$N" "$P" "$S" "$IMG_DIR/${img}.pgm" "$output" -t "$t" --seed "$SEMILLA" 2>/dev/null)
+
+        hilos=$(echo "$salida" | grep "Numero de hilos dibujados" | grep -oE '[0-9]+' | tail -1)
+        error=$(echo "$salida" | grep "Error final" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+        tiempo=$(echo "$salida" | grep "Tiempo de ejecucion" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+        hilos=${hilos:-0}
+        error=${error:-0}
+        tiempo=${tiempo:-0}
+
+        if [ -z "$base" ]; then
+            base=$tiempo
+        fi
+        aceleracion=$(awk -v b="$base" -v t="$tiempo" 'BEGIN { if (t > 0) printf "%.2f", b / t; else print "0" }')
+
+        echo "  t=$t  tiempo=${tiempo}s  aceleracion=x$aceleracion  error=$error"
+        echo "$img,$N,$P,$S,$t,$hilos,$error,$tiempo,$aceleracion" >> "$CSV"
+    done
+    echo ""
+done
+
+echo "=========================================="
+echo " Tabla de escalado: $CSV"
+echo "=========================================="
+cat "$CSV"
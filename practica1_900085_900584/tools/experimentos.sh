@@ -12,8 +12,11 @@
 #
 # Ejecutar desde la carpeta p1/:  bash tools/experimentos.sh
 #
-# Resultados: experimentos/resultados.csv
+# Resultados: experimentos/resultados.csv  (incluye el tiempo de cada fase y
+#                                           los contadores de --stats=json)
 #             experimentos/imagenes/
+#
+# Requiere python3 para leer las estadisticas JSON del programa.
 
 BINARY=./hilos
 IMG_DIR=pruebas
@@ -25,7 +28,7 @@ CSV=$OUT_DIR/resultados.csv
 echo "=========================================="
 echo " Compilando..."
 echo "=========================================="
-gcc -O2 -o hilos code/hilos.c -lm -std=c99
+gcc -O2 -pthread -o hilos code/hilos.c code/libhilos.c -lm -std=c99
 if [ $? -ne 0 ]; then
     echo "ERROR: Fallo en la compilacion"
     exit 1
@@ -36,7 +39,22 @@ echo ""
 mkdir -p "$IMG_OUT"
 
 # ─── Cabecera CSV ──────────────────────────────────────────────────────────
-echo "experimento,imagen,n,p,s,hilos_dibujados,error_final,tiempo_seg" > "$CSV"
+FASES="lectura clavos muestreo puntuacion ordenacion dibujo error escritura"
+CONTADORES="candidatos_evaluados lineas_puntuadas pixeles_visitados aciertos_cache fallos_cache"
+echo "experimento,imagen,n,p,s,hilos_dibujados,error_final,tiempo_seg,$(echo $FASES $CONTADORES | tr ' ' ',')" > "$CSV"
+
+# Convierte el objeto JSON de --stats=json en los campos del CSV
+# (hilos, error, tiempo, una columna por fase y una por contador)
+json_a_csv() {
+    python3 -c '
+import json, sys
+d = json.loads(sys.stdin.read())
+campos = [d["hilos_dibujados"], d["error_final"], d["tiempo_ejecucion"]]
+campos += [d["fases"][f] for f in sys.argv[1].split()]
+campos += [d["contadores"][c] for c in sys.argv[2].split()]
+print(",".join(str(c) for c in campos))
+' "$FASES" "$CONTADORES"
+}
 
 # ─── Funcion auxiliar ──────────────────────────────────────────────────────
 run_exp() {
@@ -51,27 +69,21 @@ run_exp() {
 
     echo "  >> $exp_label | img=$img_name  n=$n  p=$p  s=$s"
 
-    # Ejecutar y capturar salida
-    local salida
-    salida=$($BINARY "$n" "$p" "$s" "$input" "$output" 2>/dev/null)
-
-    # Extraer metricas (grep -oE compatible con MSYS2/Git Bash)
-    local hilos
-    hilos=$(echo "$salida" | grep "Numero de hilos dibujados" | grep -oE '[0-9]+' | tail -1)
-    local error
-    error=$(echo "$salida" | grep "Error final" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
-    local tiempo
-    tiempo=$(echo "$salida" | grep "Tiempo de ejecucion" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+    # Ejecutar: con --stats=json la salida estandar es solo el objeto JSON
+    local fila
+    fila=$($BINARY "$n" "$p" "$s" "$input" "$output" --stats=json 2>/dev/null | json_a_csv 2>/dev/null)
 
-    # Valores por defecto si algo falla
-    hilos=${hilos:-0}
-    error=${error:-0}
-    tiempo=${tiempo:-0}
+    # Valores por defecto si algo falla (mismo numero de columnas)
+    if [ -z "$fila" ]; then
+        fila="0,0,0$(printf ',0%.0s' $FASES $CONTADORES)"
+    fi
 
+    local hilos error tiempo
+    IFS=, read -r hilos error tiempo _ <<< "$fila"
     echo "     hilos=$hilos  error=$error  tiempo=${tiempo}s"
 
     # Escribir en CSV
-    echo "$exp_label,$img_name,$n,$p,$s,$hilos,$error,$tiempo" >> "$CSV"
+    echo "$exp_label,$img_name,$n,$p,$s,$fila" >> "$CSV"
 }
 
 # =============================================================================
@@ -146,3 +158,19 @@ echo " Vista del CSV:"
 echo "------------------------------------------"
 cat "$CSV"
 echo "------------------------------------------"
+echo ""
+echo " Reparto del tiempo por fases (% del total de cada ejecucion):"
+echo "------------------------------------------"
+python3 -c '
+import csv, sys
+fases = sys.argv[2].split()
+with open(sys.argv[1]) as f:
+    filas = list(csv.DictReader(f))
+print("%-16s %-12s %5s %5s %5s  " % ("experimento", "imagen", "n", "p", "s") +
+      " ".join("%10s" % f[:10] for f in fases))
+for r in filas:
+    total = sum(float(r[f]) for f in fases) or 1.0
+    print("%-16s %-12s %5s %5s %5s  " % (r["experimento"], r["imagen"], r["n"], r["p"], r["s"]) +
+          " ".join("%9.1f%%" % (100.0 * float(r[f]) / total) for f in fases))
+' "$CSV" "$FASES"
+echo "------------------------------------------"
@@ -0,0 +1,83 @@
+#!/bin/bash
+
+# multirresolucion.sh - Calidad frente a velocidad de la multirresolucion
+# Practica 1: Algoritmos Voraces - String Art
+#
+# Ejecuta cada imagen de pruebas/ con los parametros del enunciado y la
+# misma semilla variando el factor de escala del nivel grueso (-e), y
+# registra el tiempo y el error final relativos a la resolucion completa.
+#
+# Ejecutar desde la carpeta p1/:  bash tools/multirresolucion.sh
+#
+# Variables de entorno opcionales:
+#   N, P, S    parametros del algoritmo (por defecto los del enunciado)
+#   SEMILLA    semilla aleatoria (por defecto 12345)
+#   ESCALAS    factores a comparar (por defecto 1 2 4 8; el 1 es la referencia)
+#   REFINAR    candidatos repuntuados a resolucion completa (por defecto 4*s)
+#
+# Resultados: experimentos/multirresolucion.csv
+
+BINARY=./hilos
+IMG_DIR=pruebas
+OUT_DIR=experimentos
+IMG_OUT=$OUT_DIR/imagenes
+CSV=$OUT_DIR/multirresolucion.csv
+
+N=${N:-1000}
+P=${P:-1100}
+S=${S:-30}
+SEMILLA=${SEMILLA:-12345}
+ESCALAS=${ESCALAS:-"1 2 4 8"}
+REFINAR=${REFINAR:-$((4 * S))}
+
+# ─── Compilar ──────────────────────────────────────────────────────────────
+echo "=========================================="
+echo " Compilando..."
+echo "=========================================="
+gcc -O2 -pthread -o hilos code/hilos.c code/libhilos.c -lm -std=c99
+if [ $? -ne 0 ]; then
+    echo "ERROR: Fallo en la compilacion"
+    exit 1
+fi
+echo "Compilacion exitosa"
+echo ""
+
+mkdir -p "$IMG_OUT"
+
+echo "imagen,escala,refinar,hilos_dibujados,error_final,tiempo_seg,aceleracion,perdida_pct" > "$CSV"
+
+for img in messi iliaTopuria emoji qr; do
+    echo "=========================================="
+    echo " $img.pgm  (n=$N, p=$P, s=$S, refinar=$REFINAR, semilla=$SEMILLA)"
+    echo "=========================================="
+    base_tiempo=""
+    base_error=""
+    for e in $ESCALAS; do
+        output="$IMG_OUT/multirresolucion_${img}_e${e}.pgm"
+        salida=$($BINARY "$N" "$P" "$S" "$IMG_DIR/${img}.pgm" "$output" \
+                 -e "$e" -r "$REFINAR" --seed "$SEMILLA" 2>/dev/null)
+
+        hilos=$(echo "$salida" | grep "Numero de hilos dibujados" | grep -oE '[0-9]+' | tail -1)
+        error=$(echo "$salida" | grep "Error final" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+        tiempo=$(echo "$salida" | grep "Tiempo de ejecucion" | grep -oE '[0-9]+[.]?[0-9]*' | tail -1)
+        hilos=${hilos:-0}
+        error=${error:-0}
+        tiempo=${tiempo:-0}
+
+        if [ -z "$base_tiempo" ]; then
+            base_tiempo=$tiempo
+            base_error=$error
+        fi
+        aceleracion=$(awk -v b="$base_tiempo" -v t="$tiempo" 'BEGIN { if (t > 0) printf "%.2f", b / t; else print "0" }')
+        perdida=$(awk -v b="$base_error" -v e="$error" 'BEGIN { if (b > 0) printf "%.2f", 100 * (e - b) / b; else print "0" }')
+
+        echo "  e=$e  tiempo=${tiempo}s  aceleracion=x$aceleracion  error=$error (${perdida}%)"
+        echo "$img,$e,$REFINAR,$hilos,$error,$tiempo,$aceleracion,$perdida" >> "$CSV"
+    done
+    echo ""
+done
+
+echo "=========================================="
+echo " Tabla calidad/velocidad: $CSV"
+echo "=========================================="
+cat "$CSV"
@@ -29,8 +29,19 @@
  *                   1 = Solucion recursiva pura
  *                   2 = Recursiva con memoizacion
  *                   3 = Iterativa con tabla (bottom-up)
+ *                   4 = Segmentacion en flujo (textos de cualquier longitud)
  *   <diccionario>: Ruta al fichero con palabras (una por linea)
- *   <texto>      : Ruta al fichero con la cadena a verificar (sin espacios)
+ *   <texto>      : Ruta al fichero con la cadena a verificar (sin espacios),
+ *                  o "-" para leerla de la entrada estandar
+ *   Opciones (variantes 1 a 3):
+ *   --contar     : muestra cuantas particiones hay en lugar de listarlas
+ *   --dag        : muestra el grafo de particiones en lugar de listarlas
+ *   --limite N   : lista como mucho N particiones (0 = todas, por defecto 10000)
+ *   --desde N    : salta las N primeras particiones
+ *   --busqueda M : busqueda de prefijos: trie (por defecto) o hash
+ *
+ *   separarPalabras --bench-dicc <diccionario> [consultas]
+ *                  mide las consultas por segundo de la tabla hash
  *
  * -----------------------------------------------------------------------------
  * EJEMPLO
@@ -48,12 +59,19 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <time.h>
 
 /* Constantes de tamaño maxima para evitar desbordamientos */
 #define MAX_PALABRA 256        /* Longitud maxima de una palabra en el diccionario */
-#define MAX_TEXTO 10000        /* Longitud maxima de la cadena de entrada */
-#define HASH_SIZE 4096         /* Numero de cubos en la tabla hash (potencia de 2) */
-#define MAX_PARTICIONES 10000  /* Maximo numero de particiones distintas a mostrar */
+#define BLOQUE_FLUJO 65536     /* Bytes leidos de cada vez en la variante 4 */
+#define MAX_PENDIENTE (1 << 22) /* Maximo texto sin punto de corte en la variante 4 */
+#define MAX_TEXTO_RECURSIVO 20000 /* Maximo texto de las variantes 1 y 2 (una llamada
+                                     recursiva por caracter; con 8 MB de pila fallan
+                                     entre 40000 y 60000) */
+#define TABLA_INICIAL 1024     /* Casillas iniciales de la tabla hash (potencia de 2) */
+#define BUSQUEDA_TRIE 0        /* Prefijos recorriendo el trie de doble array */
+#define BUSQUEDA_HASH 1        /* Prefijos con hash incremental en la tabla hash */
+#define MAX_PARTICIONES 10000  /* Particiones mostradas por defecto (--limite) */
 #define MAX_PALABRAS_PARTICION 500  /* Maximo palabras en una particion (no usado activamente) */
 
 /*
@@ -66,112 +84,485 @@
  * que el algoritmo sea eficiente (en lugar de O(m) con busqueda lineal).
  *
  * Funcion hash: djb2, ampliamente usada por su buena distribucion con cadenas.
- * Resolucion de colisiones: encadenamiento (lista enlazada por cubo).
+ * Resolucion de colisiones: direccionamiento abierto con Robin Hood (ver abajo).
+ *
+ * Ademas, las mismas palabras se guardan en un trie de doble array. Los
+ * algoritmos no preguntan por cada prefijo texto[i..j] por separado (copiarlo
+ * y calcular su hash cuesta O(j-i)), sino que recorren el trie desde texto[i]
+ * un caracter cada vez: cada estado final alcanzado es una palabra texto[i..j]
+ * y el recorrido se corta en cuanto ninguna palabra puede continuar. Asi cada
+ * posicion cuesta O(L), siendo L la longitud de la palabra mas larga.
  * =============================================================================
  */
 
-/* Nodo de la lista enlazada para resolver colisiones en la tabla hash */
-typedef struct NodoHash {
-    char *palabra;
-    struct NodoHash *sig;
-} NodoHash;
+/*
+ * Trie de doble array: cada estado s es una posicion de los arrays base y
+ * check. El hijo de s por el caracter c es t = base[s] + c, y solo existe si
+ * check[t] == s, por lo que avanzar un caracter cuesta O(1) sin listas ni
+ * punteros. Los arrays se rellenan de una vez al terminar la carga, a partir
+ * de un trie auxiliar (hijo/hermano) que se construye insertando palabras.
+ */
+
+#define TRIE_RAIZ 0      /* Estado inicial: prefijo vacio */
+#define TRIE_LIBRE -1    /* Valor de check de una posicion sin usar */
+#define TRIE_MAX_FALLOS 64  /* Intentos de base antes de abandonar los huecos */
+
+/* Nodo del trie auxiliar usado solo durante la carga del diccionario */
+typedef struct {
+    int hijo;           /* Primer hijo (hijos ordenados por caracter) o -1 */
+    int hermano;        /* Siguiente hermano o -1 */
+    unsigned char c;    /* Caracter de la arista que llega al nodo */
+    char fin;           /* 1 si en este nodo termina una palabra */
+} NodoTrie;
 
-/* Estructura del diccionario: array de listas (tabla hash con encadenamiento) */
 typedef struct {
-    NodoHash *buckets[HASH_SIZE];
+    int *base;          /* base[s]: desplazamiento de los hijos de s */
+    int *check;         /* check[t]: padre del estado t o TRIE_LIBRE */
+    char *fin;          /* fin[s] = 1 si el camino hasta s es una palabra */
+    int tam;            /* Posiciones reservadas en base, check y fin */
+    NodoTrie *nodos;    /* Trie auxiliar (NULL una vez compactado) */
+    int *salto;         /* Solo al compactar: salto[p] lleva hacia la siguiente posicion libre */
+    int num_nodos;
+    int cap_nodos;
+} Trie;
+
+/* Inicializa un trie vacio con solo la raiz en el trie auxiliar */
+void trie_iniciar(Trie *t) {
+    t->base = NULL;
+    t->check = NULL;
+    t->fin = NULL;
+    t->tam = 0;
+    t->salto = NULL;
+    t->cap_nodos = 1024;
+    t->nodos = malloc((size_t)t->cap_nodos * sizeof(NodoTrie));
+    if (!t->nodos) { perror("malloc"); exit(1); }
+    t->nodos[0].hijo = -1;
+    t->nodos[0].hermano = -1;
+    t->nodos[0].c = 0;
+    t->nodos[0].fin = 0;
+    t->num_nodos = 1;
+}
+
+/* Devuelve el hijo de v por c en el trie auxiliar, creandolo si no existe */
+static int trie_hijo(Trie *t, int v, unsigned char c) {
+    int ant = -1, h = t->nodos[v].hijo;
+
+    /* Los hijos estan ordenados por caracter para compactarlos en orden */
+    while (h >= 0 && t->nodos[h].c < c) {
+        ant = h;
+        h = t->nodos[h].hermano;
+    }
+    if (h >= 0 && t->nodos[h].c == c)
+        return h;
+
+    if (t->num_nodos == t->cap_nodos) {
+        t->cap_nodos *= 2;
+        t->nodos = realloc(t->nodos, (size_t)t->cap_nodos * sizeof(NodoTrie));
+        if (!t->nodos) { perror("realloc"); exit(1); }
+    }
+    int nuevo = t->num_nodos++;
+    t->nodos[nuevo].hijo = -1;
+    t->nodos[nuevo].hermano = h;
+    t->nodos[nuevo].c = c;
+    t->nodos[nuevo].fin = 0;
+    if (ant < 0)
+        t->nodos[v].hijo = nuevo;
+    else
+        t->nodos[ant].hermano = nuevo;
+    return nuevo;
+}
+
+/* Inserta una palabra en el trie auxiliar (antes de trie_compactar) */
+void trie_insertar(Trie *t, const char *palabra) {
+    int v = 0;
+    while (*palabra)
+        v = trie_hijo(t, v, (unsigned char)*palabra++);
+    t->nodos[v].fin = 1;
+}
+
+/* Amplia base, check y fin hasta al menos 'minimo' posiciones */
+static void trie_reservar(Trie *t, int minimo) {
+    if (minimo <= t->tam) return;
+    int nuevo = t->tam * 2 > minimo ? t->tam * 2 : minimo;
+    t->base = realloc(t->base, (size_t)nuevo * sizeof(int));
+    t->check = realloc(t->check, (size_t)nuevo * sizeof(int));
+    t->fin = realloc(t->fin, (size_t)nuevo);
+    t->salto = realloc(t->salto, (size_t)nuevo * sizeof(int));
+    if (!t->base || !t->check || !t->fin || !t->salto) { perror("realloc"); exit(1); }
+    int i;
+    for (i = t->tam; i < nuevo; i++) {
+        t->base[i] = 0;
+        t->check[i] = TRIE_LIBRE;
+        t->fin[i] = 0;
+        t->salto[i] = i;
+    }
+    t->tam = nuevo;
+}
+
+/*
+ * trie_libre_desde: Primera posicion libre >= p. Las ocupadas apuntan en
+ * salto[] a la siguiente, y los caminos se acortan al recorrerlos (como en
+ * union-find), para no revisar una y otra vez las zonas ya llenas.
+ */
+static int trie_libre_desde(Trie *t, int p) {
+    int r = p;
+    while (r < t->tam && t->salto[r] != r)
+        r = t->salto[r];
+    while (p < r) {
+        int sig = t->salto[p];
+        t->salto[p] = r;
+        p = sig;
+    }
+    return r;
+}
+
+/*
+ * trie_compactar: Pasa el trie auxiliar a doble array recorriendolo por
+ * niveles. Para cada nodo con hijos busca la primera base b >= 1 tal que las
+ * posiciones b + c de todos sus hijos esten libres, y libera el trie auxiliar.
+ * Se reservan siempre 256 posiciones tras cada base, de modo que base[s] + c
+ * nunca se sale de los arrays al consultar.
+ */
+void trie_compactar(Trie *t) {
+    int *estado = malloc((size_t)t->num_nodos * sizeof(int));
+    int *cola = malloc((size_t)t->num_nodos * sizeof(int));
+    if (!estado || !cola) { perror("malloc"); exit(1); }
+    int ini = 0, fin_cola = 0;
+    int inicio = 1;     /* Las busquedas de base empiezan aqui (ver abajo) */
+
+    trie_reservar(t, 512);
+    t->check[TRIE_RAIZ] = TRIE_RAIZ;
+    t->salto[TRIE_RAIZ] = TRIE_RAIZ + 1;
+    t->fin[TRIE_RAIZ] = t->nodos[0].fin;
+    estado[0] = TRIE_RAIZ;
+    cola[fin_cola++] = 0;
+
+    while (ini < fin_cola) {
+        int v = cola[ini++];
+        int s = estado[v];
+        int h;
+        if (t->nodos[v].hijo < 0) continue;  /* Hoja: base[s] se queda a 0 */
+
+        /* Solo se prueban bases que dejan al primer hijo en una posicion libre */
+        int primero = t->nodos[t->nodos[v].hijo].c;
+        int p = trie_libre_desde(t, inicio > primero + 1 ? inicio : primero + 1);
+        int b, fallos = 0;
+        for (;;) {
+            b = p - primero;
+            trie_reservar(t, b + 256 + 1);
+            for (h = t->nodos[v].hijo; h >= 0; h = t->nodos[h].hermano)
+                if (t->check[b + t->nodos[h].c] != TRIE_LIBRE) break;
+            if (h < 0) break;  /* Todos los hijos caben con esta base */
+            p = trie_libre_desde(t, p + 1);
+            fallos++;
+        }
+
+        /*
+         * Si ha costado mucho encontrar sitio, la zona anterior esta casi llena
+         * y solo quedan huecos sueltos: las siguientes busquedas empiezan en p.
+         * Se pierden esos huecos a cambio de no recorrerlos para cada nodo.
+         */
+        if (fallos > TRIE_MAX_FALLOS)
+            inicio = p;
+
+        t->base[s] = b;
+        for (h = t->nodos[v].hijo; h >= 0; h = t->nodos[h].hermano) {
+            int hijo = b + t->nodos[h].c;
+            t->check[hijo] = s;
+            t->salto[hijo] = hijo + 1;
+            t->fin[hijo] = t->nodos[h].fin;
+            estado[h] = hijo;
+            cola[fin_cola++] = h;
+        }
+    }
+
+    free(estado);
+    free(cola);
+    free(t->nodos);
+    free(t->salto);
+    t->nodos = NULL;
+    t->salto = NULL;
+}
+
+/*
+ * trie_paso: Avanza desde el estado s con el caracter c. Devuelve el nuevo
+ * estado, o -1 si ninguna palabra del diccionario continua por ese camino.
+ * (Una hoja tiene base 0 y ningun estado tiene check igual a ella.)
+ */
+static inline int trie_paso(const Trie *t, int s, unsigned char c) {
+    int sig = t->base[s] + c;
+    return t->check[sig] == s ? sig : -1;
+}
+
+/* Libera la memoria del trie */
+void trie_liberar(Trie *t) {
+    free(t->base);
+    free(t->check);
+    free(t->fin);
+    free(t->nodos);
+    free(t->salto);
+}
+
+/*
+ * Tabla hash con direccionamiento abierto (sondeo lineal, Robin Hood). Cada
+ * casilla guarda el hash completo, la longitud y la posicion de la palabra en
+ * un unico arena de texto, asi que una consulta recorre casillas contiguas y
+ * solo compara bytes cuando coinciden hash y longitud, sin seguir punteros ni
+ * hacer un malloc por palabra. Robin Hood: al insertar, una palabra le quita
+ * la casilla a otra que este mas cerca de su casilla inicial; asi las
+ * distancias quedan igualadas y una busqueda fallida puede parar en cuanto
+ * encuentra una casilla mas cerca de su inicio que lo ya recorrido. La tabla
+ * dobla su tamaño al superar 7/8 de ocupacion.
+ */
+
+typedef struct {
+    unsigned int hash;  /* djb2 de la palabra */
+    unsigned int pos;   /* Posicion de la palabra en el arena */
+    unsigned int len;   /* Longitud de la palabra (0 = casilla vacia) */
+} Casilla;
+
+/* Estructura del diccionario: tabla hash, arena de palabras y trie */
+typedef struct {
+    Casilla *casillas;
+    unsigned int mascara;   /* Numero de casillas - 1 */
+    int bits;               /* log2 del numero de casillas */
+    char *arena;            /* Palabras seguidas, cada una terminada en '\0' */
+    size_t arena_usado;
+    size_t arena_cap;
     int num_palabras;
+    int long_max;       /* Longitud de la palabra mas larga */
+    unsigned long long longitudes[MAX_PALABRA / 64];  /* Bit k: hay palabras de longitud k */
+    int busqueda;       /* BUSQUEDA_TRIE o BUSQUEDA_HASH */
+    Trie trie;          /* Las mismas palabras, para recorrer prefijos */
 } Diccionario;
 
 /*
- * hash: Calcula el indice del cubo para una cadena.
+ * hash: Calcula el hash de una cadena de longitud len.
  * Algoritmo djb2: h = 5381; para cada caracter: h = ((h << 5) + h) + c;
  */
-static unsigned long hash(const char *str) {
-    unsigned long h = 5381;
-    int c;
-    while ((c = (unsigned char)*str++))
-        h = ((h << 5) + h) + c;
-    return h % HASH_SIZE;
+static unsigned int hash(const char *str, int len) {
+    unsigned int h = 5381;
+    int i;
+    for (i = 0; i < len; i++)
+        h = ((h << 5) + h) + (unsigned char)str[i];
+    return h;
 }
 
-/* Inicializa el diccionario vacio (todas las listas a NULL) */
+/* Casilla inicial de un hash: los bits altos de h * (2^32 / phi) */
+static inline unsigned int casa(unsigned int h, int bits) {
+    return (h * 2654435769u) >> (32 - bits);
+}
+
+/* Distancia de la casilla i a la casilla inicial de su palabra */
+static inline unsigned int distancia(const Diccionario *d, unsigned int i) {
+    return (i - casa(d->casillas[i].hash, d->bits)) & d->mascara;
+}
+
+/* Inicializa el diccionario vacio */
 void dicc_iniciar(Diccionario *d) {
-    int i;
-    for (i = 0; i < HASH_SIZE; i++)
-        d->buckets[i] = NULL;
+    d->bits = 10;
+    d->mascara = TABLA_INICIAL - 1;
+    d->casillas = calloc(TABLA_INICIAL, sizeof(Casilla));
+    d->arena_cap = 16384;
+    d->arena = malloc(d->arena_cap);
+    if (!d->casillas || !d->arena) { perror("malloc"); exit(1); }
+    d->arena_usado = 0;
     d->num_palabras = 0;
+    d->long_max = 0;
+    memset(d->longitudes, 0, sizeof(d->longitudes));
+    d->busqueda = BUSQUEDA_TRIE;
+    trie_iniciar(&d->trie);
+}
+
+/*
+ * dicc_buscar: Devuelve 1 si palabra[0..len-1] esta en el diccionario, dado
+ * su hash h. No necesita que la palabra termine en '\0'.
+ */
+static int dicc_buscar(const Diccionario *d, const char *palabra, int len,
+                       unsigned int h) {
+    unsigned int i = casa(h, d->bits), dist;
+    for (dist = 0; ; dist++, i = (i + 1) & d->mascara) {
+        const Casilla *c = &d->casillas[i];
+        if (c->len == 0 || distancia(d, i) < dist)
+            return 0;  /* Vacia, o Robin Hood habria puesto aqui la palabra */
+        if (c->hash == h && c->len == (unsigned int)len &&
+            memcmp(d->arena + c->pos, palabra, (size_t)len) == 0)
+            return 1;
+    }
 }
 
 /* Devuelve 1 si la palabra esta en el diccionario, 0 si no */
 int dicc_contiene(const Diccionario *d, const char *palabra) {
-    unsigned long idx = hash(palabra);
-    NodoHash *n = d->buckets[idx];
-    while (n) {
-        if (strcmp(n->palabra, palabra) == 0)
-            return 1;
-        n = n->sig;
+    int len = (int)strlen(palabra);
+    return dicc_buscar(d, palabra, len, hash(palabra, len));
+}
+
+/* Coloca una casilla (que no esta en la tabla) con la regla de Robin Hood */
+static void dicc_colocar(Diccionario *d, Casilla nueva) {
+    unsigned int i = casa(nueva.hash, d->bits), dist;
+    for (dist = 0; ; dist++, i = (i + 1) & d->mascara) {
+        if (d->casillas[i].len == 0) {
+            d->casillas[i] = nueva;
+            return;
+        }
+        unsigned int otra = distancia(d, i);
+        if (otra < dist) {
+            /* La que estaba aqui queda mas cerca de su inicio: se la desplaza */
+            Casilla tmp = d->casillas[i];
+            d->casillas[i] = nueva;
+            nueva = tmp;
+            dist = otra;
+        }
     }
-    return 0;
 }
 
-/* Inserta una nueva palabra en el diccionario (al inicio de la lista del cubo) */
+/* Dobla el numero de casillas y recoloca todas las palabras */
+static void dicc_crecer(Diccionario *d) {
+    Casilla *viejas = d->casillas;
+    unsigned int i, num_viejas = d->mascara + 1;
+
+    d->bits++;
+    d->mascara = (d->mascara << 1) | 1;
+    d->casillas = calloc((size_t)d->mascara + 1, sizeof(Casilla));
+    if (!d->casillas) { perror("malloc"); exit(1); }
+    for (i = 0; i < num_viejas; i++)
+        if (viejas[i].len > 0)
+            dicc_colocar(d, viejas[i]);
+    free(viejas);
+}
+
+/* Inserta una nueva palabra en el diccionario (las repetidas se ignoran) */
 void dicc_insertar(Diccionario *d, const char *palabra) {
-    unsigned long idx = hash(palabra);
-    NodoHash *n = malloc(sizeof(NodoHash));
-    if (!n) { perror("malloc"); exit(1); }
-    n->palabra = strdup(palabra);
-    n->sig = d->buckets[idx];
-    d->buckets[idx] = n;
+    int len = (int)strlen(palabra);
+    unsigned int h = hash(palabra, len);
+    if (dicc_buscar(d, palabra, len, h)) return;
+
+    if ((size_t)(d->num_palabras + 1) * 8 > (size_t)(d->mascara + 1) * 7)
+        dicc_crecer(d);
+
+    /* Copiar la palabra (con su '\0') al final del arena */
+    if (d->arena_usado + (size_t)len + 1 > d->arena_cap) {
+        while (d->arena_usado + (size_t)len + 1 > d->arena_cap)
+            d->arena_cap *= 2;
+        d->arena = realloc(d->arena, d->arena_cap);
+        if (!d->arena) { perror("realloc"); exit(1); }
+    }
+    memcpy(d->arena + d->arena_usado, palabra, (size_t)len + 1);
+
+    Casilla c = { h, (unsigned int)d->arena_usado, (unsigned int)len };
+    d->arena_usado += (size_t)len + 1;
+    dicc_colocar(d, c);
     d->num_palabras++;
+    if (len > d->long_max)
+        d->long_max = len;
+    d->longitudes[len / 64] |= 1ULL << (len % 64);
+    trie_insertar(&d->trie, palabra);
 }
 
 /* Libera toda la memoria utilizada por el diccionario */
 void dicc_liberar(Diccionario *d) {
-    int i;
-    for (i = 0; i < HASH_SIZE; i++) {
-        NodoHash *n = d->buckets[i];
-        while (n) {
-            NodoHash *sig = n->sig;
-            free(n->palabra);
-            free(n);
-            n = sig;
+    free(d->casillas);
+    free(d->arena);
+    trie_liberar(&d->trie);
+}
+
+/*
+ * Recorrido de los prefijos de texto[i..fin-1] que son palabras, en orden
+ * creciente de longitud. Es la unica forma en que las variantes consultan el
+ * diccionario, y tiene dos implementaciones que dan los mismos finales:
+ *   - BUSQUEDA_TRIE: avanza un estado del trie por caracter y termina en
+ *     cuanto ninguna palabra empieza por el prefijo.
+ *   - BUSQUEDA_HASH: extiende el hash djb2 del prefijo un caracter cada vez
+ *     (h = h * 33 + c, sin copiar ni recalcular el prefijo) y solo consulta la
+ *     tabla en las longitudes que tiene alguna palabra; termina en long_max.
+ */
+typedef struct {
+    const Diccionario *dicc;
+    const char *texto;
+    long i;             /* Inicio del prefijo */
+    long j;             /* Ultimo caracter del prefijo ya examinado */
+    long fin;           /* No se pasa de texto[fin-1] */
+    int s;              /* Estado del trie para texto[i..j] */
+    unsigned int h;     /* Hash de texto[i..j] */
+} Prefijos;
+
+static inline void prefijos_iniciar(Prefijos *p, const Diccionario *d,
+                                    const char *texto, long i, long fin) {
+    p->dicc = d;
+    p->texto = texto;
+    p->i = i;
+    p->j = i - 1;
+    p->fin = fin;
+    p->s = TRIE_RAIZ;
+    p->h = 5381;
+    if (d->busqueda == BUSQUEDA_HASH && i + d->long_max < fin)
+        p->fin = i + d->long_max;
+}
+
+/* Devuelve el siguiente j tal que texto[i..j] es palabra, o -1 si no quedan */
+static inline long prefijos_siguiente(Prefijos *p) {
+    const Diccionario *d = p->dicc;
+    if (d->busqueda == BUSQUEDA_TRIE) {
+        while (++p->j < p->fin) {
+            p->s = trie_paso(&d->trie, p->s, (unsigned char)p->texto[p->j]);
+            if (p->s < 0) break;  /* Ninguna palabra empieza por texto[i..j] */
+            if (d->trie.fin[p->s])
+                return p->j;
+        }
+    } else {
+        while (++p->j < p->fin) {
+            long len = p->j - p->i + 1;
+            p->h = ((p->h << 5) + p->h) + (unsigned char)p->texto[p->j];
+            if ((d->longitudes[len / 64] >> (len % 64) & 1) &&
+                dicc_buscar(d, p->texto + p->i, (int)len, p->h))
+                return p->j;
         }
     }
+    p->j = p->fin;
+    return -1;
 }
 
 /*
  * =============================================================================
- * SECCION 2: ESTRUCTURAS PARA ALMACENAR PARTICIONES
+ * SECCION 2: SALIDA DE PARTICIONES
  * =============================================================================
  *
  * Una particion es una forma de segmentar la cadena, ej: "me gusta soldar".
- * El resultado puede tener varias particiones posibles (ej: "me gusta sol dar").
- * ListaParticiones guarda todas las cadenas con las particiones encontradas.
+ * El resultado puede tener varias particiones posibles (ej: "me gusta sol dar")
+ * y su numero puede crecer exponencialmente, asi que no se guardan: cada una
+ * se escribe en cuanto se encuentra. Salida lleva la cuenta para saltar las
+ * primeras (--desde) y dejar de buscar tras escribir las pedidas (--limite).
  * =============================================================================
  */
 
 typedef struct {
-    char *lineas[MAX_PARTICIONES];  /* Array de cadenas, cada una es una particion */
-    int n;                           /* Numero de particiones almacenadas */
-} ListaParticiones;
+    unsigned long long desde;     /* Particiones a saltar antes de escribir */
+    unsigned long long limite;    /* Maximo de particiones a escribir (0 = todas) */
+    unsigned long long vistas;    /* Particiones encontradas hasta ahora */
+    unsigned long long escritas;  /* Particiones escritas */
+    int hay_mas;                  /* 1 si quedaron particiones sin escribir por el limite */
+} Salida;
 
-/* Inicializa la lista vacia */
-void lista_particiones_init(ListaParticiones *lp) {
-    lp->n = 0;
-}
-
-/* Aniade una nueva particion a la lista (hace copia con strdup) */
-void lista_particiones_append(ListaParticiones *lp, const char *s) {
-    if (lp->n >= MAX_PARTICIONES) return;
-    lp->lineas[lp->n] = strdup(s);
-    lp->n++;
+/*
+ * salida_completa: Se llama al encontrar una particion, antes de escribirla.
+ * Devuelve 1 si ya se escribieron todas las pedidas (y anota que hay mas).
+ */
+static int salida_completa(Salida *sal) {
+    if (sal->limite > 0 && sal->escritas == sal->limite) {
+        sal->hay_mas = 1;
+        return 1;
+    }
+    return 0;
 }
 
-/* Libera la memoria de todas las particiones almacenadas */
-void lista_particiones_liberar(ListaParticiones *lp) {
-    int i;
-    for (i = 0; i < lp->n; i++)
-        free(lp->lineas[i]);
+/* Escribe la particion si le toca. Devuelve 0 si hay que dejar de buscar */
+static int salida_escribir(Salida *sal, const char *particion) {
+    if (salida_completa(sal)) return 0;
+    if (sal->vistas++ >= sal->desde) {
+        printf(" - '%s'\n", particion);
+        sal->escritas++;
+    }
+    return 1;
 }
 
 /*
@@ -191,6 +582,10 @@ void lista_particiones_liberar(ListaParticiones *lp) {
  * Es decir: el sufijo texto[i..n-1] se puede particionar si existe algun j
  * tal que el prefijo texto[i..j] es una palabra del diccionario y el resto
  * texto[j+1..n-1] tambien se puede particionar.
+ *
+ * Los j candidatos se obtienen con Prefijos (seccion 1) en orden creciente de
+ * j, asi que solo se prueban los j en los que acaba una palabra y el bucle
+ * nunca pasa de L caracteres, sin llegar hasta n-1.
  * =============================================================================
  */
 
@@ -203,20 +598,14 @@ static int puede_recursivo(const char *texto, int n, int i,
     /* Caso base: cadena vacia siempre se puede "particionar" (ya terminamos) */
     if (i >= n) return 1;
 
+    Prefijos pr;
     int j;
-    char buf[MAX_PALABRA];
-
-    /* Probar todos los prefijos posibles texto[i..j] */
-    for (j = i; j < n; j++) {
-        int len = j - i + 1;
-        if (len >= MAX_PALABRA) continue;
 
-        /* Extraer el prefijo texto[i..j] a un buffer */
-        strncpy(buf, texto + i, len);
-        buf[len] = '\0';
-
-        /* Si este prefijo es palabra del diccionario Y el resto se puede particionar */
-        if (dicc_contiene(dicc, buf) && puede_recursivo(texto, n, j + 1, dicc))
+    /* Probar los prefijos texto[i..j] que son palabras del diccionario */
+    prefijos_iniciar(&pr, dicc, texto, i, n);
+    while ((j = prefijos_siguiente(&pr)) >= 0) {
+        /* Si el resto se puede particionar */
+        if (puede_recursivo(texto, n, j + 1, dicc))
             return 1;
     }
     return 0;  /* Ningun prefijo valido encontrado */
@@ -225,47 +614,43 @@ static int puede_recursivo(const char *texto, int n, int i,
 /*
  * particiones_recursivo: Construye TODAS las particiones posibles mediante
  * backtracking. Para cada prefijo valido, lo añaade a 'actual' y explora
- * recursivamente el resto. Cuando se llega al final (i >= n), guarda la
- * particion completa en resultado.
+ * recursivamente el resto. Cuando se llega al final (i >= n), pasa la
+ * particion completa a la salida.
  *
  * actual: buffer donde se construye la particion actual (ej: "me gusta ")
  * pos_actual: posicion donde continuar escribiendo en actual
+ * Devuelve 0 cuando ya se han escrito todas las particiones pedidas.
  */
-static void particiones_recursivo(const char *texto, int n, int i,
-                                  const Diccionario *dicc, char *actual,
-                                  int pos_actual, ListaParticiones *resultado) {
+static int particiones_recursivo(const char *texto, int n, int i,
+                                 const Diccionario *dicc, char *actual,
+                                 int pos_actual, Salida *salida) {
     if (i >= n) {
         /* Caso base: hemos terminado de construir una particion */
         actual[pos_actual] = '\0';
-        lista_particiones_append(resultado, actual);
-        return;
+        return salida_escribir(salida, actual);
     }
 
-    char buf[MAX_PALABRA];
+    Prefijos pr;
     int j;
 
     /* Probar cada prefijo texto[i..j] que este en el diccionario */
-    for (j = i; j < n; j++) {
+    prefijos_iniciar(&pr, dicc, texto, i, n);
+    while ((j = prefijos_siguiente(&pr)) >= 0) {
         int len = j - i + 1;
-        if (len >= MAX_PALABRA) continue;
+        int nueva_pos = pos_actual;
 
-        strncpy(buf, texto + i, len);
-        buf[len] = '\0';
+        /* Separador entre palabras (espacio), salvo antes de la primera */
+        if (nueva_pos > 0)
+            actual[nueva_pos++] = ' ';
 
-        if (dicc_contiene(dicc, buf)) {
-            int nueva_pos = pos_actual;
+        /* Copiar la palabra al buffer y continuar con el sufijo */
+        memcpy(actual + nueva_pos, texto + i, len);
+        nueva_pos += len;
 
-            /* Separador entre palabras (espacio), salvo antes de la primera */
-            if (nueva_pos > 0)
-                actual[nueva_pos++] = ' ';
-
-            /* Copiar la palabra al buffer y continuar con el sufijo */
-            strcpy(actual + nueva_pos, buf);
-            nueva_pos += len;
-
-            particiones_recursivo(texto, n, j + 1, dicc, actual, nueva_pos, resultado);
-        }
+        if (!particiones_recursivo(texto, n, j + 1, dicc, actual, nueva_pos, salida))
+            return 0;
     }
+    return 1;
 }
 
 /*
@@ -277,9 +662,10 @@ static void particiones_recursivo(const char *texto, int n, int i,
  * para evitar recalcular el mismo subproblema. Antes de calcular, se consulta
  * la tabla; si ya esta calculado, se devuelve directamente.
  *
- * Esto reduce la complejidad de exponencial a O(n^2) en tiempo, ya que hay
- * como maximo n subproblemas distintos (uno por cada indice i) y cada uno
- * se calcula una sola vez. Memoria adicional: O(n).
+ * Esto reduce la complejidad de exponencial a O(n*L) en tiempo, ya que hay
+ * como maximo n subproblemas distintos (uno por cada indice i), cada uno se
+ * calcula una sola vez y su recorrido del trie avanza como mucho L caracteres
+ * (L = longitud de la palabra mas larga). Memoria adicional: O(n).
  *
  * La construccion de particiones sigue siendo recursiva (igual que variante 1);
  * la memoizacion solo acelera la decision "¿se puede particionar?".
@@ -299,16 +685,12 @@ static int puede_memo(const char *texto, int n, int i, const Diccionario *dicc,
     /* Si ya lo calculamos antes, devolver el valor almacenado */
     if (mem[i] != MEM_UNSET) return mem[i];
 
+    Prefijos pr;
     int j;
-    char buf[MAX_PALABRA];
-
-    for (j = i; j < n; j++) {
-        int len = j - i + 1;
-        if (len >= MAX_PALABRA) continue;
-        strncpy(buf, texto + i, len);
-        buf[len] = '\0';
 
-        if (dicc_contiene(dicc, buf) && puede_memo(texto, n, j + 1, dicc, mem)) {
+    prefijos_iniciar(&pr, dicc, texto, i, n);
+    while ((j = prefijos_siguiente(&pr)) >= 0) {
+        if (puede_memo(texto, n, j + 1, dicc, mem)) {
             mem[i] = 1;  /* Guardar resultado para futuras consultas */
             return 1;
         }
@@ -320,9 +702,8 @@ static int puede_memo(const char *texto, int n, int i, const Diccionario *dicc,
 
 /* Construye las particiones usando la misma logica recursiva que la variante 1 */
 static void particiones_con_memo(const char *texto, int n, const Diccionario *dicc,
-                                 ListaParticiones *resultado) {
-    char actual[MAX_TEXTO];
-    particiones_recursivo(texto, n, 0, dicc, actual, 0, resultado);
+                                 char *actual, Salida *salida) {
+    particiones_recursivo(texto, n, 0, dicc, actual, 0, salida);
 }
 
 /*
@@ -340,7 +721,11 @@ static void particiones_con_memo(const char *texto, int n, const Diccionario *di
  *
  * Orden de calculo: i = n-1, n-2, ..., 1, 0 (de derecha a izquierda)
  *
- * Coste: O(n^2) en tiempo, O(n) en espacio para la tabla.
+ * Coste: O(n*L) en tiempo (L = longitud de la palabra mas larga, gracias al
+ * recorrido del trie), O(n) en espacio para la tabla.
+ *
+ * Las particiones se listan recorriendo el grafo de particiones que se
+ * construye a partir de la tabla (seccion 8).
  * Es la version mas eficiente ya que evita la sobrecarga de llamadas recursivas.
  * =============================================================================
  */
@@ -353,22 +738,17 @@ static void particiones_con_memo(const char *texto, int n, const Diccionario *di
 static void llenar_tabla(const char *texto, int n, const Diccionario *dicc,
                          int *posible) {
     int i, j;
-    char buf[MAX_PALABRA];
     posible[n] = 1;  /* Caso base: sufijo vacio siempre particionable */
 
     /* Rellenar de atras hacia adelante (i = n-1 hasta 0) */
     for (i = n - 1; i >= 0; i--) {
+        Prefijos pr;
         posible[i] = 0;
 
-        for (j = i; j < n; j++) {
-            int len = j - i + 1;
-            if (len >= MAX_PALABRA) continue;
-
-            strncpy(buf, texto + i, len);
-            buf[len] = '\0';
-
+        prefijos_iniciar(&pr, dicc, texto, i, n);
+        while ((j = prefijos_siguiente(&pr)) >= 0) {
             /* Si texto[i..j] es palabra Y texto[j+1..n-1] se puede particionar */
-            if (dicc_contiene(dicc, buf) && posible[j + 1]) {
+            if (posible[j + 1]) {
                 posible[i] = 1;
                 break;  /* Basta con una opcion valida */
             }
@@ -377,50 +757,567 @@ static void llenar_tabla(const char *texto, int n, const Diccionario *dicc,
 }
 
 /*
- * particiones_tabla_aux: Construye las particiones usando la tabla 'posible'
- * como guia. Solo explora ramas donde posible[i]=1 (evita ramas muertas).
- * La construccion es recursiva/backtracking igual que en variantes 1 y 2.
+ * =============================================================================
+ * SECCION 6: VARIANTE 4 - SEGMENTACION EN FLUJO
+ * =============================================================================
+ *
+ * Pensada para textos de varios megas (registros, OCR...) que no conviene
+ * cargar enteros, o que llegan por la entrada estandar. El texto se lee por
+ * bloques y la tabla se rellena hacia delante:
+ *
+ *   alcanzable[k] = 1 si texto[0..k-1] se puede particionar
+ *
+ * Punto de corte: posicion c alcanzable tal que ninguna palabra que empieza en
+ * una posicion alcanzable anterior a c termina despues de c. Entonces toda
+ * particion del texto completo pasa por c, y el tramo anterior a c se puede
+ * escribir ya y olvidar. Solo se guarda el texto desde el ultimo corte mas
+ * las L letras siguientes, asi que la memoria no depende de la longitud total.
+ *
+ * Cada tramo se escribe eligiendo en cada paso la palabra mas corta desde la
+ * que se llega al corte, igual que la primera particion que listan las otras
+ * variantes. Si el texto es ambiguo durante mas de MAX_PENDIENTE caracteres
+ * seguidos (sin ningun corte) se aborta, en lugar de crecer sin limite.
+ *
+ * Salida: las palabras separadas por espacios segun se van fijando y una linea
+ * final "Si." o "No."; si es "No.", lo escrito es la particion del texto hasta
+ * el ultimo corte encontrado.
+ * =============================================================================
  */
-static void particiones_tabla_aux(const char *texto, int n, int i,
-                                 const Diccionario *dicc, const int *posible,
-                                 char *actual, int pos_actual,
-                                 ListaParticiones *resultado) {
-    if (i >= n) {
-        actual[pos_actual] = '\0';
-        lista_particiones_append(resultado, actual);
+
+/* Ventana de la variante 4: texto desde el ultimo corte y su tabla */
+typedef struct {
+    FILE *f;
+    char *texto;        /* texto[ini + k] es el caracter base + k */
+    char *alcanzable;   /* alcanzable[ini + k] para la posicion base + k (len + 1 entradas) */
+    char *llega;        /* Auxiliar para escribir un tramo */
+    long ini;           /* Inicio de la ventana dentro de los arrays */
+    long base;          /* Posicion absoluta del ultimo corte */
+    long len;           /* Caracteres en la ventana */
+    long cap;           /* Capacidad de los arrays */
+    int fin_fichero;
+    long palabras;      /* Palabras ya escritas */
+} Flujo;
+
+/* Lee el siguiente bloque del fichero y lo aniade sin blancos a la ventana */
+static void flujo_leer(Flujo *fl) {
+    char bloque[BLOQUE_FLUJO];
+
+    /* Lo ya escrito debe salir antes de que la lectura pueda bloquearse */
+    fflush(stdout);
+    size_t leidos = fread(bloque, 1, sizeof(bloque), fl->f);
+    if (leidos == 0) {
+        fl->fin_fichero = 1;
         return;
     }
 
-    /* Optimizacion: si la tabla dice que no se puede, no explorar */
-    if (!posible[i]) return;
-    char buf[MAX_PALABRA];
-    int j;
-    for (j = i; j < n; j++) {
-        int len = j - i + 1;
-        if (len >= MAX_PALABRA) continue;
-        strncpy(buf, texto + i, len);
-        buf[len] = '\0';
-        if (dicc_contiene(dicc, buf) && posible[j + 1]) {
-            int nueva_pos = pos_actual;
-            if (nueva_pos > 0) actual[nueva_pos++] = ' ';
-            strcpy(actual + nueva_pos, buf);
-            nueva_pos += len;
-            particiones_tabla_aux(texto, n, j + 1, dicc, posible, actual,
-                                  nueva_pos, resultado);
+    /* Los cortes solo avanzan ini; la ventana se lleva al principio aqui */
+    if (fl->ini > 0) {
+        memmove(fl->texto, fl->texto + fl->ini, (size_t)fl->len);
+        memmove(fl->alcanzable, fl->alcanzable + fl->ini, (size_t)fl->len + 1);
+        fl->ini = 0;
+    }
+    if (fl->len + (long)leidos > fl->cap) {
+        long nueva = fl->cap * 2 > fl->len + (long)leidos ? fl->cap * 2 : fl->len + (long)leidos;
+        fl->texto = realloc(fl->texto, (size_t)nueva);
+        fl->alcanzable = realloc(fl->alcanzable, (size_t)nueva + 1);
+        fl->llega = realloc(fl->llega, (size_t)nueva + 1);
+        if (!fl->texto || !fl->alcanzable || !fl->llega) { perror("realloc"); exit(1); }
+        fl->cap = nueva;
+    }
+
+    size_t i;
+    for (i = 0; i < leidos; i++) {
+        char c = bloque[i];
+        if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+            continue;  /* Omitir blancos, igual que cargar_texto */
+        fl->texto[fl->len++] = c;
+        fl->alcanzable[fl->len] = 0;  /* ini es 0 tras la compactacion */
+    }
+}
+
+/*
+ * flujo_escribir_tramo: Escribe la particion de texto[0..c-1], siendo c un
+ * punto de corte, y desplaza la ventana para que empiece en c.
+ * llega[i] = 1 si desde i se puede llegar hasta c con palabras del diccionario.
+ */
+static void flujo_escribir_tramo(Flujo *fl, const Diccionario *dicc, long c) {
+    const char *texto = fl->texto + fl->ini;
+    const char *alcanzable = fl->alcanzable + fl->ini;
+    Prefijos pr;
+    long i, j;
+
+    fl->llega[c] = 1;
+    for (i = c - 1; i >= 0; i--) {
+        fl->llega[i] = 0;
+        if (!alcanzable[i]) continue;  /* La escritura nunca pasa por i */
+        prefijos_iniciar(&pr, dicc, texto, i, c);
+        while ((j = prefijos_siguiente(&pr)) >= 0) {
+            if (fl->llega[j + 1]) {
+                fl->llega[i] = 1;
+                break;
+            }
+        }
+    }
+
+    /* En cada paso, la palabra mas corta que permite llegar al corte */
+    for (i = 0; i < c; i = j + 1) {
+        prefijos_iniciar(&pr, dicc, texto, i, c);
+        do
+            j = prefijos_siguiente(&pr);
+        while (!fl->llega[j + 1]);
+        if (fl->palabras++ > 0)
+            putchar(' ');
+        fwrite(texto + i, 1, (size_t)(j - i + 1), stdout);
+    }
+
+    fl->ini += c;
+    fl->len -= c;
+    fl->base += c;
+}
+
+/*
+ * segmentar_flujo: Variante 4 completa (lectura, tabla y salida).
+ * Devuelve 0 si termina (con "Si." o "No."), 1 si hay error.
+ */
+static int segmentar_flujo(const char *fichero, const Diccionario *dicc) {
+    Flujo fl;
+    fl.f = strcmp(fichero, "-") == 0 ? stdin : fopen(fichero, "r");
+    if (!fl.f) {
+        fprintf(stderr, "Error: no se pudo abrir el texto '%s'\n", fichero);
+        return 1;
+    }
+    fl.cap = BLOQUE_FLUJO;
+    fl.texto = malloc((size_t)fl.cap);
+    fl.alcanzable = malloc((size_t)fl.cap + 1);
+    fl.llega = malloc((size_t)fl.cap + 1);
+    if (!fl.texto || !fl.alcanzable || !fl.llega) { perror("malloc"); exit(1); }
+    fl.ini = 0;
+    fl.base = 0;
+    fl.len = 0;
+    fl.fin_fichero = 0;
+    fl.palabras = 0;
+    fl.alcanzable[0] = 1;  /* El prefijo vacio siempre se puede particionar */
+
+    /* Hacen falta las L letras siguientes a p para conocer sus palabras */
+    long L = dicc->long_max > 0 ? dicc->long_max : 1;
+    long p = 0;         /* Siguiente posicion a procesar */
+    long max_fin = 0;   /* Mayor final de palabra desde posiciones alcanzables < p */
+    int error = 0;
+
+    for (;;) {
+        while (!fl.fin_fichero && fl.base + fl.len < p + L)
+            flujo_leer(&fl);
+        long k = p - fl.base;
+        if (k == fl.len) break;  /* Fin del texto */
+        char *texto = fl.texto + fl.ini;
+        char *alcanzable = fl.alcanzable + fl.ini;
+
+        if (max_fin <= p) {
+            if (!alcanzable[k]) break;  /* Nada alcanzable desde p: No */
+            if (k > 0) {
+                flujo_escribir_tramo(&fl, dicc, k);  /* p es punto de corte */
+                texto += k;
+                alcanzable += k;
+                k = 0;
+            }
+        }
+        if (k > MAX_PENDIENTE) {
+            fprintf(stderr, "Error: mas de %d caracteres sin punto de corte, texto demasiado ambiguo para la variante 4\n",
+                    MAX_PENDIENTE);
+            error = 1;
+            break;
+        }
+
+        /* Marcar los finales de las palabras que empiezan en p */
+        if (alcanzable[k]) {
+            Prefijos pr;
+            long j;
+            prefijos_iniciar(&pr, dicc, texto, k, fl.len);
+            while ((j = prefijos_siguiente(&pr)) >= 0) {
+                alcanzable[j + 1] = 1;
+                if (fl.base + j + 1 > max_fin)
+                    max_fin = fl.base + j + 1;
+            }
         }
+        p++;
+    }
+
+    if (!error) {
+        long k = p - fl.base;
+        int puede = fl.fin_fichero && k == fl.len && fl.alcanzable[fl.ini + k];
+        if (puede && k > 0)
+            flujo_escribir_tramo(&fl, dicc, k);
+        if (fl.palabras > 0)
+            putchar('\n');
+        printf(puede ? "Si.\n" : "No.\n");
     }
+
+    if (fl.f != stdin)
+        fclose(fl.f);
+    free(fl.texto);
+    free(fl.alcanzable);
+    free(fl.llega);
+    return error;
 }
 
 /*
  * =============================================================================
- * SECCION 6: CARGA DE FICHEROS
+ * SECCION 7: CONTEO DE PARTICIONES (--contar)
+ * =============================================================================
+ *
+ * Cuando solo interesa cuantas particiones hay, no hace falta construirlas
+ * (su numero puede crecer exponencialmente con n). Se usa la misma
+ * recurrencia que llenar_tabla, pero sumando en vez de hacer OR, y hacia
+ * delante:
+ *
+ *   cuenta[0] = 1
+ *   para cada palabra texto[i..j]:  cuenta[j+1] += cuenta[i]
+ *
+ * y el resultado es cuenta[n]. Como una palabra mide como mucho L letras,
+ * solo hacen falta L+1 posiciones de cuenta a la vez (se usan en anillo).
+ *
+ * Primero se cuenta con enteros de 128 bits que se saturan en lugar de
+ * desbordarse: O(n*L) operaciones. Solo si se satura se repite el conteo con
+ * numeros de precision arbitraria, cuyo coste crece con el numero de cifras.
+ * =============================================================================
+ */
+
+#ifdef __SIZEOF_INT128__
+__extension__ typedef unsigned __int128 Cuenta;
+#else
+typedef unsigned long long Cuenta;  /* Sin enteros de 128 bits: satura antes */
+#endif
+
+#define CUENTA_MAX ((Cuenta)~(Cuenta)0)
+
+/* Suma saturada: a + b, o CUENTA_MAX (y *exacto = 0) si no cabe */
+static inline Cuenta cuenta_sumar(Cuenta a, Cuenta b, int *exacto) {
+    if (a > CUENTA_MAX - b) {
+        *exacto = 0;
+        return CUENTA_MAX;
+    }
+    return a + b;
+}
+
+/*
+ * contar_particiones: Cuenta las particiones de texto[0..n-1] con
+ * aritmetica saturada. Devuelve 1 si el resultado es exacto y 0 si se saturo.
+ */
+static int contar_particiones(const char *texto, int n, const Diccionario *dicc,
+                              Cuenta *total) {
+    int R = dicc->long_max + 1;  /* Tamaño del anillo */
+    Cuenta *cuenta = calloc((size_t)R, sizeof(Cuenta));
+    if (!cuenta) { perror("malloc"); exit(1); }
+    int exacto = 1;
+    int i, j;
+
+    cuenta[0] = 1;
+    for (i = 0; i < n; i++) {
+        Cuenta c = cuenta[i % R];
+        cuenta[i % R] = 0;  /* Esta casilla pasa a ser la posicion i + R */
+        if (c == 0) continue;
+
+        Prefijos pr;
+        prefijos_iniciar(&pr, dicc, texto, i, n);
+        while ((j = prefijos_siguiente(&pr)) >= 0)
+            cuenta[(j + 1) % R] = cuenta_sumar(cuenta[(j + 1) % R], c, &exacto);
+    }
+
+    *total = cuenta[n % R];
+    free(cuenta);
+    return exacto;
+}
+
+/* Escribe una Cuenta en decimal */
+static void imprimir_cuenta(Cuenta c) {
+    char buf[48];
+    int i = sizeof(buf) - 1;
+    buf[i] = '\0';
+    do {
+        buf[--i] = (char)('0' + (int)(c % 10));
+        c /= 10;
+    } while (c > 0);
+    fputs(buf + i, stdout);
+}
+
+/* Natural de precision arbitraria: cifras en base 10^9, menos significativa primero */
+typedef struct {
+    unsigned int *cifras;
+    int n;
+    int cap;
+} Grande;
+
+#define GRANDE_BASE 1000000000u
+
+/* a += b */
+static void grande_sumar(Grande *a, const Grande *b) {
+    int i;
+    if (a->cap < b->n + 1) {
+        a->cap = b->n + 1 > a->cap * 2 ? b->n + 1 : a->cap * 2;
+        a->cifras = realloc(a->cifras, (size_t)a->cap * sizeof(unsigned int));
+        if (!a->cifras) { perror("realloc"); exit(1); }
+    }
+    for (i = a->n; i < b->n; i++)
+        a->cifras[i] = 0;
+    if (a->n < b->n)
+        a->n = b->n;
+
+    unsigned int acarreo = 0;
+    for (i = 0; i < a->n && (i < b->n || acarreo); i++) {
+        unsigned int v = a->cifras[i] + (i < b->n ? b->cifras[i] : 0) + acarreo;
+        acarreo = v >= GRANDE_BASE;
+        a->cifras[i] = acarreo ? v - GRANDE_BASE : v;
+    }
+    if (acarreo)
+        a->cifras[a->n++] = 1;
+}
+
+/* Escribe un Grande en decimal */
+static void imprimir_grande(const Grande *g) {
+    int i;
+    if (g->n == 0) {
+        putchar('0');
+        return;
+    }
+    printf("%u", g->cifras[g->n - 1]);
+    for (i = g->n - 2; i >= 0; i--)
+        printf("%09u", g->cifras[i]);
+}
+
+/* contar_particiones_exacto: Igual que contar_particiones, con Grande */
+static void contar_particiones_exacto(const char *texto, int n, const Diccionario *dicc) {
+    int R = dicc->long_max + 1;
+    Grande *cuenta = calloc((size_t)R, sizeof(Grande));
+    if (!cuenta) { perror("malloc"); exit(1); }
+    int i, j;
+
+    Grande uno = { (unsigned int[]){ 1 }, 1, 1 };
+    grande_sumar(&cuenta[0], &uno);
+    for (i = 0; i < n; i++) {
+        Grande *c = &cuenta[i % R];
+        if (c->n > 0) {
+            Prefijos pr;
+            prefijos_iniciar(&pr, dicc, texto, i, n);
+            while ((j = prefijos_siguiente(&pr)) >= 0)
+                grande_sumar(&cuenta[(j + 1) % R], c);
+        }
+        c->n = 0;  /* Se conserva la memoria para la posicion i + R */
+    }
+
+    imprimir_grande(&cuenta[n % R]);
+    for (i = 0; i < R; i++)
+        free(cuenta[i].cifras);
+    free(cuenta);
+}
+
+/*
+ * =============================================================================
+ * SECCION 8: GRAFO DE PARTICIONES E ITERADOR (VARIANTE 3 Y --dag)
+ * =============================================================================
+ *
+ * Todas las particiones caben en un grafo aciclico: un nodo por posicion
+ * 0..n y una arista i -> j+1 por cada palabra texto[i..j] con posible[j+1].
+ * Cada particion es un camino de 0 a n. El grafo ocupa O(n*L) aunque el
+ * numero de caminos sea exponencial, y --dag lo escribe tal cual.
+ *
+ * La variante 3 lista las particiones con un iterador que recorre los caminos
+ * en profundidad con una pila de aristas (O(n)) y escribe cada uno al llegar
+ * a n, en el mismo orden que las variantes 1 y 2. Como toda arista lleva a un
+ * nodo desde el que se llega a n, pasar de una particion a la siguiente nunca
+ * explora ramas muertas. Ademas, con caminos[i] (particiones de texto[i..n-1],
+ * la cuenta de --contar hecha hacia atras) el iterador salta las --desde
+ * primeras sin recorrerlas: en cada nodo descarta de golpe las aristas cuyos
+ * caminos quedan por delante de la pedida.
+ * =============================================================================
+ */
+
+typedef struct {
+    int n;
+    int *inicio;        /* Aristas del nodo i: destino[inicio[i] .. fin[i]-1] */
+    int *fin;
+    int *destino;       /* Destinos de cada nodo en orden creciente */
+    int num_aristas;
+    int cap_aristas;
+    Cuenta *caminos;    /* caminos[i]: caminos de i a n (saturado a CUENTA_MAX) */
+} Grafo;
+
+/* Construye el grafo a partir de la tabla posible[] de la variante 3 */
+static void grafo_construir(const char *texto, int n, const Diccionario *dicc,
+                            const int *posible, Grafo *g) {
+    int i, j, exacto = 1;
+    g->n = n;
+    g->inicio = malloc((size_t)(n + 1) * sizeof(int));
+    g->fin = malloc((size_t)(n + 1) * sizeof(int));
+    g->caminos = malloc((size_t)(n + 1) * sizeof(Cuenta));
+    g->cap_aristas = n + 1;
+    g->destino = malloc((size_t)g->cap_aristas * sizeof(int));
+    if (!g->inicio || !g->fin || !g->caminos || !g->destino) { perror("malloc"); exit(1); }
+    g->num_aristas = 0;
+
+    g->inicio[n] = g->fin[n] = 0;
+    g->caminos[n] = 1;
+    for (i = n - 1; i >= 0; i--) {
+        Prefijos pr;
+        g->inicio[i] = g->num_aristas;
+        g->caminos[i] = 0;
+        prefijos_iniciar(&pr, dicc, texto, i, posible[i] ? n : i);
+        while ((j = prefijos_siguiente(&pr)) >= 0) {
+            if (!posible[j + 1]) continue;
+
+            if (g->num_aristas == g->cap_aristas) {
+                g->cap_aristas *= 2;
+                g->destino = realloc(g->destino, (size_t)g->cap_aristas * sizeof(int));
+                if (!g->destino) { perror("realloc"); exit(1); }
+            }
+            g->destino[g->num_aristas++] = j + 1;
+            g->caminos[i] = cuenta_sumar(g->caminos[i], g->caminos[j + 1], &exacto);
+        }
+        g->fin[i] = g->num_aristas;
+    }
+}
+
+/* Libera la memoria del grafo */
+static void grafo_liberar(Grafo *g) {
+    free(g->inicio);
+    free(g->fin);
+    free(g->destino);
+    free(g->caminos);
+}
+
+/*
+ * grafo_imprimir: Escribe los nodos alcanzables desde 0 (los que estan en
+ * alguna particion) y sus aristas, una por linea: "i j palabra".
+ */
+static void grafo_imprimir(const char *texto, const Grafo *g) {
+    char *alcanzable = calloc((size_t)g->n + 1, 1);
+    if (!alcanzable) { perror("malloc"); exit(1); }
+    int i, e, nodos = 0, aristas = 0;
+
+    alcanzable[0] = 1;
+    for (i = 0; i <= g->n; i++) {
+        if (!alcanzable[i]) continue;
+        nodos++;
+        aristas += g->fin[i] - g->inicio[i];
+        for (e = g->inicio[i]; e < g->fin[i]; e++)
+            alcanzable[g->destino[e]] = 1;
+    }
+
+    printf("Grafo de particiones: %d nodos, %d aristas\n", nodos, aristas);
+    for (i = 0; i < g->n; i++) {
+        if (!alcanzable[i]) continue;
+        for (e = g->inicio[i]; e < g->fin[i]; e++) {
+            printf("%d %d ", i, g->destino[e]);
+            fwrite(texto + i, 1, (size_t)(g->destino[e] - i), stdout);
+            putchar('\n');
+        }
+    }
+    free(alcanzable);
+}
+
+#define ITER_NUEVO 0     /* Aun no se ha pedido la primera particion */
+#define ITER_EN_CURSO 1
+#define ITER_FIN 2       /* No quedan particiones */
+
+/* Recorrido perezoso de los caminos de 0 a n */
+typedef struct {
+    const Grafo *g;
+    int *nodo;          /* nodo[d]: posicion tras d palabras (nodo[0] = 0) */
+    int *arista;        /* arista[d]: arista elegida desde nodo[d] */
+    int prof;           /* Palabras del camino actual */
+    int estado;
+    unsigned long long desde;
+} IteradorParticiones;
+
+/* Prepara el iterador; la primera particion que dara es la numero 'desde' (desde 0) */
+static void iter_iniciar(IteradorParticiones *it, const Grafo *g, unsigned long long desde) {
+    it->g = g;
+    it->nodo = malloc((size_t)(g->n + 1) * sizeof(int));
+    it->arista = malloc((size_t)(g->n + 1) * sizeof(int));
+    if (!it->nodo || !it->arista) { perror("malloc"); exit(1); }
+    it->nodo[0] = 0;
+    it->prof = 0;
+    it->estado = ITER_NUEVO;
+    it->desde = desde;
+}
+
+/*
+ * iter_bajar: Completa el camino desde la profundidad d saltandose los
+ * 'saltar' primeros caminos que hay por debajo. Devuelve 0 si no hay tantos.
+ */
+static int iter_bajar(IteradorParticiones *it, int d, Cuenta saltar) {
+    const Grafo *g = it->g;
+    while (it->nodo[d] != g->n) {
+        int v = it->nodo[d], e;
+        for (e = g->inicio[v]; e < g->fin[v]; e++) {
+            Cuenta c = g->caminos[g->destino[e]];
+            if (saltar < c) break;  /* El camino buscado empieza por esta arista */
+            saltar -= c;
+        }
+        if (e == g->fin[v]) return 0;
+        it->arista[d] = e;
+        it->nodo[d + 1] = g->destino[e];
+        d++;
+    }
+    it->prof = d;
+    return 1;
+}
+
+/* Avanza a la siguiente particion. Devuelve 0 si no quedan */
+static int iter_siguiente(IteradorParticiones *it) {
+    const Grafo *g = it->g;
+    int d;
+
+    if (it->estado == ITER_NUEVO) {
+        it->estado = iter_bajar(it, 0, it->desde) ? ITER_EN_CURSO : ITER_FIN;
+        return it->estado == ITER_EN_CURSO;
+    }
+    if (it->estado == ITER_FIN) return 0;
+
+    /* Retroceder hasta el ultimo nodo con aristas sin probar */
+    for (d = it->prof - 1; d >= 0; d--) {
+        if (it->arista[d] + 1 < g->fin[it->nodo[d]]) {
+            it->arista[d]++;
+            it->nodo[d + 1] = g->destino[it->arista[d]];
+            iter_bajar(it, d + 1, 0);  /* Siempre llega a n */
+            return 1;
+        }
+    }
+    it->estado = ITER_FIN;
+    return 0;
+}
+
+/* Escribe la particion actual con el mismo formato que salida_escribir */
+static void iter_escribir(const IteradorParticiones *it, const char *texto) {
+    int d;
+    fputs(" - '", stdout);
+    for (d = 0; d < it->prof; d++) {
+        if (d > 0)
+            putchar(' ');
+        fwrite(texto + it->nodo[d], 1, (size_t)(it->nodo[d + 1] - it->nodo[d]), stdout);
+    }
+    fputs("'\n", stdout);
+}
+
+/* Libera la memoria del iterador */
+static void iter_liberar(IteradorParticiones *it) {
+    free(it->nodo);
+    free(it->arista);
+}
+
+/*
+ * =============================================================================
+ * SECCION 9: CARGA DE FICHEROS
  * =============================================================================
  *
  * cargar_diccionario: Lee un fichero con una palabra por linea (o separadas
- *                    por espacios) e inserta cada palabra en la tabla hash.
+ *                    por espacios), inserta cada palabra en la tabla hash y
+ *                    en el trie, y al terminar compacta el trie.
  *
  * cargar_texto: Lee la cadena a verificar. Elimina espacios, saltos de linea
- *               y tabulaciones para obtener la cadena sin espacios.
+ *               y tabulaciones para obtener la cadena sin espacios. El buffer
+ *               crece segun hace falta, sin limite de longitud (las
+ *               variantes 1 y 2 rechazan despues los de mas de
+ *               MAX_TEXTO_RECURSIVO caracteres).
  * =============================================================================
  */
 
@@ -445,54 +1342,336 @@ static int cargar_diccionario(const char *fichero, Diccionario *dicc) {
             dicc_insertar(dicc, buf);
     }
     fclose(f);
+    trie_compactar(&dicc->trie);
     return 0;
 }
 
-/* Carga el texto desde fichero (eliminando espacios). Devuelve longitud o -1 si error */
-static int cargar_texto(const char *fichero, char *texto, int max_len) {
-    FILE *f = fopen(fichero, "r");
+/*
+ * Carga el texto desde fichero (eliminando espacios). Devuelve la cadena
+ * reservada con malloc y su longitud en *n, o NULL si hay error.
+ */
+static char *cargar_texto(const char *fichero, int *n) {
+    FILE *f = strcmp(fichero, "-") == 0 ? stdin : fopen(fichero, "r");
     if (!f) {
         fprintf(stderr, "Error: no se pudo abrir el texto '%s'\n", fichero);
-        return -1;
+        return NULL;
     }
+    int cap = 4096;
+    char *texto = malloc((size_t)cap);
+    if (!texto) { perror("malloc"); exit(1); }
     int i = 0;
     int c;
 
     /* Leer caracter a caracter, ignorando espacios y saltos de linea */
-    while (i < max_len - 1 && (c = fgetc(f)) != EOF) {
+    while ((c = fgetc(f)) != EOF) {
         if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
             continue;  /* Omitir blancos */
+        if (i + 1 == cap) {
+            cap *= 2;
+            texto = realloc(texto, (size_t)cap);
+            if (!texto) { perror("realloc"); exit(1); }
+        }
         texto[i++] = (char)c;
     }
     texto[i] = '\0';
-    fclose(f);
-    return i;
+    if (f != stdin)
+        fclose(f);
+    *n = i;
+    return texto;
+}
+
+/*
+ * =============================================================================
+ * SECCION 10: BENCHMARK DEL DICCIONARIO (--bench-dicc)
+ * =============================================================================
+ *
+ * Compara las consultas por segundo de la tabla hash del diccionario con las
+ * de la tabla anterior (4096 cubos fijos con listas enlazadas y un strdup por
+ * palabra), que se conserva aqui solo como referencia. Las consultas son la
+ * mitad palabras del diccionario y la mitad palabras alteradas, generadas
+ * con semilla fija, y se comprueba que ambas tablas responden lo mismo.
+ * =============================================================================
+ */
+
+#define CUBOS_ENCADENADA 4096
+#define REPETICIONES_BENCH 3   /* Se toma la mejor de varias pasadas */
+
+/* Nodo de la lista enlazada de un cubo de la tabla anterior */
+typedef struct NodoHash {
+    char *palabra;
+    struct NodoHash *sig;
+} NodoHash;
+
+typedef struct {
+    NodoHash *buckets[CUBOS_ENCADENADA];
+} TablaEncadenada;
+
+/* Consulta en la tabla anterior (djb2 % 4096 y recorrido de la lista) */
+static int encadenada_contiene(const TablaEncadenada *t, const char *palabra) {
+    NodoHash *n = t->buckets[hash(palabra, (int)strlen(palabra)) % CUBOS_ENCADENADA];
+    while (n) {
+        if (strcmp(n->palabra, palabra) == 0)
+            return 1;
+        n = n->sig;
+    }
+    return 0;
+}
+
+/* Inserta al inicio de la lista del cubo, como hacia la tabla anterior */
+static void encadenada_insertar(TablaEncadenada *t, const char *palabra) {
+    unsigned int idx = hash(palabra, (int)strlen(palabra)) % CUBOS_ENCADENADA;
+    NodoHash *n = malloc(sizeof(NodoHash));
+    if (!n) { perror("malloc"); exit(1); }
+    n->palabra = strdup(palabra);
+    n->sig = t->buckets[idx];
+    t->buckets[idx] = n;
+}
+
+static void encadenada_liberar(TablaEncadenada *t) {
+    int i;
+    for (i = 0; i < CUBOS_ENCADENADA; i++) {
+        NodoHash *n = t->buckets[i];
+        while (n) {
+            NodoHash *sig = n->sig;
+            free(n->palabra);
+            free(n);
+            n = sig;
+        }
+    }
+}
+
+/* Generador congruencial con semilla fija, para que las consultas se repitan */
+static unsigned int aleatorio(unsigned long long *semilla) {
+    *semilla = *semilla * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned int)(*semilla >> 33);
+}
+
+static double segundos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Consultas por segundo de la mejor pasada; *aciertos recibe los de una pasada */
+static double medir_consultas(const Diccionario *d, const TablaEncadenada *t,
+                              char **consultas, int num, long *aciertos) {
+    double mejor = 0;
+    int r, q;
+    for (r = 0; r < REPETICIONES_BENCH; r++) {
+        long a = 0;
+        double ini = segundos();
+        if (d) {
+            for (q = 0; q < num; q++)
+                a += dicc_contiene(d, consultas[q]);
+        } else {
+            for (q = 0; q < num; q++)
+                a += encadenada_contiene(t, consultas[q]);
+        }
+        double v = num / (segundos() - ini);
+        if (v > mejor) mejor = v;
+        *aciertos = a;
+    }
+    return mejor;
+}
+
+/* Modo --bench-dicc. Devuelve 0 si OK, 1 si hay error */
+static int bench_diccionario(const char *fichero, int num_consultas) {
+    Diccionario dicc;
+    if (cargar_diccionario(fichero, &dicc) < 0)
+        return 1;
+    if (dicc.num_palabras == 0) {
+        fprintf(stderr, "Error: el diccionario '%s' esta vacio\n", fichero);
+        dicc_liberar(&dicc);
+        return 1;
+    }
+
+    /* Palabras del arena y tabla anterior con las mismas palabras */
+    const char **palabras = malloc((size_t)dicc.num_palabras * sizeof(char *));
+    TablaEncadenada *anterior = calloc(1, sizeof(TablaEncadenada));
+    if (!palabras || !anterior) { perror("malloc"); exit(1); }
+    size_t pos;
+    int i = 0;
+    for (pos = 0; pos < dicc.arena_usado; pos += strlen(dicc.arena + pos) + 1) {
+        palabras[i++] = dicc.arena + pos;
+        encadenada_insertar(anterior, dicc.arena + pos);
+    }
+
+    /* Consultas: la mitad palabras del diccionario, la otra mitad alteradas */
+    unsigned long long semilla = 12345;
+    char **consultas = malloc((size_t)num_consultas * sizeof(char *));
+    char *texto_consultas = malloc((size_t)num_consultas * (size_t)(dicc.long_max + 2));
+    if (!consultas || !texto_consultas) { perror("malloc"); exit(1); }
+    int q;
+    for (q = 0; q < num_consultas; q++) {
+        char *c = texto_consultas + (size_t)q * (size_t)(dicc.long_max + 2);
+        const char *p = palabras[aleatorio(&semilla) % (unsigned int)dicc.num_palabras];
+        int len = (int)strlen(p);
+        memcpy(c, p, (size_t)len + 1);
+        if (q % 2 == 1) {
+            if (aleatorio(&semilla) % 2 == 0)
+                c[aleatorio(&semilla) % (unsigned int)len] = (char)('a' + aleatorio(&semilla) % 26);
+            else
+                c[len - 1] = '\0';  /* O una letra menos */
+        }
+        consultas[q] = c;
+    }
+
+    /* Estadisticas de ocupacion de ambas tablas */
+    unsigned int c, casillas = dicc.mascara + 1, dist_max = 0;
+    double dist_total = 0;
+    for (c = 0; c < casillas; c++) {
+        if (dicc.casillas[c].len == 0) continue;
+        unsigned int dist = distancia(&dicc, c);
+        dist_total += dist;
+        if (dist > dist_max) dist_max = dist;
+    }
+    int cubos_usados = 0, cadena_max = 0;
+    for (i = 0; i < CUBOS_ENCADENADA; i++) {
+        int largo = 0;
+        NodoHash *n;
+        for (n = anterior->buckets[i]; n; n = n->sig)
+            largo++;
+        if (largo > 0) cubos_usados++;
+        if (largo > cadena_max) cadena_max = largo;
+    }
+
+    printf("Diccionario: %d palabras, longitud maxima %d, arena de %lu bytes\n",
+           dicc.num_palabras, dicc.long_max, (unsigned long)dicc.arena_usado);
+    printf("Tabla abierta:    %u casillas (carga %.2f), distancia media %.2f, maxima %u\n",
+           casillas, (double)dicc.num_palabras / casillas, dist_total / dicc.num_palabras, dist_max);
+    printf("Tabla encadenada: %d cubos, cadena media %.2f, maxima %d\n",
+           CUBOS_ENCADENADA, (double)dicc.num_palabras / cubos_usados, cadena_max);
+
+    /* Comprobar que ambas responden lo mismo antes de medir */
+    long aciertos = 0;
+    for (q = 0; q < num_consultas; q++) {
+        int a = dicc_contiene(&dicc, consultas[q]);
+        if (a != encadenada_contiene(anterior, consultas[q])) {
+            fprintf(stderr, "Error: las tablas no coinciden en '%s'\n", consultas[q]);
+            return 1;
+        }
+        aciertos += a;
+    }
+    printf("Consultas: %d (%ld aciertos), mejor de %d pasadas\n",
+           num_consultas, aciertos, REPETICIONES_BENCH);
+
+    long a1, a2;
+    double v_anterior = medir_consultas(NULL, anterior, consultas, num_consultas, &a1);
+    double v_abierta = medir_consultas(&dicc, NULL, consultas, num_consultas, &a2);
+    printf("  encadenada (anterior):  %8.2f M consultas/s\n", v_anterior / 1e6);
+    printf("  abierta (Robin Hood):   %8.2f M consultas/s  (x%.2f)\n",
+           v_abierta / 1e6, v_abierta / v_anterior);
+
+    free(consultas);
+    free(texto_consultas);
+    free(palabras);
+    encadenada_liberar(anterior);
+    free(anterior);
+    dicc_liberar(&dicc);
+    return (a1 == aciertos && a2 == aciertos) ? 0 : 1;
 }
 
 /*
  * =============================================================================
- * SECCION 7: FUNCION MAIN
+ * SECCION 11: FUNCION MAIN
  * =============================================================================
  *
  * Flujo: 1) Validar argumentos
- *        2) Cargar diccionario y texto
- *        3) Ejecutar variante seleccionada (1, 2 o 3)
- *        4) Mostrar resultado (Si/No y lista de particiones si aplica)
+ *        2) Cargar diccionario y texto (la variante 4 lee el texto ella misma)
+ *        3) Ejecutar variante seleccionada (1, 2 o 3), o solo contar (--contar)
+ *        4) Mostrar resultado (Si/No y las particiones segun se encuentran)
  *        5) Liberar memoria
  * =============================================================================
  */
 
+/* Lee el valor numerico de una opcion. Devuelve 0 si OK, -1 si no es valido */
+static int leer_numero(const char *opcion, const char *valor, unsigned long long *n) {
+    char *fin;
+    if (!valor || !isdigit((unsigned char)valor[0])) {
+        fprintf(stderr, "Error: %s necesita un numero\n", opcion);
+        return -1;
+    }
+    *n = strtoull(valor, &fin, 10);
+    if (*fin != '\0') {
+        fprintf(stderr, "Error: valor no valido para %s: '%s'\n", opcion, valor);
+        return -1;
+    }
+    return 0;
+}
+
 int main(int argc, char **argv) {
     /* ---------- 1. Validar argumentos ---------- */
-    if (argc != 4) {
-        fprintf(stderr, "Uso: %s <var> <diccionario> <texto>\n", argv[0]);
-        fprintf(stderr, "  var: 1 (recursivo), 2 (recursivo con memoria), 3 (tabla)\n");
+    if (argc >= 3 && strcmp(argv[1], "--bench-dicc") == 0) {
+        int consultas = argc > 3 ? atoi(argv[3]) : 1000000;
+        if (consultas <= 0) {
+            fprintf(stderr, "Error: el numero de consultas debe ser positivo\n");
+            return 1;
+        }
+        return bench_diccionario(argv[2], consultas);
+    }
+
+    if (argc < 4) {
+        fprintf(stderr, "Uso: %s <var> <diccionario> <texto> [opciones]\n", argv[0]);
+        fprintf(stderr, "  var: 1 (recursivo), 2 (recursivo con memoria), 3 (tabla), 4 (flujo)\n");
+        fprintf(stderr, "  texto: fichero, o - para la entrada estandar\n");
+        fprintf(stderr, "Opciones:\n");
+        fprintf(stderr, "  --busqueda M busqueda de prefijos: trie (por defecto) o hash\n");
+        fprintf(stderr, "Opciones de listado (variantes 1 a 3):\n");
+        fprintf(stderr, "  --contar    muestra el numero de particiones en vez de listarlas\n");
+        fprintf(stderr, "  --dag       muestra el grafo de particiones en vez de listarlas\n");
+        fprintf(stderr, "  --limite N  lista como mucho N particiones (0 = todas, por defecto %d)\n",
+                MAX_PARTICIONES);
+        fprintf(stderr, "  --desde N   salta las N primeras particiones\n");
+        fprintf(stderr, "Benchmark de la tabla hash: %s --bench-dicc <diccionario> [consultas]\n", argv[0]);
         return 1;
     }
 
     int var = atoi(argv[1]);
-    if (var < 1 || var > 3) {
-        fprintf(stderr, "Error: var debe ser 1, 2 o 3\n");
+    if (var < 1 || var > 4) {
+        fprintf(stderr, "Error: var debe ser 1, 2, 3 o 4\n");
+        return 1;
+    }
+
+    int contar = 0, dag = 0, limite_explicito = 0, opciones_listado = 0;
+    int busqueda = BUSQUEDA_TRIE;
+    Salida salida = { 0, MAX_PARTICIONES, 0, 0, 0 };
+    int a;
+    for (a = 4; a < argc; a++) {
+        if (strcmp(argv[a], "--busqueda") == 0) {
+            if (a + 1 < argc && strcmp(argv[a + 1], "trie") == 0) {
+                busqueda = BUSQUEDA_TRIE;
+            } else if (a + 1 < argc && strcmp(argv[a + 1], "hash") == 0) {
+                busqueda = BUSQUEDA_HASH;
+            } else {
+                fprintf(stderr, "Error: --busqueda debe ser trie o hash\n");
+                return 1;
+            }
+            a++;
+            continue;
+        }
+        opciones_listado = 1;
+        if (strcmp(argv[a], "--contar") == 0) {
+            contar = 1;
+        } else if (strcmp(argv[a], "--dag") == 0) {
+            dag = 1;
+        } else if (strcmp(argv[a], "--limite") == 0) {
+            if (leer_numero(argv[a], argv[a + 1], &salida.limite) < 0) return 1;
+            limite_explicito = 1;
+            a++;
+        } else if (strcmp(argv[a], "--desde") == 0) {
+            if (leer_numero(argv[a], argv[a + 1], &salida.desde) < 0) return 1;
+            a++;
+        } else {
+            fprintf(stderr, "Error: opcion desconocida '%s'\n", argv[a]);
+            return 1;
+        }
+    }
+    if (var == 4 && opciones_listado) {
+        fprintf(stderr, "Error: la variante 4 solo admite --busqueda\n");
+        return 1;
+    }
+    if (contar && dag) {
+        fprintf(stderr, "Error: --contar y --dag no se pueden usar juntas\n");
         return 1;
     }
 
@@ -503,63 +1682,118 @@ int main(int argc, char **argv) {
     Diccionario dicc;
     if (cargar_diccionario(fichero_dicc, &dicc) < 0)
         return 1;
+    dicc.busqueda = busqueda;
 
-    char texto[MAX_TEXTO];
-    int n = cargar_texto(fichero_texto, texto, MAX_TEXTO);
-    if (n < 0) {
+    if (var == 4) {
+        /* Variante 4: lee, resuelve y escribe por tramos */
+        int ret = segmentar_flujo(fichero_texto, &dicc);
+        dicc_liberar(&dicc);
+        return ret;
+    }
+
+    int n;
+    char *texto = cargar_texto(fichero_texto, &n);
+    if (!texto) {
+        dicc_liberar(&dicc);
+        return 1;
+    }
+    if ((var == 1 || var == 2) && !contar && !dag && n > MAX_TEXTO_RECURSIVO) {
+        /* La recursion llega a n llamadas anidadas y desbordaria la pila */
+        fprintf(stderr, "Error: el texto tiene %d caracteres y las variantes 1 y 2 admiten como mucho %d; usa la variante 3 o 4\n",
+                n, MAX_TEXTO_RECURSIVO);
+        free(texto);
         dicc_liberar(&dicc);
         return 1;
     }
 
-    /* ---------- 3. Ejecutar algoritmo segun variante ---------- */
-    int puede = 0;
-    ListaParticiones particiones;
-    lista_particiones_init(&particiones);
-
-    if (var == 1) {
-        /* Variante 1: recursivo puro */
-        puede = puede_recursivo(texto, n, 0, &dicc);
-        if (puede)
-            particiones_recursivo(texto, n, 0, &dicc,
-                                 (char[MAX_TEXTO]){0}, 0, &particiones);
-    } else if (var == 2) {
-        /* Variante 2: recursivo con memoizacion */
-        int *mem = calloc((size_t)(n + 1), sizeof(int));
-        if (!mem) { perror("malloc"); dicc_liberar(&dicc); return 1; }
-        {
-            int i;
-            for (i = 0; i <= n; i++) mem[i] = MEM_UNSET;
+    if (contar) {
+        /* Solo el numero de particiones, sin construir ninguna */
+        Cuenta total;
+        int exacto = contar_particiones(texto, n, &dicc, &total);
+        if (total == 0) {
+            printf("No.\n");
+        } else {
+            printf("Si.\n");
+            printf("Numero de particiones: ");
+            if (exacto)
+                imprimir_cuenta(total);
+            else
+                contar_particiones_exacto(texto, n, &dicc);
+            printf("\n");
         }
-        puede = puede_memo(texto, n, 0, &dicc, mem);
-        if (puede)
-            particiones_con_memo(texto, n, &dicc, &particiones);
-        free(mem);
-    } else {
-        /* Variante 3: iterativo con tabla */
+        free(texto);
+        dicc_liberar(&dicc);
+        return 0;
+    }
+
+    /* ---------- 3 y 4. Ejecutar la variante y mostrar el resultado ---------- */
+    /* Las particiones se escriben segun se encuentran, tras la cabecera */
+    const char *cabecera = "Si.\nLa cadena se puede segmentar como:\n";
+    int puede = 0;
+
+    if (var == 3 || dag) {
+        /* Variante 3 (o --dag): tabla, grafo de particiones e iterador */
         int *posible = calloc((size_t)(n + 1), sizeof(int));
-        if (!posible) { perror("malloc"); dicc_liberar(&dicc); return 1; }
+        if (!posible) { perror("malloc"); exit(1); }
         llenar_tabla(texto, n, &dicc, posible);
         puede = posible[0];
         if (puede) {
-            char actual[MAX_TEXTO];
-            particiones_tabla_aux(texto, n, 0, &dicc, posible, actual, 0, &particiones);
+            Grafo g;
+            grafo_construir(texto, n, &dicc, posible, &g);
+            if (dag) {
+                printf("Si.\n");
+                grafo_imprimir(texto, &g);
+            } else {
+                IteradorParticiones it;
+                fputs(cabecera, stdout);
+                iter_iniciar(&it, &g, salida.desde);
+                while (iter_siguiente(&it) && !salida_completa(&salida)) {
+                    iter_escribir(&it, texto);
+                    salida.escritas++;
+                }
+                iter_liberar(&it);
+            }
+            grafo_liberar(&g);
         }
         free(posible);
+    } else {
+        /* Buffer para construir cada particion: n letras, n-1 espacios y el '\0' */
+        char *actual = malloc((size_t)n * 2 + 1);
+        if (!actual) { perror("malloc"); exit(1); }
+
+        if (var == 1) {
+            /* Variante 1: recursivo puro */
+            puede = puede_recursivo(texto, n, 0, &dicc);
+            if (puede) {
+                fputs(cabecera, stdout);
+                particiones_recursivo(texto, n, 0, &dicc, actual, 0, &salida);
+            }
+        } else {
+            /* Variante 2: recursivo con memoizacion */
+            int *mem = calloc((size_t)(n + 1), sizeof(int));
+            if (!mem) { perror("malloc"); exit(1); }
+            {
+                int i;
+                for (i = 0; i <= n; i++) mem[i] = MEM_UNSET;
+            }
+            puede = puede_memo(texto, n, 0, &dicc, mem);
+            if (puede) {
+                fputs(cabecera, stdout);
+                particiones_con_memo(texto, n, &dicc, actual, &salida);
+            }
+            free(mem);
+        }
+        free(actual);
     }
 
-    /* ---------- 4. Mostrar resultado ---------- */
-    if (puede) {
-        printf("Si.\n");
-        printf("La cadena se puede segmentar como:\n");
-        int i;
-        for (i = 0; i < particiones.n; i++)
-            printf(" - '%s'\n", particiones.lineas[i]);
-    } else {
+    if (!puede)
         printf("No.\n");
-    }
+    else if (salida.hay_mas && !limite_explicito)
+        fprintf(stderr, "Aviso: solo se muestran las primeras %d particiones (--limite 0 las muestra todas, --contar da el total)\n",
+                MAX_PARTICIONES);
 
     /* ---------- 5. Liberar memoria ---------- */
-    lista_particiones_liberar(&particiones);
+    free(texto);
     dicc_liberar(&dicc);
     return 0;
 }
@@ -66,6 +66,26 @@ echo "------------------------------------------"
 ./separarPalabras 3 pruebas/diccionario_ejemplo.txt pruebas/texto_helado.txt
 echo ""
 
+# Caso 6: megustasoldar en flujo - Solo la primera particion
+echo "------------------------------------------"
+echo "Caso 6: megustasoldar (variante 4 - flujo)"
+echo "------------------------------------------"
+./separarPalabras 4 pruebas/diccionario_ejemplo.txt pruebas/texto_megustasoldar.txt
+echo ""
+
+# Caso 7: texto largo - Las variantes recursivas lo rechazan en vez de desbordar la pila
+echo "------------------------------------------"
+echo "Caso 7: 100000 letras 'a' (variante 2 rechaza, variante 3 cuenta)"
+echo "------------------------------------------"
+DICC_AB=$(mktemp)
+TEXTO_LARGO=$(mktemp)
+printf 'a\nb\n' > "${DICC_AB}"
+head -c 100000 /dev/zero | tr '\0' 'a' > "${TEXTO_LARGO}"
+./separarPalabras 2 "${DICC_AB}" "${TEXTO_LARGO}"
+./separarPalabras 3 "${DICC_AB}" "${TEXTO_LARGO}" --contar
+rm -f "${DICC_AB}" "${TEXTO_LARGO}"
+echo ""
+
 echo "=========================================="
 echo "Ejecucion completada"
 echo "=========================================="
@@ -103,8 +123,8 @@ for TAM in 100 1000 5000; do
     for VAR in 1 2 3; do
         echo "  -- Variante ${VAR} --"
         # Todas las variantes tienen timeout: la 1 por coste exponencial en la decision,
-        # la 2 y 3 porque la enumeracion de TODAS las particiones puede ser exponencial
-        # si hay muchas combinaciones validas (independientemente de la variante).
+        # y la 1 y la 2 porque su enumeracion recursiva explora tambien ramas muertas
+        # antes de llegar a las 10000 particiones que se muestran por defecto.
         { time timeout 60 ./separarPalabras ${VAR} "${DICC}" "${TEXTO_VALIDO}"; } 2>&1
         RET=$?
         if [ ${RET} -eq 124 ]; then